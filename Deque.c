@@ -27,7 +27,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdint.h>
-#include "deque.h"
+#include "Deque.h"
 #ifndef DEQUE_STATIC
 #include <malloc.h>
 #endif /* DEQUE_STATIC */
@@ -64,42 +64,204 @@ deque_init(Deque d, deque_comparater_t compare_func) {
 		d->compare_func = compare_func;
 	}
 
-	/* initialize the state of the rest of the deque */
+	/* initialize the state of the rest of the deque, the items of a static
+	* one are left as they are */
+#ifdef DEQUE_STATIC
+	d->first = 0;
+#else
 	d->head = NULL;
 	d->tail = NULL;
-	d->number_items = 0;
-    
-#ifdef DEQUE_STATIC
-    int i;
-    for (i = 0; i < sizeof(d->nodes)/sizeof(d->nodes[0]); i++) {
-        d->nodes[i].value  = NULL;
-        d->nodes[i].next   = NULL;
-        d->nodes[i].prev   = NULL;
-        d->nodes[i].in_use = false;
-    }    
 #endif /* DEQUE_STATIC */
+	d->number_items = 0;
 }
 
 
 #ifdef DEQUE_STATIC
-static struct deque_node_t *
-deque_alloc_node(Deque d) {
-	struct deque_node_t * node;
-	int i = 0;
-	/* find the first unused node */
-	while ((node = &d->nodes[i++])->in_use)
-        ;
-	if (node != NULL)
-		node->in_use = true;
-	return node;
+/* The static deque is a ring buffer, items[(first + i) & DEQUE_MASK] being
+* the i:th item from the left (tail).
+*/
+#define DEQUE_MASK (DEQUE_MAX_NODES - 1)
+
+/* DEQUE_MAX_NODES shall be a power of two */
+typedef char deque_max_nodes_check[(DEQUE_MAX_NODES & DEQUE_MASK) == 0 ? 1 : -1];
+
+#define DEQUE_ITEM(d, i) ((d)->items[((d)->first + (i)) & DEQUE_MASK])
+
+/* Append the specified item to the right end of the deque (head).
+*/
+deque_result_t
+deque_append(Deque d, void* item) {
+	assert(d != NULL);
+	if (d->number_items == DEQUE_MAX_NODES) {
+		return DEQUE_ALLOC_ERROR;
+	}
+	DEQUE_ITEM(d, d->number_items) = item;
+	d->number_items++;
+	return DEQUE_SUCCESS;
 }
 
-static void
-deque_free_node(struct deque_node_t * node) {
-	node->in_use = false;
+/* Append the specified item to the left end of the deque (tail).
+*/
+deque_result_t
+deque_appendleft(Deque d, void* item) {
+	assert(d != NULL);
+	if (d->number_items == DEQUE_MAX_NODES) {
+		return DEQUE_ALLOC_ERROR;
+	}
+	d->first = (d->first - 1) & DEQUE_MASK;
+	d->items[d->first] = item;
+	d->number_items++;
+	return DEQUE_SUCCESS;
+}
+
+/* Clear the specified deque, this will not free anything the items are
+* pointing to.
+*
+* This operation is O(1), constant time.
+*/
+deque_result_t
+deque_clear(Deque d) {
+	assert(d != NULL);
+	d->first = 0;
+	d->number_items = 0;
+	return DEQUE_SUCCESS;
+}
+
+/* Remove the count leftmost elements, or all if there are fewer.
+*
+* This operation is O(1), constant time.
+*/
+void
+deque_popnleft(Deque d, uint32_t count) {
+	if (count > d->number_items) {
+		count = d->number_items;
+	}
+	d->first = (d->first + count) & DEQUE_MASK;
+	d->number_items -= count;
+}
+
+/* Remove the rightmost element from the deque and return a reference to the
+* value.  If there is no rightmost element then NULL will be returned.
+*
+* This operation is O(1), constant time.
+*/
+void*
+deque_pop(Deque d) {
+	if (d->number_items == 0) {
+		return NULL;
+	}
+	d->number_items--;
+	return DEQUE_ITEM(d, d->number_items);
+}
+
+/* Get the value of the deque head or NULL if the deque is empty */
+void*
+deque_peek(Deque d) {
+	if (d->number_items == 0) {
+		return NULL;
+	}
+	return DEQUE_ITEM(d, d->number_items - 1);
+}
+
+/* Remove the leftmost element from the deque and return a reference to the
+* value.  If there is no leftmost element then NULL will be returned.
+*
+* This operation is O(1), constant time.
+*/
+void*
+deque_popleft(Deque d) {
+	void* value;
+	if (d->number_items == 0) {
+		return NULL;
+	}
+	value = d->items[d->first];
+	d->first = (d->first + 1) & DEQUE_MASK;
+	d->number_items--;
+	return value;
+}
+
+/* Get the value of the deque tail (leftmost element) or NULL if empty */
+void*
+deque_peekleft(Deque d) {
+	if (d->number_items == 0) {
+		return NULL;
+	}
+	return d->items[d->first];
+}
+
+/* Remove the first occurrence of item from the deque, starting from the left.
+* A reference to the removed value will be returned, otherwise NULL will be
+* returned (if the item cannot be found).
+*
+* This operation executes in O(n) time where n is the number of elements in
+* the deque, the items to the right of the removed one are moved one step.
+*/
+void*
+deque_remove(Deque d, void* item) {
+	uint32_t i;
+	void* value;
+	for (i = 0; i < d->number_items; i++) {
+		if ((d->compare_func)(DEQUE_ITEM(d, i), item) == 0) {
+			value = DEQUE_ITEM(d, i);
+			for (; i + 1 < d->number_items; i++) {
+				DEQUE_ITEM(d, i) = DEQUE_ITEM(d, i + 1);
+			}
+			d->number_items--;
+			return value;
+		}
+	}
+	return NULL; /* item not found in deque */
+}
+
+/* Rotate the deque n steps to the right */
+void
+deque_rotateright(Deque d, uint32_t n) {
+	uint32_t i;
+	if (d->number_items == 0) {
+		return;
+	}
+	for (i = 0; i < n; i++) {
+		deque_appendleft(d, deque_pop(d));
+	}
+}
+
+/* Rotate the deque n steps to the left */
+void
+deque_rotateleft(Deque d, uint32_t n) {
+	uint32_t i;
+	if (d->number_items == 0) {
+		return;
+	}
+	for (i = 0; i < n; i++) {
+		deque_append(d, deque_popleft(d));
+	}
+}
+
+/* Reverse the order of the items in the deque */
+void
+deque_reverse(Deque d) {
+	uint32_t i;
+	void* tmp;
+	for (i = 0; i < d->number_items / 2; i++) {
+		tmp = DEQUE_ITEM(d, i);
+		DEQUE_ITEM(d, i) = DEQUE_ITEM(d, d->number_items - 1 - i);
+		DEQUE_ITEM(d, d->number_items - 1 - i) = tmp;
+	}
 }
+
+/* Return position starting @ 1 if the deque contains the specified item and 0 if not */
+uint32_t
+deque_contains(Deque d, void* item) {
+	uint32_t i;
+	for (i = 0; i < d->number_items; i++) {
+		if ((d->compare_func)(DEQUE_ITEM(d, i), item) == 0) {
+			return i + 1;
+		}
+	}
+	return 0; /* item not found in deque */
+}
+
 #else
-#include <malloc.h>
 static struct deque_node_t *
 deque_alloc_node(Deque d) {
 	return (struct deque_node_t *)malloc(sizeof(struct deque_node_t));
@@ -152,14 +314,6 @@ deque_copy(Deque d) {
 	}
 	return newDeque;
 }
-#endif /* DEQUE_STATIC */
-
-/* Free the data allocated for the deque and all nodes */
-void
-deque_free(Deque d) {
-	deque_clear(d);
-	free(d);
-}
 
 /* Append the specified item to the right end of the deque (head).
 */
@@ -352,33 +506,6 @@ deque_remove(Deque d, void* item) {
 	return NULL; /* item not found in deque */
 }
 
-/* Rotate the deque n steps to the right.  If n is negative, rotate the deque
-* to the left.  Here is a set of equivalent operations that gives you an idea
-* of what the rotate operations:
-*
-* -- These are equivalent --
-* deque_rotate(d, 1);
-* deque_rotateright(d, 1);
-* deque_appendleft(deque_pop());
-*
-* -- These are equivalent --
-* deque_rotate(d, -1);
-* deque_rotateleft(d, 1);
-* deque_append(deque_popleft());
-*
-* The rotate operation is O(m) where m is the absolute value of the number of
-* steps we are rotating.
-*/
-void
-deque_rotate(Deque d, int32_t n) {
-	if (n > 0) {
-		deque_rotateright(d, n);
-	}
-	else if (n < 0) {
-		deque_rotateleft(d, abs(n));
-	}
-}
-
 /* Rotate the deque n steps to the right */
 void
 deque_rotateright(Deque d, uint32_t n) {
@@ -427,12 +554,6 @@ deque_rotateleft(Deque d, uint32_t n) {
 	}
 }
 
-/* Return the number of items in the deque */
-uint32_t
-deque_count(Deque d) {
-	return d->number_items;
-}
-
 /* Reverse the order of the items in the deque */
 void
 deque_reverse(Deque d) {
@@ -465,4 +586,47 @@ deque_contains(Deque d, void* item) {
         pos++;
 	}
 	return 0; /* item not found in deque */
-}
\ No newline at end of file
+}
+#endif /* DEQUE_STATIC */
+
+#ifndef SM_NO_MALLOC
+/* Free the data allocated for the deque and all nodes */
+void
+deque_free(Deque d) {
+	deque_clear(d);
+	free(d);
+}
+#endif /* SM_NO_MALLOC */
+
+/* Rotate the deque n steps to the right.  If n is negative, rotate the deque
+* to the left.  Here is a set of equivalent operations that gives you an idea
+* of what the rotate operations:
+*
+* -- These are equivalent --
+* deque_rotate(d, 1);
+* deque_rotateright(d, 1);
+* deque_appendleft(deque_pop());
+*
+* -- These are equivalent --
+* deque_rotate(d, -1);
+* deque_rotateleft(d, 1);
+* deque_append(deque_popleft());
+*
+* The rotate operation is O(m) where m is the absolute value of the number of
+* steps we are rotating.
+*/
+void
+deque_rotate(Deque d, int32_t n) {
+	if (n > 0) {
+		deque_rotateright(d, n);
+	}
+	else if (n < 0) {
+		deque_rotateleft(d, abs(n));
+	}
+}
+
+/* Return the number of items in the deque */
+uint32_t
+deque_count(Deque d) {
+	return d->number_items;
+}
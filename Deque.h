@@ -28,8 +28,10 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+/* A static deque is a ring buffer of DEQUE_MAX_NODES items, which shall be
+* a power of two. Appending to a full one fails with DEQUE_ALLOC_ERROR.
+*/
 #define DEQUE_STATIC
-#define DEQUE_MAX_NODES (10)
 
 typedef enum {
 	DEQUE_SUCCESS = 0,
@@ -41,16 +43,21 @@ typedef enum {
 #define FALSE (false)
 
 #ifndef DEQUE_MAX_NODES
-#define DEQUE_MAX_NODES (20)
+#define DEQUE_MAX_NODES (32)
 #endif
 
+#ifdef DEQUE_STATIC
+struct deque_t {
+	void* items[DEQUE_MAX_NODES];
+	uint32_t first; /* index of the leftmost item */
+	uint32_t number_items;
+	int8_t(*compare_func)(const void *, const void *);
+};
+#else
 struct deque_node_t {
 	void* value;
 	struct deque_node_t *next;
 	struct deque_node_t *prev;
-#ifdef DEQUE_STATIC
-	bool in_use;
-#endif
 };
 
 struct deque_t {
@@ -58,10 +65,8 @@ struct deque_t {
 	struct deque_node_t *tail;
 	uint32_t number_items;
 	int8_t(*compare_func)(const void *, const void *);
-#ifdef DEQUE_STATIC
-	struct deque_node_t nodes[DEQUE_MAX_NODES];
-#endif
 };
+#endif /* DEQUE_STATIC */
 
 typedef struct deque_node_t *DequeNode;
 typedef struct deque_t *Deque;
@@ -72,7 +77,9 @@ Deque           deque_create(deque_comparater_t comp);
 Deque           deque_copy(Deque d);
 #endif
 void            deque_init(Deque d, deque_comparater_t comp);
+#ifndef SM_NO_MALLOC
 void            deque_free(Deque d);
+#endif
 deque_result_t  deque_append(Deque d, void* item);
 deque_result_t  deque_appendleft(Deque d, void* item);
 deque_result_t  deque_clear(Deque d);
@@ -0,0 +1,195 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmActiveObject.h
+// Author        Tommy Carlsson (topcatse)
+//
+// This file contains the interfaces of SmActiveObject.
+//==============================================================================
+#pragma once
+#if !defined ( BASE_SM_ACTIVE_OBJECT_H_ )
+#define BASE_SM_ACTIVE_OBJECT_H_
+//==============================================================================
+
+#include "StateMachine.h"
+#include "SmEventQueue.h"
+#include "SmExecutor.h"
+
+//==============================================================================
+namespace Base {
+//==============================================================================
+
+/**
+ * A StateMachine with an event queue of its own. Events are posted from any
+ * thread and dispatched one at a time, run to completion, by the single
+ * thread that calls pump() or run(). OWNER derives from this class instead
+ * of StateMachine.
+ *
+ * Alternatively attach() the object to an SmExecutor, which then dispatches
+ * its events on a worker thread as they are posted. Do not call pump() or
+ * run() on an attached object. Posting with SM_BLOCK from a worker to a
+ * full queue may deadlock; use SM_SPIN or tryPost() there.
+ */
+template < class OWNER,
+           class T            = int,
+           unsigned CAPACITY  = 256,
+           unsigned MAX_DEPTH = 16 >
+class SmActiveObject : public StateMachine< OWNER, T, MAX_DEPTH >
+                     , public SmRunnable
+{
+    typedef SmEvent< T > UserEvent;
+
+public:
+    /// Queue an event for dispatch. Any thread.
+    /// policy: how to wait if the queue is full.
+    void post( UserEvent* e, SmWaitPolicy policy = SM_BLOCK );
+
+    /// Queue an event for dispatch unless the queue is full. Any thread.
+    bool tryPost( UserEvent* e );
+
+    /// Dispatch the queued events, until the queue is empty.
+    /// Returns the number of events dispatched.
+    std::size_t pump();
+
+    /// Dispatch events as they arrive, sleeping while there are none,
+    /// until stop() is called.
+    void run();
+
+    /// Make run() return once the event being dispatched is done.
+    /// Any thread.
+    void stop();
+
+protected:
+    /// Constructor.
+    SmActiveObject() : stopped_( false ) {}
+
+    /// Dtor. This class is not to be derived from but by OWNER.
+    ~SmActiveObject() {}
+
+private:
+    /// Dispatch at most budget queued events. Executor worker only.
+    bool runSlice( unsigned budget );
+
+    bool hasWork() const { return !queue_.empty(); }
+
+    SmEventQueue< UserEvent*, CAPACITY > queue_;
+    std::atomic< bool >                  stopped_;
+};
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned CAPACITY, unsigned MAX_DEPTH >
+void
+SmActiveObject< OWNER, T, CAPACITY, MAX_DEPTH >::post( UserEvent*   e,
+                                                       SmWaitPolicy policy )
+{
+    SM_TRACE( "SmActiveObject::post" );
+    assert( e && "Bad event to SmActiveObject::post" );
+    queue_.push( e, policy );
+    schedule();
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned CAPACITY, unsigned MAX_DEPTH >
+bool
+SmActiveObject< OWNER, T, CAPACITY, MAX_DEPTH >::tryPost( UserEvent* e )
+{
+    SM_TRACE( "SmActiveObject::tryPost" );
+    assert( e && "Bad event to SmActiveObject::tryPost" );
+    if ( !queue_.tryPush( e ) )
+    {
+        return false;
+    }
+    schedule();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned CAPACITY, unsigned MAX_DEPTH >
+std::size_t
+SmActiveObject< OWNER, T, CAPACITY, MAX_DEPTH >::pump()
+{
+    SM_TRACE( "SmActiveObject::pump" );
+
+    std::size_t count = 0;
+    UserEvent*  e;
+
+    while ( queue_.tryPop( e ) )
+    {
+        this->dispatch( e );
+        ++count;
+    }
+    return count;
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned CAPACITY, unsigned MAX_DEPTH >
+bool
+SmActiveObject< OWNER, T, CAPACITY, MAX_DEPTH >::runSlice( unsigned budget )
+{
+    SM_TRACE( "SmActiveObject::runSlice" );
+
+    UserEvent* e;
+
+    for ( unsigned i = 0; i < budget; ++i )
+    {
+        if ( !queue_.tryPop( e ) )
+        {
+            return false;
+        }
+        this->dispatch( e );
+    }
+    return !queue_.empty();
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned CAPACITY, unsigned MAX_DEPTH >
+void
+SmActiveObject< OWNER, T, CAPACITY, MAX_DEPTH >::run()
+{
+    SM_TRACE( "SmActiveObject::run" );
+
+    UserEvent* e;
+
+    for ( ;; )
+    {
+        // Before stopped_, so that a stop() after the check wakes the wait.
+        uint32_t seen = queue_.ticket();
+        if ( stopped_.load( std::memory_order_acquire ) )
+        {
+            break;
+        }
+
+        if ( queue_.tryPop( e ) )
+        {
+            this->dispatch( e );
+        }
+        else
+        {
+            queue_.wait( seen );
+        }
+    }
+    stopped_.store( false, std::memory_order_relaxed );
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned CAPACITY, unsigned MAX_DEPTH >
+void
+SmActiveObject< OWNER, T, CAPACITY, MAX_DEPTH >::stop()
+{
+    SM_TRACE( "SmActiveObject::stop" );
+    stopped_.store( true, std::memory_order_release );
+    queue_.wake();
+}
+
+//------------------------------------------------------------------------------
+} // namespace Base {
+//------------------------------------------------------------------------------
+
+//==============================================================================
+#endif /* BASE_SM_ACTIVE_OBJECT_H_ */
+//==============================================================================
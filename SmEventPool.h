@@ -0,0 +1,309 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmEventPool.h
+// Author        Tommy Carlsson (topcatse)
+//
+// This file contains the interfaces of SmEventPool.
+//==============================================================================
+#pragma once
+#if !defined ( BASE_SM_EVENT_POOL_H_ )
+#define BASE_SM_EVENT_POOL_H_
+//==============================================================================
+
+#include "StateMachine.h"
+
+// ANSI/STL
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//==============================================================================
+namespace Base {
+//==============================================================================
+
+// This section should be defined elsewhere.
+
+/// Payload bytes held inline by a pooled event, see SmEventPool.
+#if !defined ( SM_EVENT_PAYLOAD_SIZE )
+#   define SM_EVENT_PAYLOAD_SIZE 48
+#endif /* SM_EVENT_PAYLOAD_SIZE */
+
+/// Events taken from the heap at a time by a pool that has run dry.
+#if !defined ( SM_EVENT_POOL_CHUNK )
+#   define SM_EVENT_POOL_CHUNK 64
+#endif /* SM_EVENT_POOL_CHUNK */
+
+//==============================================================================
+
+/**
+ * Per thread pools of SmEvent< T >, each with room for a payload of up to
+ * SIZE bytes inline. An event is returned to the pool of the thread that
+ * made it once dispatched (see StateMachine::dispatch()), by whichever
+ * thread dispatched it, so that steady traffic neither allocates nor
+ * frees. A pooled event shall be dispatched once, or else released.
+ *
+ *   machine.post( SmEventPool< Order >::make( SIG_ORDER, id, quantity ) );
+ *
+ * Events are taken from the heap SM_EVENT_POOL_CHUNK at a time while the
+ * pools grow, and are never given back. The pool of a thread that exits
+ * is taken over by the next thread that needs one.
+ */
+template < class T = int, std::size_t SIZE = SM_EVENT_PAYLOAD_SIZE >
+class SmEventPool
+{
+public:
+    typedef SmEvent< T >               UserEvent;
+    typedef typename UserEvent::Signal Signal;
+
+    /// A pooled event of given signal, its payload a U made from args.
+    /// U is T or derived from T.
+    template < class U = T, class... ARGS >
+    static UserEvent* make( Signal const& signal, ARGS&&... args );
+
+    /// A pooled event of given signal without payload.
+    static UserEvent* event( Signal const& signal );
+
+private:
+    struct Pool;
+
+    /// A pooled event and its payload.
+    struct Block : UserEvent
+    {
+        Block() : UserEvent( 0 ), next( 0 ), pool( 0 ), destroy( 0 ) {}
+
+        Block* next;
+        Pool*  pool;
+
+        /// Destructor of the payload, 0 if there is none to call.
+        void ( *destroy )( void* );
+
+        alignas( std::max_align_t ) unsigned char payload[ SIZE ];
+    };
+
+    /// The events of one thread.
+    struct Pool
+    {
+        Pool() : free( 0 ), remote( 0 ) {}
+
+        /// Events to reuse. Owner thread only.
+        Block*                free;
+
+        /// Events released by other threads.
+        std::atomic< Block* > remote;
+    };
+
+    /// Takes a pool over, or makes one, for the lifetime of a thread.
+    struct Holder
+    {
+        Holder();
+        ~Holder();
+
+        Pool* pool;
+    };
+
+    /// Pools of threads that have exited.
+    struct Orphans
+    {
+        std::mutex           lock;
+        std::vector< Pool* > pools;
+    };
+
+    static Orphans& orphans();
+
+    /// The pool of the calling thread, made on first use.
+    static Pool& pool();
+
+    /// The pool of the calling thread, 0 if it has none.
+    static Pool*& current();
+
+    /// An event of the calling thread's pool.
+    static Block* allocate();
+
+    /// Back to its pool, see SmEvent::release().
+    static void release( UserEvent* e );
+
+    template < class U >
+    static void destroy( void* payload )
+    {
+        static_cast< U* >( payload )->~U();
+    }
+};
+
+//------------------------------------------------------------------------------
+
+template < class T, std::size_t SIZE >
+template < class U, class... ARGS >
+typename SmEventPool< T, SIZE >::UserEvent*
+SmEventPool< T, SIZE >::make( Signal const& signal, ARGS&&... args )
+{
+    static_assert( std::is_same< T, U >::value || std::is_base_of< T, U >::value,
+                   "SmEventPool payload shall be a T" );
+    static_assert( sizeof( U ) <= SIZE,
+                   "SmEventPool payload exceeds SIZE" );
+    static_assert( alignof( U ) <= alignof( std::max_align_t ),
+                   "SmEventPool payload is overaligned" );
+
+    Block* block = allocate();
+
+    block->ptr_    = new ( block->payload ) U( std::forward< ARGS >( args )... );
+    block->destroy = std::is_trivially_destructible< U >::value
+                     ? 0
+                     : &SmEventPool::destroy< U >;
+    block->signal( signal );
+    return block;
+}
+
+//------------------------------------------------------------------------------
+
+template < class T, std::size_t SIZE >
+typename SmEventPool< T, SIZE >::UserEvent*
+SmEventPool< T, SIZE >::event( Signal const& signal )
+{
+    Block* block = allocate();
+
+    block->ptr_    = 0;
+    block->destroy = 0;
+    block->signal( signal );
+    return block;
+}
+
+//------------------------------------------------------------------------------
+
+template < class T, std::size_t SIZE >
+typename SmEventPool< T, SIZE >::Orphans&
+SmEventPool< T, SIZE >::orphans()
+{
+    static Orphans orphans;
+    return orphans;
+}
+
+//------------------------------------------------------------------------------
+
+template < class T, std::size_t SIZE >
+typename SmEventPool< T, SIZE >::Pool*&
+SmEventPool< T, SIZE >::current()
+{
+    // A plain pointer needs no initialization check on every access,
+    // unlike the holder.
+    static thread_local Pool* pool = 0;
+    return pool;
+}
+
+//------------------------------------------------------------------------------
+
+template < class T, std::size_t SIZE >
+inline
+typename SmEventPool< T, SIZE >::Pool&
+SmEventPool< T, SIZE >::pool()
+{
+    Pool*& pool = current();
+    if ( !pool )
+    {
+        static thread_local Holder holder;
+        pool = holder.pool;
+    }
+    return *pool;
+}
+
+//------------------------------------------------------------------------------
+
+template < class T, std::size_t SIZE >
+SmEventPool< T, SIZE >::Holder::Holder() : pool( 0 )
+{
+    Orphans& orphans = SmEventPool::orphans();
+    std::lock_guard< std::mutex > guard( orphans.lock );
+
+    if ( orphans.pools.empty() )
+    {
+        pool = new Pool;
+    }
+    else
+    {
+        pool = orphans.pools.back();
+        orphans.pools.pop_back();
+    }
+}
+
+//------------------------------------------------------------------------------
+
+template < class T, std::size_t SIZE >
+SmEventPool< T, SIZE >::Holder::~Holder()
+{
+    current() = 0;
+
+    // Events still out are released to it remotely.
+    Orphans& orphans = SmEventPool::orphans();
+    std::lock_guard< std::mutex > guard( orphans.lock );
+    orphans.pools.push_back( pool );
+}
+
+//------------------------------------------------------------------------------
+
+template < class T, std::size_t SIZE >
+inline
+typename SmEventPool< T, SIZE >::Block*
+SmEventPool< T, SIZE >::allocate()
+{
+    Pool& pool = SmEventPool::pool();
+
+    if ( !pool.free )
+    {
+        pool.free = pool.remote.exchange( 0, std::memory_order_acquire );
+    }
+
+    if ( !pool.free )
+    {
+        Block* chunk = new Block[ SM_EVENT_POOL_CHUNK ];
+        for ( unsigned i = 0; i < SM_EVENT_POOL_CHUNK; ++i )
+        {
+            chunk[ i ].pool     = &pool;
+            chunk[ i ].release_ = &SmEventPool::release;
+            chunk[ i ].next     = i + 1 < SM_EVENT_POOL_CHUNK ? &chunk[ i + 1 ] : 0;
+        }
+        pool.free = chunk;
+    }
+
+    Block* block = pool.free;
+    pool.free    = block->next;
+    return block;
+}
+
+//------------------------------------------------------------------------------
+
+template < class T, std::size_t SIZE >
+void
+SmEventPool< T, SIZE >::release( UserEvent* e )
+{
+    Block* block = static_cast< Block* >( e );
+
+    if ( block->destroy )
+    {
+        block->destroy( block->payload );
+    }
+
+    Pool* pool = block->pool;
+    if ( pool == current() )
+    {
+        block->next = pool->free;
+        pool->free  = block;
+        return;
+    }
+
+    block->next = pool->remote.load( std::memory_order_relaxed );
+    while ( !pool->remote.compare_exchange_weak( block->next, block,
+                                                 std::memory_order_release,
+                                                 std::memory_order_relaxed ) )
+        ;
+}
+
+//------------------------------------------------------------------------------
+} // namespace Base {
+//------------------------------------------------------------------------------
+
+//==============================================================================
+#endif /* BASE_SM_EVENT_POOL_H_ */
+//==============================================================================
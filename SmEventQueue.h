@@ -0,0 +1,383 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmEventQueue.h
+// Author        Tommy Carlsson (topcatse)
+//
+// This file contains the interfaces of SmEventQueue and its wait primitives.
+//==============================================================================
+#pragma once
+#if !defined ( BASE_SM_EVENT_QUEUE_H_ )
+#define BASE_SM_EVENT_QUEUE_H_
+//==============================================================================
+
+// ANSI/STL
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#if defined ( __linux__ )
+#   include <linux/futex.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#endif /* __linux__ */
+
+//==============================================================================
+namespace Base {
+//==============================================================================
+
+/// How a producer waits for room in a full queue.
+enum SmWaitPolicy
+{
+    SM_SPIN,  ///< Spin with exponential backoff.
+    SM_BLOCK  ///< Spin a while, then sleep until woken by the consumer.
+};
+
+/// Block while word == expected, or until woken. May return spuriously.
+inline void smFutexWait( std::atomic< uint32_t >& word, uint32_t expected )
+{
+#if defined ( __linux__ )
+    syscall( SYS_futex, reinterpret_cast< uint32_t* >( &word ),
+             FUTEX_WAIT_PRIVATE, expected, 0, 0, 0 );
+#else
+    if ( word.load( std::memory_order_acquire ) == expected )
+    {
+        std::this_thread::yield();
+    }
+#endif /* __linux__ */
+}
+
+/// Wake up to count threads blocked in smFutexWait() on word.
+inline void smFutexWake( std::atomic< uint32_t >& word, int count )
+{
+#if defined ( __linux__ )
+    syscall( SYS_futex, reinterpret_cast< uint32_t* >( &word ),
+             FUTEX_WAKE_PRIVATE, count, 0, 0, 0 );
+#else
+    (void)word;
+    (void)count;
+#endif /* __linux__ */
+}
+
+//==============================================================================
+
+/**
+ * Exponential backoff for spin loops.
+ */
+class SmBackoff
+{
+public:
+    /// Constructor.
+    SmBackoff() : spins_( 1 ) {}
+
+    /// Pause, twice as long as last time. Returns false when the caller
+    /// had better sleep instead.
+    bool pause()
+    {
+        if ( spins_ > LIMIT )
+        {
+            std::this_thread::yield();
+            return false;
+        }
+        for ( unsigned i = 0; i < spins_; ++i )
+        {
+#if defined ( __i386__ ) || defined ( __x86_64__ )
+            __builtin_ia32_pause();
+#else
+            std::atomic_signal_fence( std::memory_order_seq_cst );
+#endif
+        }
+        spins_ <<= 1;
+        return true;
+    }
+
+    void reset() { spins_ = 1; }
+
+private:
+    enum { LIMIT = 1024 };
+    unsigned spins_;
+};
+
+//==============================================================================
+
+/**
+ * Bounded lock-free multi producer, single consumer queue (cf. Vyukov's
+ * bounded MPMC queue). Producers never take a lock; a sleeping consumer
+ * or producer is woken by futex. Consumers may share the queue through
+ * tryPopShared(). CAPACITY shall be a power of two.
+ */
+template < class E, unsigned CAPACITY >
+class SmEventQueue
+{
+public:
+    /// Constructor.
+    SmEventQueue();
+
+    /// Append item unless the queue is full. Any thread.
+    bool tryPush( E const& item );
+
+    /// Append item, waiting for room according to policy. Any thread.
+    void push( E const& item, SmWaitPolicy policy = SM_BLOCK );
+
+    /// Remove the oldest item, false if empty. Consumer thread only.
+    bool tryPop( E& item );
+
+    /// Remove the oldest item, false if empty. Any thread, for queues that
+    /// are shared by several consumers.
+    bool tryPopShared( E& item );
+
+    /// Block until the queue is probably not empty, or wake() is called.
+    /// Consumer thread only.
+    void wait() { wait( ticket() ); }
+
+    /// As wait(), but returns at once if anything has been pushed, or
+    /// wake() called, since ticket() returned seen. Take the ticket before
+    /// checking whatever wake() is called for, e.g. a stop flag, so that a
+    /// wake() in between is not lost.
+    void wait( uint32_t seen );
+
+    /// The count of pushes and wake()s, for wait( seen ).
+    uint32_t ticket() const { return pushes_.load( std::memory_order_seq_cst ); }
+
+    /// Make a consumer blocked in wait() return.
+    void wake();
+
+    /// True if there was nothing to pop at the time of the call.
+    bool empty() const;
+
+private:
+    SmEventQueue( SmEventQueue const& );
+    SmEventQueue& operator=( SmEventQueue const& );
+
+    enum { MASK = CAPACITY - 1 };
+
+    struct Cell
+    {
+        std::atomic< std::size_t > sequence;
+        E                          item;
+    };
+
+    Cell cells_[ CAPACITY ];
+
+    alignas( 64 ) std::atomic< std::size_t > enqueuePos_;
+    alignas( 64 ) std::atomic< std::size_t > dequeuePos_;
+
+    /// Futex words, bumped on every push and pop respectively.
+    alignas( 64 ) std::atomic< uint32_t > pushes_;
+    std::atomic< uint32_t > consumerWaiting_;
+    alignas( 64 ) std::atomic< uint32_t > pops_;
+    std::atomic< uint32_t > producersWaiting_;
+};
+
+//------------------------------------------------------------------------------
+
+template < class E, unsigned CAPACITY >
+SmEventQueue< E, CAPACITY >::SmEventQueue()
+    : enqueuePos_( 0 )
+    , dequeuePos_( 0 )
+    , pushes_( 0 )
+    , consumerWaiting_( 0 )
+    , pops_( 0 )
+    , producersWaiting_( 0 )
+{
+    static_assert( CAPACITY >= 2 && ( CAPACITY & ( CAPACITY - 1 ) ) == 0,
+                   "SmEventQueue CAPACITY shall be a power of two" );
+
+    for ( std::size_t i = 0; i < CAPACITY; ++i )
+    {
+        cells_[ i ].sequence.store( i, std::memory_order_relaxed );
+    }
+}
+
+//------------------------------------------------------------------------------
+
+template < class E, unsigned CAPACITY >
+bool
+SmEventQueue< E, CAPACITY >::tryPush( E const& item )
+{
+    Cell*       cell;
+    std::size_t pos = enqueuePos_.load( std::memory_order_relaxed );
+
+    for ( ;; )
+    {
+        cell = &cells_[ pos & MASK ];
+        std::size_t seq = cell->sequence.load( std::memory_order_acquire );
+        std::ptrdiff_t diff = std::ptrdiff_t( seq ) - std::ptrdiff_t( pos );
+
+        if ( diff == 0 )
+        {
+            if ( enqueuePos_.compare_exchange_weak( pos, pos + 1,
+                                                    std::memory_order_relaxed ) )
+            {
+                break;
+            }
+        }
+        else if ( diff < 0 )
+        {
+            // Full.
+            return false;
+        }
+        else
+        {
+            pos = enqueuePos_.load( std::memory_order_relaxed );
+        }
+    }
+
+    cell->item = item;
+    cell->sequence.store( pos + 1, std::memory_order_release );
+
+    pushes_.fetch_add( 1, std::memory_order_seq_cst );
+    if ( consumerWaiting_.load( std::memory_order_seq_cst ) )
+    {
+        smFutexWake( pushes_, 1 );
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+template < class E, unsigned CAPACITY >
+void
+SmEventQueue< E, CAPACITY >::push( E const& item, SmWaitPolicy policy )
+{
+    SmBackoff backoff;
+
+    while ( !tryPush( item ) )
+    {
+        uint32_t seen = pops_.load( std::memory_order_seq_cst );
+
+        if ( backoff.pause() || policy == SM_SPIN )
+        {
+            continue;
+        }
+
+        producersWaiting_.fetch_add( 1, std::memory_order_seq_cst );
+        if ( !tryPush( item ) )
+        {
+            smFutexWait( pops_, seen );
+            producersWaiting_.fetch_sub( 1, std::memory_order_seq_cst );
+            backoff.reset();
+            continue;
+        }
+        producersWaiting_.fetch_sub( 1, std::memory_order_seq_cst );
+        return;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+template < class E, unsigned CAPACITY >
+bool
+SmEventQueue< E, CAPACITY >::tryPop( E& item )
+{
+    std::size_t pos  = dequeuePos_.load( std::memory_order_relaxed );
+    Cell*       cell = &cells_[ pos & MASK ];
+    std::size_t seq  = cell->sequence.load( std::memory_order_acquire );
+
+    if ( std::ptrdiff_t( seq ) - std::ptrdiff_t( pos + 1 ) < 0 )
+    {
+        // Empty.
+        return false;
+    }
+
+    item = cell->item;
+    cell->sequence.store( pos + MASK + 1, std::memory_order_release );
+    dequeuePos_.store( pos + 1, std::memory_order_relaxed );
+
+    pops_.fetch_add( 1, std::memory_order_seq_cst );
+    if ( producersWaiting_.load( std::memory_order_seq_cst ) )
+    {
+        smFutexWake( pops_, INT_MAX );
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+template < class E, unsigned CAPACITY >
+bool
+SmEventQueue< E, CAPACITY >::tryPopShared( E& item )
+{
+    Cell*       cell;
+    std::size_t pos = dequeuePos_.load( std::memory_order_relaxed );
+
+    for ( ;; )
+    {
+        cell = &cells_[ pos & MASK ];
+        std::size_t seq = cell->sequence.load( std::memory_order_acquire );
+        std::ptrdiff_t diff = std::ptrdiff_t( seq ) - std::ptrdiff_t( pos + 1 );
+
+        if ( diff == 0 )
+        {
+            if ( dequeuePos_.compare_exchange_weak( pos, pos + 1,
+                                                    std::memory_order_relaxed ) )
+            {
+                break;
+            }
+        }
+        else if ( diff < 0 )
+        {
+            // Empty.
+            return false;
+        }
+        else
+        {
+            pos = dequeuePos_.load( std::memory_order_relaxed );
+        }
+    }
+
+    item = cell->item;
+    cell->sequence.store( pos + MASK + 1, std::memory_order_release );
+
+    pops_.fetch_add( 1, std::memory_order_seq_cst );
+    if ( producersWaiting_.load( std::memory_order_seq_cst ) )
+    {
+        smFutexWake( pops_, INT_MAX );
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+template < class E, unsigned CAPACITY >
+void
+SmEventQueue< E, CAPACITY >::wait( uint32_t seen )
+{
+    consumerWaiting_.store( 1, std::memory_order_seq_cst );
+    if ( empty() )
+    {
+        smFutexWait( pushes_, seen );
+    }
+    consumerWaiting_.store( 0, std::memory_order_relaxed );
+}
+
+//------------------------------------------------------------------------------
+
+template < class E, unsigned CAPACITY >
+void
+SmEventQueue< E, CAPACITY >::wake()
+{
+    pushes_.fetch_add( 1, std::memory_order_seq_cst );
+    smFutexWake( pushes_, 1 );
+}
+
+//------------------------------------------------------------------------------
+
+template < class E, unsigned CAPACITY >
+bool
+SmEventQueue< E, CAPACITY >::empty() const
+{
+    std::size_t pos = dequeuePos_.load( std::memory_order_relaxed );
+    std::size_t seq = cells_[ pos & MASK ].sequence.load(
+                          std::memory_order_acquire );
+    return std::ptrdiff_t( seq ) - std::ptrdiff_t( pos + 1 ) < 0;
+}
+
+//------------------------------------------------------------------------------
+} // namespace Base {
+//------------------------------------------------------------------------------
+
+//==============================================================================
+#endif /* BASE_SM_EVENT_QUEUE_H_ */
+//==============================================================================
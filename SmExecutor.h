@@ -0,0 +1,506 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmExecutor.h
+// Author        Tommy Carlsson (topcatse)
+//
+// This file contains the interfaces of SmExecutor and SmRunnable.
+//==============================================================================
+#pragma once
+#if !defined ( BASE_SM_EXECUTOR_H_ )
+#define BASE_SM_EXECUTOR_H_
+//==============================================================================
+
+#include "SmEventQueue.h"
+
+// ANSI/STL
+#include <cassert>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+//==============================================================================
+namespace Base {
+//==============================================================================
+
+class SmExecutor;
+
+/**
+ * Something an SmExecutor runs, e.g. an SmActiveObject with pending events.
+ * A runnable is in at most one executor queue at a time, so it is only ever
+ * run by one thread at a time.
+ */
+class SmRunnable
+{
+public:
+    /// Let executor run this object whenever it has work.
+    void attach( SmExecutor* executor ) { executor_ = executor; }
+
+    /// The executor attached to, if any.
+    SmExecutor* executor() const { return executor_; }
+
+protected:
+    /// Constructor.
+    SmRunnable() : executor_( 0 ), scheduled_( false ) {}
+
+    /// Dtor.
+    virtual ~SmRunnable() {}
+
+    /// Call when work has arrived. Any thread.
+    void schedule();
+
+    /// Do at most budget pieces of work.
+    /// Returns true if there is more to do.
+    virtual bool runSlice( unsigned budget ) = 0;
+
+    /// True if there is work to do.
+    virtual bool hasWork() const = 0;
+
+private:
+    friend class SmExecutor;
+
+    SmExecutor*         executor_;
+    std::atomic< bool > scheduled_;
+};
+
+//==============================================================================
+
+/**
+ * Fixed capacity work stealing queue (cf. Chase and Lev, "Dynamic Circular
+ * Work-Stealing Deque"). Unlike a Chase-Lev deque the owner takes from the
+ * top, same as the thieves, so that runnables are served in FIFO order and
+ * none is starved by a busy neighbour.
+ */
+template < class E, unsigned CAPACITY >
+class SmWorkQueue
+{
+public:
+    /// Constructor.
+    SmWorkQueue() : top_( 0 ), bottom_( 0 )
+    {
+        static_assert( ( CAPACITY & ( CAPACITY - 1 ) ) == 0,
+                       "SmWorkQueue CAPACITY shall be a power of two" );
+    }
+
+    /// Append at bottom, false if full. Owner only.
+    bool push( E item );
+
+    /// Take from top, 0 if empty or lost a race. Any thread.
+    E steal();
+
+private:
+    enum { MASK = CAPACITY - 1 };
+
+    alignas( 64 ) std::atomic< int64_t > top_;
+    alignas( 64 ) std::atomic< int64_t > bottom_;
+    std::atomic< E >                     items_[ CAPACITY ];
+};
+
+//------------------------------------------------------------------------------
+
+template < class E, unsigned CAPACITY >
+bool
+SmWorkQueue< E, CAPACITY >::push( E item )
+{
+    int64_t b = bottom_.load( std::memory_order_relaxed );
+    int64_t t = top_.load( std::memory_order_acquire );
+
+    if ( b - t >= int64_t( CAPACITY ) )
+    {
+        return false;
+    }
+
+    items_[ b & MASK ].store( item, std::memory_order_relaxed );
+    bottom_.store( b + 1, std::memory_order_release );
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+template < class E, unsigned CAPACITY >
+E
+SmWorkQueue< E, CAPACITY >::steal()
+{
+    int64_t t = top_.load( std::memory_order_acquire );
+
+    for ( ;; )
+    {
+        int64_t b = bottom_.load( std::memory_order_acquire );
+        if ( t >= b )
+        {
+            return 0;
+        }
+
+        // The slot is reused only after top_ has moved on, in which case
+        // the exchange fails and the item is dropped.
+        E item = items_[ t & MASK ].load( std::memory_order_relaxed );
+        if ( top_.compare_exchange_weak( t, t + 1,
+                                         std::memory_order_acq_rel,
+                                         std::memory_order_acquire ) )
+        {
+            return item;
+        }
+    }
+}
+
+//==============================================================================
+
+/**
+ * A pool of worker threads running SmRunnable objects. Each worker has a
+ * queue of runnables; work scheduled by a worker goes to its own queue and
+ * idle workers steal from the others. Work scheduled by other threads, and
+ * runnables that used up their budget, go through a shared FIFO queue.
+ * A worker never waits for room in a queue, which the other workers may be
+ * waiting for as well: with both its own and the shared queue full, it
+ * runs the runnable at once instead.
+ */
+class SmExecutor
+{
+public:
+    /// Start workers threads.
+    /// budget: pieces of work done on a runnable before moving on.
+    explicit SmExecutor( unsigned workers = std::thread::hardware_concurrency(),
+                         unsigned budget  = 64 );
+
+    /// Stop and join the workers.
+    ~SmExecutor();
+
+    /// Schedule runnable for execution. Any thread.
+    void submit( SmRunnable* runnable );
+
+    /// Make the workers return, leaving any work undone.
+    void stop();
+
+    /// Number of worker threads.
+    unsigned workers() const { return unsigned( workers_.size() ); }
+
+private:
+    SmExecutor( SmExecutor const& );
+    SmExecutor& operator=( SmExecutor const& );
+
+    enum { QUEUE_CAPACITY  = 1 << 14,
+           SHARED_CAPACITY = 1 << 16,
+           SHARED_INTERVAL = 61,
+           SHARED_BATCH    = 32 };
+
+    struct Worker
+    {
+        Worker() : executor( 0 ), index( 0 ), ticks( 0 ) {}
+
+        SmExecutor*                                 executor;
+        unsigned                                    index;
+        unsigned                                    ticks;
+        SmWorkQueue< SmRunnable*, QUEUE_CAPACITY >  queue;
+        std::thread                                 thread;
+    };
+
+    /// The worker of the calling thread, if any.
+    static Worker*& current();
+
+    void work( Worker& worker );
+
+    SmRunnable* find( Worker& worker );
+
+    SmRunnable* refill( Worker& worker );
+
+    void run( Worker& worker, SmRunnable* runnable );
+
+    /// Queue runnable, still scheduled, on worker's queue or the shared
+    /// one. False if both are full.
+    bool requeue( Worker& worker, SmRunnable* runnable );
+
+    void sleep( Worker& worker );
+
+    void wakeOne();
+
+    std::vector< Worker* >                            workers_;
+    unsigned                                          budget_;
+    SmEventQueue< SmRunnable*, SHARED_CAPACITY >      shared_;
+    std::atomic< bool >                               stopped_;
+
+    /// Futex word bumped when work arrives for sleeping workers.
+    alignas( 64 ) std::atomic< uint32_t >             epoch_;
+    std::atomic< uint32_t >                           sleepers_;
+};
+
+//------------------------------------------------------------------------------
+
+inline
+void
+SmRunnable::schedule()
+{
+    if ( executor_ && !scheduled_.exchange( true, std::memory_order_acq_rel ) )
+    {
+        executor_->submit( this );
+    }
+}
+
+//------------------------------------------------------------------------------
+
+inline
+SmExecutor::SmExecutor( unsigned workers, unsigned budget )
+    : budget_( budget )
+    , stopped_( false )
+    , epoch_( 0 )
+    , sleepers_( 0 )
+{
+    if ( workers == 0 )
+    {
+        workers = 1;
+    }
+
+    for ( unsigned i = 0; i < workers; ++i )
+    {
+        workers_.push_back( new Worker );
+        workers_.back()->executor = this;
+        workers_.back()->index    = i;
+    }
+
+    for ( unsigned i = 0; i < workers; ++i )
+    {
+        Worker& worker = *workers_[ i ];
+        worker.thread  = std::thread( &SmExecutor::work, this,
+                                      std::ref( worker ) );
+    }
+}
+
+//------------------------------------------------------------------------------
+
+inline
+SmExecutor::~SmExecutor()
+{
+    stop();
+
+    for ( std::size_t i = 0; i < workers_.size(); ++i )
+    {
+        if ( workers_[ i ]->thread.joinable() )
+        {
+            workers_[ i ]->thread.join();
+        }
+    }
+
+    // Not before all are joined, the others may be stealing.
+    for ( std::size_t i = 0; i < workers_.size(); ++i )
+    {
+        delete workers_[ i ];
+    }
+}
+
+//------------------------------------------------------------------------------
+
+inline
+void
+SmExecutor::stop()
+{
+    stopped_.store( true, std::memory_order_seq_cst );
+    epoch_.fetch_add( 1, std::memory_order_seq_cst );
+    smFutexWake( epoch_, INT_MAX );
+}
+
+//------------------------------------------------------------------------------
+
+inline
+SmExecutor::Worker*&
+SmExecutor::current()
+{
+    static thread_local Worker* worker = 0;
+    return worker;
+}
+
+//------------------------------------------------------------------------------
+
+inline
+void
+SmExecutor::submit( SmRunnable* runnable )
+{
+    Worker* worker = current();
+
+    if ( !worker || worker->executor != this )
+    {
+        // The workers drain the shared queue, so waiting for room is safe.
+        shared_.push( runnable, SM_SPIN );
+    }
+    else if ( !requeue( *worker, runnable ) )
+    {
+        run( *worker, runnable );
+        return;
+    }
+
+    wakeOne();
+}
+
+//------------------------------------------------------------------------------
+
+inline
+void
+SmExecutor::wakeOne()
+{
+    // Pairs with the fence in sleep(): either the sleeper sees the work,
+    // or we see the sleeper.
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if ( sleepers_.load( std::memory_order_relaxed ) )
+    {
+        epoch_.fetch_add( 1, std::memory_order_seq_cst );
+        smFutexWake( epoch_, 1 );
+    }
+}
+
+//------------------------------------------------------------------------------
+
+inline
+void
+SmExecutor::work( Worker& worker )
+{
+    current() = &worker;
+
+    SmBackoff backoff;
+
+    while ( !stopped_.load( std::memory_order_acquire ) )
+    {
+        SmRunnable* runnable = find( worker );
+
+        if ( runnable )
+        {
+            run( worker, runnable );
+            backoff.reset();
+        }
+        else if ( !backoff.pause() )
+        {
+            sleep( worker );
+            backoff.reset();
+        }
+    }
+
+    current() = 0;
+}
+
+//------------------------------------------------------------------------------
+
+inline
+SmRunnable*
+SmExecutor::find( Worker& worker )
+{
+    SmRunnable* runnable = 0;
+
+    // Look at the shared queue now and then, so that it is not starved.
+    if ( ++worker.ticks % SHARED_INTERVAL == 0 && ( runnable = refill( worker ) ) )
+    {
+        return runnable;
+    }
+
+    if ( ( runnable = worker.queue.steal() ) || ( runnable = refill( worker ) ) )
+    {
+        return runnable;
+    }
+
+    // Steal, starting at a victim that differs between workers.
+    std::size_t count = workers_.size();
+    for ( std::size_t i = 1; i < count; ++i )
+    {
+        Worker& victim = *workers_[ ( worker.index + worker.ticks + i ) % count ];
+        if ( &victim != &worker && ( runnable = victim.queue.steal() ) )
+        {
+            return runnable;
+        }
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+inline
+SmRunnable*
+SmExecutor::refill( Worker& worker )
+{
+    // Take the first one and move a batch more to the local queue.
+    SmRunnable* first = 0;
+    if ( !shared_.tryPopShared( first ) )
+    {
+        return 0;
+    }
+
+    SmRunnable* runnable;
+    for ( unsigned i = 1; i < SHARED_BATCH && shared_.tryPopShared( runnable ); ++i )
+    {
+        if ( !requeue( worker, runnable ) )
+        {
+            run( worker, runnable );
+            break;
+        }
+    }
+    return first;
+}
+
+//------------------------------------------------------------------------------
+
+inline
+void
+SmExecutor::run( Worker& worker, SmRunnable* runnable )
+{
+    // Runs again only if there is no room to queue it.
+    for ( ;; )
+    {
+        if ( runnable->runSlice( budget_ ) )
+        {
+            // Still scheduled, let the others have a go first.
+            if ( requeue( worker, runnable ) )
+            {
+                return;
+            }
+            continue;
+        }
+
+        // Unschedule, then pick up work that arrived meanwhile. The exchange
+        // synchronizes with the one in SmRunnable::schedule().
+        runnable->scheduled_.exchange( false, std::memory_order_acq_rel );
+        if ( !runnable->hasWork() ||
+             runnable->scheduled_.exchange( true, std::memory_order_acq_rel ) ||
+             requeue( worker, runnable ) )
+        {
+            return;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+inline
+bool
+SmExecutor::requeue( Worker& worker, SmRunnable* runnable )
+{
+    return worker.queue.push( runnable ) || shared_.tryPush( runnable );
+}
+
+//------------------------------------------------------------------------------
+
+inline
+void
+SmExecutor::sleep( Worker& worker )
+{
+    uint32_t seen = epoch_.load( std::memory_order_seq_cst );
+
+    sleepers_.fetch_add( 1, std::memory_order_seq_cst );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+
+    // Last look around before sleeping.
+    SmRunnable* runnable = find( worker );
+    if ( runnable )
+    {
+        sleepers_.fetch_sub( 1, std::memory_order_seq_cst );
+        run( worker, runnable );
+        return;
+    }
+
+    if ( !stopped_.load( std::memory_order_acquire ) )
+    {
+        smFutexWait( epoch_, seen );
+    }
+    sleepers_.fetch_sub( 1, std::memory_order_seq_cst );
+}
+
+//------------------------------------------------------------------------------
+} // namespace Base {
+//------------------------------------------------------------------------------
+
+//==============================================================================
+#endif /* BASE_SM_EXECUTOR_H_ */
+//==============================================================================
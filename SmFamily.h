@@ -0,0 +1,480 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmFamily.h
+// Author        Tommy Carlsson (topcatse)
+//
+// This file contains the interfaces of SmFamily.
+//==============================================================================
+#pragma once
+#if !defined ( BASE_SM_FAMILY_H_ )
+#define BASE_SM_FAMILY_H_
+//==============================================================================
+
+#include "StateMachine.h"
+#include "SmSnapshot.h"
+
+//==============================================================================
+namespace Base {
+//==============================================================================
+
+/// A transition without actions, see SmPureTransitions.
+struct SmPureTransition
+{
+    /// Declared id of the state that handles signal.
+    SmStateId state;
+    unsigned  signal;
+    SmStateId target;
+};
+
+/**
+ * Opt-in declaration of the transitions of SmFamily< OWNER, T > members
+ * that have no actions. broadcast() moves the members of a group that
+ * takes one of them to the target, without invoking any state.
+ *
+ *   template <>
+ *   struct SmPureTransitions< Session >
+ *   {
+ *       SM_STATIC_CONSTANT( bool, declared = true );
+ *       static constexpr SmPureTransition transitions[] =
+ *       {
+ *           { STARTING, TICK, FINISHING }
+ *       };
+ *   };
+ *
+ * A transition applies in the state and its substates, the one declared
+ * nearest to the current state first. It shall be what dispatch would
+ * do: no state below it handles the signal, it always takes the signal
+ * to target, and no state exited or entered, target included, acts on
+ * EXIT, ENTRY or INIT. The members moved are counted but not traced.
+ */
+template < class OWNER, class T = int >
+struct SmPureTransitions
+{
+    SM_STATIC_CONSTANT( bool, declared = false );
+    static constexpr SmPureTransition transitions[ 1 ] =
+    {
+        { SM_NO_ID, 0, SM_NO_ID }
+    };
+};
+
+template < class OWNER, class T >
+constexpr SmPureTransition SmPureTransitions< OWNER, T >::transitions[ 1 ];
+
+/**
+ * Many machines of one definition, the members, kept as an array of their
+ * current state ids. OWNER derives from this class instead of StateMachine
+ * and holds the state handlers once for all members; member() tells which
+ * member a handler runs for, and is the index of its data in arrays of
+ * OWNER's own.
+ *
+ * OWNER shall have the SmCompact layout, hence a declared hierarchy. All
+ * the options of the definition (SmJumpTable, SmPitcherCache and the
+ * published signals) apply to the members as to single machines.
+ *
+ * broadcast() dispatches an event to all members, grouped by current
+ * state, so that the handlers of a group run back to back. The published
+ * signals are checked and the SmJumpTable entry, if any, looked up once
+ * per group; with a jump table the transition of a group is thus resolved
+ * by its first member. Groups whose state rejects the signal are skipped
+ * as a whole, counted but not traced, and groups whose transition is
+ * declared pure (see SmPureTransitions) are moved as a whole.
+ *
+ * A handler may dispatch to other members, but not to its own member,
+ * nor broadcast. A member that such a dispatch moves before its group is
+ * reached gets the broadcast event in the state it was moved to, by
+ * itself.
+ */
+template < class OWNER, class T = int, unsigned MAX_DEPTH = 16 >
+class SmFamily : public StateMachine< OWNER, T, MAX_DEPTH >
+{
+    typedef StateMachine< OWNER, T, MAX_DEPTH > Machine;
+    typedef SmEvent< T >                        UserEvent;
+    typedef StatePtr< OWNER, T >                UserState;
+    typedef SmHierarchy< OWNER, T >             Hierarchy;
+
+public:
+    /// Number of members.
+    std::size_t size() const { return states_.size(); }
+
+    /// Declared id of the current state of given member.
+    SmStateId state( std::size_t member ) const { return states_[ member ]; }
+
+    /// Dispatch event to given member.
+    bool dispatch( std::size_t member, UserEvent* e );
+
+    /// Dispatch event to all members, see above. A pooled event is
+    /// released once dispatched to all. Returns the number of members
+    /// that handled it.
+    std::size_t broadcast( UserEvent* e );
+
+    /// Write a snapshot of the members to file, see SmSnapshotHeader.
+    /// Returns false if it could not be written.
+    bool save( std::FILE* file ) const
+    {
+        return smWriteSnapshot< OWNER, T >( file, states_.data(), states_.size() );
+    }
+
+protected:
+    /// Constructor.
+    SmFamily() : member_( 0 ), broadcasting_( false ) {}
+
+    /// Dtor. This class is not to be derived from but by OWNER.
+    ~SmFamily() {}
+
+    /// Add a member and execute its initial transition, see
+    /// StateMachine::open(). Returns the new member.
+    std::size_t add( UserState const& initial, UserEvent const* e = 0 );
+
+    /// Replace the members by those of a snapshot of size bytes at data,
+    /// see save(), without invoking any state: the data of OWNER's own is
+    /// taken to be as it was when saved. Returns false, leaving the
+    /// members as they were, if it is not a snapshot of this definition.
+    bool restore( void const* data, std::size_t size );
+
+    /// The member that the machine runs for.
+    std::size_t member() const { return member_; }
+
+private:
+    /// Lets the machine run for a member, and keeps the state that the
+    /// member is left in. Restores the member it ran for before.
+    class Select
+    {
+    public:
+        Select( SmFamily& family, std::size_t member );
+        ~Select();
+
+    private:
+        Select( Select const& );
+        Select& operator=( Select const& );
+
+        SmFamily&   family_;
+        std::size_t member_;
+        SmStateId   state_;
+    };
+
+    /// Current state id of each member.
+    std::vector< SmStateId >   states_;
+
+    /// The transition of given state by signal, if declared pure.
+    static bool pureTransition( SmStateId  state,
+                                unsigned   signal,
+                                SmStateId& target,
+                                char&      kind );
+
+    /// Broadcast e to member_ by itself, in its current state, having been
+    /// moved out of its group by a handler's dispatch(). Returns the
+    /// transition case.
+    char single( UserEvent* e );
+
+    /// The members by current state, used by broadcast().
+    std::vector< std::size_t > order_;
+
+    std::size_t                member_;
+    bool                       broadcasting_;
+};
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned MAX_DEPTH >
+SmFamily< OWNER, T, MAX_DEPTH >::Select::Select( SmFamily&   family,
+                                                 std::size_t member )
+    : family_( family )
+    , member_( family.member_ )
+    , state_( family.storage_.current() )
+{
+    family_.member_            = member;
+    family_.storage_.current() = family_.states_[ member ];
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned MAX_DEPTH >
+SmFamily< OWNER, T, MAX_DEPTH >::Select::~Select()
+{
+    family_.states_[ family_.member_ ] = family_.storage_.current();
+    family_.member_                    = member_;
+    family_.storage_.current()         = state_;
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned MAX_DEPTH >
+std::size_t
+SmFamily< OWNER, T, MAX_DEPTH >::add( UserState const& initial,
+                                      UserEvent const* e )
+{
+    SM_TRACE( "SmFamily::add" );
+
+    static_assert( SmCompact< OWNER, T >::enabled,
+                   "SmFamily needs the SmCompact layout" );
+
+    std::size_t member = states_.size();
+    states_.push_back( SM_TOP_ID );
+
+    Select select( *this, member );
+    this->open( static_cast< OWNER* >( this ), initial, e );
+    return member;
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned MAX_DEPTH >
+bool
+SmFamily< OWNER, T, MAX_DEPTH >::restore( void const* data, std::size_t size )
+{
+    SM_TRACE( "SmFamily::restore" );
+
+    static_assert( SmCompact< OWNER, T >::enabled,
+                   "SmFamily needs the SmCompact layout" );
+    assert( !broadcasting_ && "SmFamily::restore from a handler" );
+
+    enum { STATES = sizeof( Hierarchy::states ) /
+                    sizeof( Hierarchy::states[ 0 ] ) };
+
+    uint64_t         count = 0;
+    SmStateId const* ids   = smReadSnapshot< OWNER, T >( data, size, count );
+    if ( !ids )
+    {
+        return false;
+    }
+
+    // One pass to check, without branching per member, one to copy.
+    SmStateId top = 0;
+    for ( uint64_t i = 0; i < count; ++i )
+    {
+        top = ids[ i ] > top ? ids[ i ] : top;
+    }
+    if ( count > 0 && top >= STATES )
+    {
+        return false;
+    }
+
+    states_.assign( ids, ids + count );
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned MAX_DEPTH >
+bool
+SmFamily< OWNER, T, MAX_DEPTH >::dispatch( std::size_t member, UserEvent* e )
+{
+    SM_TRACE( "SmFamily::dispatch" );
+    assert( member < states_.size() && "Bad member to SmFamily::dispatch" );
+
+    Select select( *this, member );
+    return Machine::dispatch( e );
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned MAX_DEPTH >
+std::size_t
+SmFamily< OWNER, T, MAX_DEPTH >::broadcast( UserEvent* e )
+{
+    SM_TRACE( "SmFamily::broadcast" );
+    assert( e && "Bad event to SmFamily::broadcast" );
+    assert( !broadcasting_ && "SmFamily::broadcast from a handler" );
+
+    enum { STATES = sizeof( Hierarchy::states ) /
+                    sizeof( Hierarchy::states[ 0 ] ) };
+
+    broadcasting_ = true;
+
+    bool        pooled   = e->pooled();
+    std::size_t handled  = 0;
+    std::size_t previous = member_;
+    SmStateId   saved    = this->storage_.current();
+    std::size_t size     = states_.size();
+    std::size_t i;
+
+    // What dispatch() does per event is done once per broadcast, or once
+    // per group.
+    typename Machine::Storage::Scope scope( this->storage_ );
+#if !defined ( SM_NO_METRICS )
+    typename Machine::MetricsBlock& metrics = Machine::metricsBlock();
+    metrics.dispatches.increment( size );
+#endif /* SM_NO_METRICS */
+
+    std::size_t count[ STATES ] = {};
+    for ( i = 0; i < size; ++i )
+    {
+        ++count[ states_[ i ] ];
+    }
+
+    // The state each group is left in, SM_NO_ID if it is dispatched to.
+    // end[ s ] ends up as the end of the dispatched group of state s.
+    SmStateId   next[ STATES ];
+    std::size_t end[ STATES ];
+    std::size_t dispatched = 0;
+    bool        moved      = false;
+
+    for ( SmStateId state = 0; state < STATES; ++state )
+    {
+        next[ state ] = state;
+        end[ state ]  = dispatched;
+        if ( count[ state ] == 0 )
+        {
+            continue;
+        }
+
+        this->storage_.current() = state;
+        char kind;
+
+        if ( this->rejects( e ) )
+        {
+            SM_TRACE( "SmFamily signal not published in group" );
+#if !defined ( SM_NO_METRICS )
+            metrics.unhandled.increment( count[ state ] );
+#endif /* SM_NO_METRICS */
+        }
+        else if ( pureTransition( state, e->signal(), next[ state ], kind ) )
+        {
+            SM_TRACE( "SmFamily pure transition of group" );
+#if !defined ( SM_NO_METRICS )
+            metrics.cases[ kind - 'a' ].increment( count[ state ] );
+#endif /* SM_NO_METRICS */
+            handled += count[ state ];
+            moved    = true;
+        }
+        else
+        {
+            next[ state ] = SM_NO_ID;
+            dispatched   += count[ state ];
+        }
+    }
+
+    // Move the members of pure transitions, and order the others by state
+    // and member.
+    if ( moved || dispatched > 0 )
+    {
+        order_.resize( dispatched );
+        for ( i = 0; i < size; ++i )
+        {
+            SmStateId state = states_[ i ];
+            if ( next[ state ] == SM_NO_ID )
+            {
+                order_[ end[ state ]++ ] = i;
+            }
+            else
+            {
+                states_[ i ] = next[ state ];
+            }
+        }
+    }
+
+    std::size_t begin = 0;
+    for ( SmStateId state = 0; state < STATES && begin < dispatched; ++state )
+    {
+        if ( next[ state ] != SM_NO_ID )
+        {
+            continue;
+        }
+
+        this->storage_.current() = state;
+        typename Machine::JumpEntry* entry = this->jumpEntry( e );
+
+        for ( ; begin < end[ state ]; ++begin )
+        {
+            member_                  = order_[ begin ];
+            this->storage_.current() = states_[ member_ ];
+            this->target( this->owner()->topState() );
+#if SM_BINARY_TRACE
+            uint16_t from = this->traceId( this->current() );
+#endif /* SM_BINARY_TRACE */
+
+            // Moved out of the group by a handler's dispatch() if not in
+            // state any more.
+            char kind = states_[ member_ ] == state ? this->transit( e, entry )
+                                                    : single( e );
+            handled += kind != 0;
+            states_[ member_ ] = this->storage_.current();
+
+#if SM_BINARY_TRACE
+            smTraceWrite( SM_TRACE_DISPATCH, this, from,
+                          this->traceId( this->current() ),
+                          static_cast< uint16_t >( e->signal() ),
+                          static_cast< uint8_t >( kind ) );
+#endif /* SM_BINARY_TRACE */
+        }
+    }
+
+    member_                  = previous;
+    this->storage_.current() = saved;
+    broadcasting_            = false;
+
+    if ( pooled )
+    {
+        e->release();
+    }
+    return handled;
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned MAX_DEPTH >
+char
+SmFamily< OWNER, T, MAX_DEPTH >::single( UserEvent* e )
+{
+    SM_TRACE( "SmFamily member moved since grouped" );
+
+    if ( this->rejects( e ) )
+    {
+#if !defined ( SM_NO_METRICS )
+        Machine::metricsBlock().unhandled.increment();
+#endif /* SM_NO_METRICS */
+        this->pitcher( this->owner()->topState() );
+        return 0;
+    }
+    return this->transit( e, this->jumpEntry( e ) );
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned MAX_DEPTH >
+bool
+SmFamily< OWNER, T, MAX_DEPTH >::pureTransition( SmStateId  state,
+                                                 unsigned   signal,
+                                                 SmStateId& target,
+                                                 char&      kind )
+{
+    typedef SmPureTransitions< OWNER, T > Pure;
+
+    if ( !Pure::declared )
+    {
+        return false;
+    }
+
+    enum { SIZE = sizeof( Pure::transitions ) /
+                  sizeof( Pure::transitions[ 0 ] ) };
+
+    // The nearest one declared, from state up.
+    for ( SmStateId pitcher = state;
+          pitcher != SM_TOP_ID;
+          pitcher = Hierarchy::states[ pitcher ].parent )
+    {
+        for ( unsigned i = 0; i < SIZE; ++i )
+        {
+            SmPureTransition const& pure = Pure::transitions[ i ];
+            if ( pure.state == pitcher && pure.signal == signal )
+            {
+                typename Machine::IdPath exits;
+                typename Machine::IdPath entries;
+
+                target = pure.target;
+                kind   = Machine::resolveIds( state, pitcher, target,
+                                              exits, entries );
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------------
+} // namespace Base {
+//------------------------------------------------------------------------------
+
+//==============================================================================
+#endif /* BASE_SM_FAMILY_H_ */
+//==============================================================================
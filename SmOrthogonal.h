@@ -0,0 +1,370 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmOrthogonal.h
+// Author        Tommy Carlsson (topcatse)
+//
+// This file contains the interfaces of SmOrthogonal.
+//==============================================================================
+#pragma once
+#if !defined ( BASE_SM_ORTHOGONAL_H_ )
+#define BASE_SM_ORTHOGONAL_H_
+//==============================================================================
+
+#include "StateMachine.h"
+#include "SmExecutor.h"
+
+//==============================================================================
+namespace Base {
+//==============================================================================
+
+/**
+ * A machine of orthogonal regions, see SmRegions: concerns such as a
+ * connection, its authentication and its flow control, that would
+ * otherwise be as many machines, in one. OWNER derives from this class
+ * instead of StateMachine, and holds the states of all regions.
+ *
+ * dispatch() dispatches an event to each region in turn, in region order,
+ * as if to separate machines: a region that does not handle the event
+ * passes it to its outer states and then to top, not to other regions,
+ * and a transition stays in its region. region() tells which region a
+ * handler runs for, and current() is the current state of that region.
+ *
+ * If the regions are declared independent and the machine is run on an
+ * SmExecutor, see runOn(), the other regions are dispatched to by its
+ * workers while the calling thread takes the first. The calling thread
+ * then takes those regions that no worker has started, so the executor
+ * may be the one that runs the calling thread. The executor may run a
+ * lane of the machine after dispatch() has returned, if only to find it
+ * done; destroy the executor before the machine.
+ *
+ * A handler shall not dispatch to its own machine.
+ */
+template < class OWNER, class T = int, unsigned MAX_DEPTH = 16 >
+class SmOrthogonal : public StateMachine< OWNER, T, MAX_DEPTH >
+{
+    typedef StateMachine< OWNER, T, MAX_DEPTH > Machine;
+    typedef SmEvent< T >                        UserEvent;
+    typedef StatePtr< OWNER, T >                UserState;
+    typedef SmHierarchy< OWNER, T >             Hierarchy;
+    typedef SmRegions< OWNER, T >               Regions;
+
+public:
+    SM_STATIC_CONSTANT( unsigned, REGIONS = Regions::regions );
+
+    /// Declared id of the current state of given region.
+    SmStateId state( unsigned region ) const
+    {
+        return this->storage_.current( region );
+    }
+
+    /// As StateMachine::isInState(), in any region.
+    int isInState( UserState const& state );
+
+    /// Dispatch event to all regions, see above. A pooled event is
+    /// released once dispatched to all. Returns true if any region
+    /// handled it.
+    bool dispatch( UserEvent* e );
+
+    /// Dispatch to independent regions in parallel on executor, or in
+    /// turn if 0.
+    void runOn( SmExecutor* executor );
+
+protected:
+    /// Constructor.
+    SmOrthogonal();
+
+    /// Dtor. This class is not to be derived from but by OWNER.
+    ~SmOrthogonal() {}
+
+    /// Execute the initial transition of each region, into initials[ r ]
+    /// in region r, see StateMachine::open().
+    void open( UserState const (&initials)[ REGIONS ], UserEvent const* e = 0 );
+
+    /// The region that the machine runs for.
+    unsigned region() const { return Machine::Storage::region(); }
+
+private:
+    /// Lets the thread run the machine for a region, until destroyed.
+    class Select
+    {
+    public:
+        explicit Select( unsigned region )
+            : region_( Machine::Storage::region() )
+        {
+            Machine::Storage::region() = region;
+        }
+
+        ~Select() { Machine::Storage::region() = region_; }
+
+    private:
+        Select( Select const& );
+        Select& operator=( Select const& );
+
+        unsigned region_;
+    };
+
+    /// Dispatches the event of the machine to one region, on an executor
+    /// worker or on the calling thread, whichever claims it first.
+    class Lane : public SmRunnable
+    {
+    public:
+        Lane() : machine_( 0 ), region_( 0 ), claimed_( true ), handled_( false ) {}
+
+        /// Let a worker claim the region.
+        void start()
+        {
+            claimed_.store( false, std::memory_order_release );
+            schedule();
+        }
+
+        /// Dispatch to the region unless claimed already.
+        void claim()
+        {
+            if ( !claimed_.exchange( true, std::memory_order_acq_rel ) )
+            {
+                handled_ = machine_->dispatchTo( region_, machine_->event_ );
+                machine_->done();
+            }
+        }
+
+        SmOrthogonal*       machine_;
+        unsigned            region_;
+        std::atomic< bool > claimed_;
+        bool                handled_;
+
+    private:
+        bool runSlice( unsigned ) { claim(); return false; }
+        bool hasWork() const { return !claimed_.load( std::memory_order_acquire ); }
+    };
+
+    /// Dispatch event to given region, without releasing it.
+    bool dispatchTo( unsigned region, UserEvent* e );
+
+    /// Dispatch event to the regions in parallel.
+    bool dispatchParallel( UserEvent* e );
+
+    /// A lane is done.
+    void done();
+
+    /// The region of given state.
+    static unsigned regionOf( SmStateId state );
+
+    SmExecutor*               executor_;
+    Lane                      lanes_[ REGIONS ];
+
+    /// The event being dispatched in parallel.
+    UserEvent*                event_;
+
+    /// Lanes not done, and whether the calling thread waits for them.
+    std::atomic< uint32_t >   pending_;
+    std::atomic< uint32_t >   waiting_;
+};
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned MAX_DEPTH >
+SmOrthogonal< OWNER, T, MAX_DEPTH >::SmOrthogonal()
+    : executor_( 0 ), event_( 0 ), pending_( 0 ), waiting_( 0 )
+{
+    for ( unsigned r = 0; r < REGIONS; ++r )
+    {
+        lanes_[ r ].machine_ = this;
+        lanes_[ r ].region_  = r;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned MAX_DEPTH >
+void
+SmOrthogonal< OWNER, T, MAX_DEPTH >::open( UserState const (&initials)[ REGIONS ],
+                                           UserEvent const* e )
+{
+    SM_TRACE( "SmOrthogonal::open" );
+
+    static_assert( REGIONS > 0, "SmOrthogonal needs SmRegions" );
+    static_assert( SmCompact< OWNER, T >::enabled,
+                   "SmRegions needs the SmCompact layout" );
+
+    for ( unsigned r = 0; r < REGIONS; ++r )
+    {
+        Select select( r );
+        Machine::open( static_cast< OWNER* >( this ), initials[ r ], e );
+        assert( regionOf( this->storage_.current() ) == r &&
+                "SmOrthogonal initial state out of region" );
+    }
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned MAX_DEPTH >
+void
+SmOrthogonal< OWNER, T, MAX_DEPTH >::runOn( SmExecutor* executor )
+{
+    executor_ = Regions::independent ? executor : 0;
+    for ( unsigned r = 0; r < REGIONS; ++r )
+    {
+        lanes_[ r ].attach( executor_ );
+    }
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned MAX_DEPTH >
+int
+SmOrthogonal< OWNER, T, MAX_DEPTH >::isInState( UserState const& state )
+{
+    int in = 0;
+    for ( unsigned r = 0; r < REGIONS && in < 2; ++r )
+    {
+        Select select( r );
+        int inRegion = Machine::isInState( state );
+        in = inRegion > in ? inRegion : in;
+    }
+    return in;
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned MAX_DEPTH >
+bool
+SmOrthogonal< OWNER, T, MAX_DEPTH >::dispatch( UserEvent* e )
+{
+    SM_TRACE( "SmOrthogonal::dispatch" );
+    assert( e && "Bad event to SmOrthogonal::dispatch" );
+
+    bool pooled  = e->pooled();
+    bool handled = false;
+
+    if ( executor_ && REGIONS > 1 )
+    {
+        handled = dispatchParallel( e );
+    }
+    else
+    {
+        for ( unsigned r = 0; r < REGIONS; ++r )
+        {
+            handled = dispatchTo( r, e ) || handled;
+        }
+    }
+
+    if ( pooled )
+    {
+        e->release();
+    }
+    return handled;
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned MAX_DEPTH >
+bool
+SmOrthogonal< OWNER, T, MAX_DEPTH >::dispatchTo( unsigned region, UserEvent* e )
+{
+    Select select( region );
+
+#if SM_BINARY_TRACE
+    uint16_t state  = this->traceId( this->current() );
+    uint16_t signal = static_cast< uint16_t >( e->signal() );
+    char     kind   = this->transit( e );
+    smTraceWrite( SM_TRACE_DISPATCH, this, state, this->traceId( this->current() ),
+                  signal, static_cast< uint8_t >( kind ) );
+#else
+    char     kind   = this->transit( e );
+#endif /* SM_BINARY_TRACE */
+
+    assert( regionOf( this->storage_.current() ) == region &&
+            "SmOrthogonal transition out of region" );
+    return kind != 0;
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned MAX_DEPTH >
+bool
+SmOrthogonal< OWNER, T, MAX_DEPTH >::dispatchParallel( UserEvent* e )
+{
+    event_ = e;
+    pending_.store( REGIONS - 1, std::memory_order_relaxed );
+    for ( unsigned r = 1; r < REGIONS; ++r )
+    {
+        lanes_[ r ].start();
+    }
+
+    bool handled = dispatchTo( 0, e );
+
+    // Take those that no worker has got to yet.
+    for ( unsigned r = 1; r < REGIONS; ++r )
+    {
+        lanes_[ r ].claim();
+    }
+
+    SmBackoff backoff;
+    while ( pending_.load( std::memory_order_acquire ) != 0 )
+    {
+        if ( backoff.pause() )
+        {
+            continue;
+        }
+
+        // Pairs with done(): either it sees the waiter, or we see it done.
+        waiting_.store( 1, std::memory_order_seq_cst );
+        uint32_t left = pending_.load( std::memory_order_seq_cst );
+        if ( left != 0 )
+        {
+            smFutexWait( pending_, left );
+        }
+        waiting_.store( 0, std::memory_order_relaxed );
+    }
+
+    for ( unsigned r = 1; r < REGIONS; ++r )
+    {
+        handled = lanes_[ r ].handled_ || handled;
+    }
+    return handled;
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned MAX_DEPTH >
+void
+SmOrthogonal< OWNER, T, MAX_DEPTH >::done()
+{
+    if ( pending_.fetch_sub( 1, std::memory_order_seq_cst ) == 1 &&
+         waiting_.load( std::memory_order_seq_cst ) )
+    {
+        smFutexWake( pending_, 1 );
+    }
+}
+
+//------------------------------------------------------------------------------
+
+template < class OWNER, class T, unsigned MAX_DEPTH >
+unsigned
+SmOrthogonal< OWNER, T, MAX_DEPTH >::regionOf( SmStateId state )
+{
+    if ( state == SM_TOP_ID )
+    {
+        return REGIONS;
+    }
+
+    while ( Hierarchy::states[ state ].parent != SM_TOP_ID )
+    {
+        state = Hierarchy::states[ state ].parent;
+    }
+
+    unsigned region = 0;
+    for ( SmStateId id = 0; id < state; ++id )
+    {
+        region += Hierarchy::states[ id ].parent == SM_TOP_ID;
+    }
+    return region;
+}
+
+//------------------------------------------------------------------------------
+} // namespace Base {
+//------------------------------------------------------------------------------
+
+//==============================================================================
+#endif /* BASE_SM_ORTHOGONAL_H_ */
+//==============================================================================
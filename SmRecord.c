@@ -0,0 +1,362 @@
+//=============================================- -*- C -*- ===================
+//
+// File Name     SmRecord.c
+// Author        Tommy Carlsson
+//
+// This file contains the implementation of the event recorder and replay.
+//
+//==============================================================================
+
+#if !defined ( _POSIX_C_SOURCE )
+#   define _POSIX_C_SOURCE 200112L
+#endif /* _POSIX_C_SOURCE */
+
+#include "SmRecord.h"
+#include "SmTrace.h"
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t SmRecord_nanoseconds( void )
+{
+   struct timespec now;
+   clock_gettime( CLOCK_MONOTONIC, &now );
+   return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+
+static void SmRecorder_flush( SmRecorder* self )
+{
+   if ( self->used > 0 && !self->error &&
+        fwrite( self->buffer, 1, self->used, self->file ) != self->used )
+   {
+      self->error = 1;
+   }
+   self->used = 0;
+}
+
+//------------------------------------------------------------------------------
+
+static void SmRecorder_write( SmRecorder* self, void const* bytes, size_t size )
+{
+   if ( self->used + size > SM_RECORD_BUFFER_SIZE )
+   {
+      SmRecorder_flush( self );
+   }
+
+   if ( size > SM_RECORD_BUFFER_SIZE )
+   {
+      if ( !self->error && fwrite( bytes, 1, size, self->file ) != size )
+      {
+         self->error = 1;
+      }
+      return;
+   }
+
+   memcpy( self->buffer + self->used, bytes, size );
+   self->used += size;
+}
+
+//------------------------------------------------------------------------------
+
+int SmRecorder_open( SmRecorder* self, FILE* file )
+{
+   SmRecordFileHeader header;
+
+   memcpy( header.magic, "SMRC", 4 );
+   header.version   = 1;
+   header.entrySize = sizeof( SmRecordEntry );
+
+   self->file  = file;
+   self->error = 0;
+   self->used  = 0;
+
+   SmRecorder_write( self, &header, sizeof( header ) );
+   return 0;
+}
+
+//------------------------------------------------------------------------------
+
+static void SmRecorder_entry( SmRecorder* self,
+                              uint32_t    machine,
+                              uint16_t    signal,
+                              void const* payload,
+                              uint16_t    size )
+{
+   SmRecordEntry entry;
+
+   entry.machine = machine;
+   entry.signal  = signal;
+   entry.size    = payload ? size : 0;
+
+   SmRecorder_write( self, &entry, sizeof( entry ) );
+   if ( entry.size > 0 )
+   {
+      SmRecorder_write( self, payload, entry.size );
+   }
+}
+
+//------------------------------------------------------------------------------
+
+void SmRecorder_dispatch( SmRecorder* self,
+                          uint32_t    machine,
+                          uint16_t    signal,
+                          void const* payload,
+                          uint16_t    size )
+{
+   // It would be replayed as a final state.
+   assert( signal != SM_RECORD_STATE && "SmRecorder_dispatch of SM_RECORD_STATE" );
+   if ( signal == SM_RECORD_STATE )
+   {
+      self->error = 1;
+      return;
+   }
+
+   SmRecorder_entry( self, machine, signal, payload, size );
+}
+
+//------------------------------------------------------------------------------
+
+void SmRecorder_state( SmRecorder* self, uint32_t machine, uint16_t state )
+{
+   SmRecorder_entry( self, machine, SM_RECORD_STATE, &state, sizeof( state ) );
+}
+
+//------------------------------------------------------------------------------
+
+int SmRecorder_close( SmRecorder* self )
+{
+   SmRecorder_flush( self );
+   if ( !self->error && fflush( self->file ) != 0 )
+   {
+      self->error = 1;
+   }
+   return self->error ? -1 : 0;
+}
+
+//==============================================================================
+
+/// Bucket of a latency.
+static unsigned SmReplay_bucket( uint64_t ticks )
+{
+   if ( ticks < SM_REPLAY_SUBS )
+   {
+      return (unsigned)ticks;
+   }
+
+   unsigned power = 63 - __builtin_clzll( ticks );
+   unsigned shift = power - SM_REPLAY_SUB_BITS;
+   return ( ( shift + 1 ) << SM_REPLAY_SUB_BITS ) |
+          (unsigned)( ( ticks >> shift ) & ( SM_REPLAY_SUBS - 1 ) );
+}
+
+//------------------------------------------------------------------------------
+
+/// The greatest latency of a bucket.
+static uint64_t SmReplay_limit( unsigned bucket )
+{
+   if ( bucket < SM_REPLAY_SUBS )
+   {
+      return bucket;
+   }
+
+   unsigned shift = ( bucket >> SM_REPLAY_SUB_BITS ) - 1;
+   uint64_t sub   = bucket & ( SM_REPLAY_SUBS - 1 );
+   return ( ( SM_REPLAY_SUBS + sub + 1 ) << shift ) - 1;
+}
+
+//------------------------------------------------------------------------------
+
+/// The latency that fraction of the events are within, in ticks.
+static uint64_t SmReplay_percentile( uint64_t const* counts,
+                                     uint64_t        events,
+                                     double          fraction )
+{
+   uint64_t rank = (uint64_t)( fraction * events + 0.999999 );
+   uint64_t seen = 0;
+   unsigned bucket;
+
+   for ( bucket = 0; bucket < SM_REPLAY_BUCKETS; ++bucket )
+   {
+      seen += counts[ bucket ];
+      if ( seen >= rank && seen > 0 )
+      {
+         return SmReplay_limit( bucket );
+      }
+   }
+   return 0;
+}
+
+//------------------------------------------------------------------------------
+
+void const* SmReplay_first( void const* data, size_t size )
+{
+   SmRecordFileHeader header;
+
+   if ( size < sizeof( header ) )
+   {
+      return 0;
+   }
+
+   memcpy( &header, data, sizeof( header ) );
+   if ( memcmp( header.magic, "SMRC", 4 ) != 0 ||
+        header.version != 1 ||
+        header.entrySize != sizeof( SmRecordEntry ) )
+   {
+      return 0;
+   }
+   return (unsigned char const*)data + sizeof( header );
+}
+
+//------------------------------------------------------------------------------
+
+void const* SmReplay_next( void const* entry, void const* end, uint32_t* machine )
+{
+   unsigned char const* next = entry;
+   SmRecordEntry        header;
+
+   if ( (size_t)( (unsigned char const*)end - next ) < sizeof( header ) )
+   {
+      return 0;
+   }
+   memcpy( &header, next, sizeof( header ) );
+   next += sizeof( header );
+
+   if ( (size_t)( (unsigned char const*)end - next ) < header.size ||
+        ( header.signal == SM_RECORD_STATE && header.size != sizeof( uint16_t ) ) )
+   {
+      return 0;
+   }
+
+   *machine = header.machine;
+   return next + header.size;
+}
+
+//------------------------------------------------------------------------------
+
+void SmReplay_entry( void const*           entry,
+                     SmReplayTarget const* target,
+                     SmReplayReport*       report,
+                     SmReplayLatencies*    latencies )
+{
+   unsigned char const* payload = (unsigned char const*)entry + sizeof( SmRecordEntry );
+   SmRecordEntry        header;
+
+   memcpy( &header, entry, sizeof( header ) );
+
+   if ( header.signal == SM_RECORD_STATE )
+   {
+      uint16_t state;
+      memcpy( &state, payload, sizeof( state ) );
+
+      uint16_t replayed = target->state( target->context, header.machine );
+      ++report->checked;
+      report->mismatched += replayed != state;
+      ++report->states[ replayed < SM_REPLAY_SUMMARY ? replayed : SM_REPLAY_SUMMARY - 1 ];
+      return;
+   }
+
+   uint64_t begin   = smTraceNow();
+   int      handled = target->dispatch( target->context, header.machine,
+                                        header.signal,
+                                        header.size > 0 ? payload : 0,
+                                        header.size );
+   uint64_t ticks   = smTraceNow() - begin;
+
+   ++latencies->counts[ SmReplay_bucket( ticks ) ];
+   latencies->most = ticks > latencies->most ? ticks : latencies->most;
+   ++report->events;
+   report->handled += handled != 0;
+}
+
+//------------------------------------------------------------------------------
+
+void SmReplay_merge( SmReplayReport*          report,
+                     SmReplayLatencies*       latencies,
+                     SmReplayReport const*    shardReport,
+                     SmReplayLatencies const* shardLatencies )
+{
+   unsigned i;
+
+   report->events     += shardReport->events;
+   report->handled    += shardReport->handled;
+   report->checked    += shardReport->checked;
+   report->mismatched += shardReport->mismatched;
+   for ( i = 0; i < SM_REPLAY_SUMMARY; ++i )
+   {
+      report->states[ i ] += shardReport->states[ i ];
+   }
+
+   for ( i = 0; i < SM_REPLAY_BUCKETS; ++i )
+   {
+      latencies->counts[ i ] += shardLatencies->counts[ i ];
+   }
+   latencies->most = shardLatencies->most > latencies->most ? shardLatencies->most
+                                                            : latencies->most;
+   latencies->ticks       += shardLatencies->ticks;
+   latencies->nanoseconds += shardLatencies->nanoseconds;
+}
+
+//------------------------------------------------------------------------------
+
+void SmReplay_percentiles( SmReplayReport*          report,
+                           SmReplayLatencies const* latencies )
+{
+   uint64_t const* counts = latencies->counts;
+
+   // ns per tick.
+   double rate = latencies->ticks > 0
+               ? (double)latencies->nanoseconds / (double)latencies->ticks : 1.0;
+
+   report->p50  = (uint64_t)( rate * SmReplay_percentile( counts, report->events, 0.5 ) );
+   report->p90  = (uint64_t)( rate * SmReplay_percentile( counts, report->events, 0.9 ) );
+   report->p99  = (uint64_t)( rate * SmReplay_percentile( counts, report->events, 0.99 ) );
+   report->p999 = (uint64_t)( rate * SmReplay_percentile( counts, report->events, 0.999 ) );
+   report->max  = (uint64_t)( rate * latencies->most );
+}
+
+//------------------------------------------------------------------------------
+
+int SmReplay_run( void const*           data,
+                  size_t                size,
+                  SmReplayTarget const* target,
+                  SmReplayReport*       report )
+{
+   SmReplayLatencies latencies;
+   void const*       end   = (unsigned char const*)data + size;
+   void const*       entry = SmReplay_first( data, size );
+
+   memset( report, 0, sizeof( *report ) );
+   memset( &latencies, 0, sizeof( latencies ) );
+
+   if ( !entry )
+   {
+      return -1;
+   }
+
+   uint64_t startTicks       = smTraceNow();
+   uint64_t startNanoseconds = SmRecord_nanoseconds();
+
+   while ( entry != end )
+   {
+      uint32_t    machine;
+      void const* next = SmReplay_next( entry, end, &machine );
+      if ( !next )
+      {
+         return -1;
+      }
+
+      SmReplay_entry( entry, target, report, &latencies );
+      entry = next;
+   }
+
+   report->nanoseconds   = SmRecord_nanoseconds() - startNanoseconds;
+   latencies.ticks       = smTraceNow() - startTicks;
+   latencies.nanoseconds = report->nanoseconds;
+
+   SmReplay_percentiles( report, &latencies );
+   return 0;
+}
+
+//==============================================================================
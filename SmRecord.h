@@ -0,0 +1,226 @@
+//=============================================- -*- C -*- ===================
+//
+// File Name     SmRecord.h
+// Author        Tommy Carlsson (topcatse)
+//
+// This file contains the interfaces of the event recorder and replay of
+// the C and C++ StateMachine engines.
+//==============================================================================
+#if !defined ( BASE_SM_RECORD_H_ )
+#define BASE_SM_RECORD_H_
+//==============================================================================
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined ( __cplusplus )
+extern "C" {
+#endif /* __cplusplus */
+
+//==============================================================================
+
+// This section should be defined elsewhere.
+
+/// Bytes that an SmRecorder collects before writing them to its file.
+#if !defined ( SM_RECORD_BUFFER_SIZE )
+#   define SM_RECORD_BUFFER_SIZE 65536
+#endif /* SM_RECORD_BUFFER_SIZE */
+
+/// Final states that an SmReplayReport tells apart, see
+/// SmReplayReport::states.
+#if !defined ( SM_REPLAY_SUMMARY )
+#   define SM_REPLAY_SUMMARY 32
+#endif /* SM_REPLAY_SUMMARY */
+
+//==============================================================================
+
+/**
+ * Layout of a recording, see SmRecorder. All fields in host byte order.
+ *
+ *   SmRecordFileHeader
+ *   SmRecordEntry, followed by size bytes of payload, repeated
+ *
+ * Entries are packed, hence not aligned. An entry of signal
+ * SM_RECORD_STATE holds the final state of its machine, a uint16_t.
+ */
+typedef struct
+{
+    char     magic[ 4 ];   ///< "SMRC"
+    uint16_t version;      ///< 1
+    uint16_t entrySize;    ///< sizeof( SmRecordEntry )
+} SmRecordFileHeader;
+
+typedef struct
+{
+    /// Id of the machine, of the user's choice.
+    uint32_t machine;
+    uint16_t signal;
+
+    /// Bytes of payload that follow.
+    uint16_t size;
+} SmRecordEntry;
+
+/// Signal of the entries of final states. It is that of INQUIRE, which is
+/// never dispatched.
+#define SM_RECORD_STATE 0xFFFF
+
+//==============================================================================
+
+/**
+ * Appends the events dispatched to machines to a file: the machine, the
+ * signal and the bytes of the payload, to be dispatched again by
+ * SmReplay_run(). Call SmRecorder_dispatch() along with each dispatch,
+ * and SmRecorder_state() for each machine at the end, so that replay can
+ * check where the machines end up. One thread records to a recorder.
+ */
+typedef struct
+{
+    FILE*         file;
+
+    /// Set once a write has failed, or SM_RECORD_STATE was dispatched,
+    /// after which nothing is written.
+    int           error;
+    size_t        used;
+    unsigned char buffer[ SM_RECORD_BUFFER_SIZE ];
+} SmRecorder;
+
+/// Start a recording in file, which is written from its current position.
+/// Returns 0 on success.
+int SmRecorder_open( SmRecorder* self, FILE* file );
+
+/// Record that signal, with size bytes of payload, is dispatched to
+/// machine. Signal SM_RECORD_STATE cannot be recorded: it is dropped and
+/// sets error.
+void SmRecorder_dispatch( SmRecorder* self,
+                          uint32_t    machine,
+                          uint16_t    signal,
+                          void const* payload,
+                          uint16_t    size );
+
+/// Record the final state of machine, by an id of the user's choice, e.g.
+/// its declared id or StateMachine_save().
+void SmRecorder_state( SmRecorder* self, uint32_t machine, uint16_t state );
+
+/// Write what is collected to the file, which is not closed. Returns 0 if
+/// all of the recording has been written.
+int SmRecorder_close( SmRecorder* self );
+
+//==============================================================================
+
+/**
+ * The machines that a recording is replayed to, by callbacks that wrap
+ * their engine, e.g. Base::StateMachine::dispatch() or
+ * StateMachine_dispatch().
+ */
+typedef struct
+{
+    /// Dispatch signal, with size bytes of payload, to machine. Returns
+    /// non-zero if handled. The payload is not aligned.
+    int      ( *dispatch )( void*       context,
+                            uint32_t    machine,
+                            uint16_t    signal,
+                            void const* payload,
+                            uint16_t    size );
+
+    /// The state of machine, as given to SmRecorder_state().
+    uint16_t ( *state )( void* context, uint32_t machine );
+
+    void*    context;
+} SmReplayTarget;
+
+/// Outcome of SmReplay_run(). Latencies are those of the dispatch
+/// callback, in ns, to within 1/16.
+typedef struct
+{
+    uint64_t events;
+    uint64_t handled;
+
+    /// Final states compared, and those that differed.
+    uint64_t checked;
+    uint64_t mismatched;
+
+    /// Machines checked by the state they ended up in when replayed; the
+    /// last counts those of state SM_REPLAY_SUMMARY - 1 and up.
+    uint64_t states[ SM_REPLAY_SUMMARY ];
+
+    /// Wall time of the replay.
+    uint64_t nanoseconds;
+
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+} SmReplayReport;
+
+/// Dispatch the events of the recording of size bytes at data, e.g. a
+/// mapped file, to target as fast as it takes them, and compare the final
+/// states recorded. Returns 0 on success, -1 if data is not a recording
+/// or is truncated. SmTrace.c shall be linked in.
+int SmReplay_run( void const*           data,
+                  size_t                size,
+                  SmReplayTarget const* target,
+                  SmReplayReport*       report );
+
+//------------------------------------------------------------------------------
+
+/// Latencies are counted in buckets of 1/16 of their power of two.
+#define SM_REPLAY_SUB_BITS 4
+#define SM_REPLAY_SUBS     ( 1u << SM_REPLAY_SUB_BITS )
+#define SM_REPLAY_BUCKETS  ( ( 64 - SM_REPLAY_SUB_BITS + 1 ) * SM_REPLAY_SUBS )
+
+/// Latencies of a replay, in ticks of smTraceNow(), as kept until the
+/// percentiles of its SmReplayReport are set by SmReplay_percentiles().
+typedef struct
+{
+    uint64_t counts[ SM_REPLAY_BUCKETS ];
+    uint64_t most;
+
+    /// Ticks and ns that the replay took, for the rate between them.
+    uint64_t ticks;
+    uint64_t nanoseconds;
+} SmReplayLatencies;
+
+/// The first entry of the recording of size bytes at data, 0 if data is
+/// not a recording. The steps of SmReplay_run(), for replaying it in
+/// other ways, e.g. from several threads (see SmShardedReplay.h):
+///
+///   for ( entry = SmReplay_first( data, size ); entry != end; entry = next )
+///   {
+///       next = SmReplay_next( entry, end, &machine );  // 0 if truncated
+///       SmReplay_entry( entry, target, report, latencies );
+///   }
+void const* SmReplay_first( void const* data, size_t size );
+
+/// The entry after the one at entry, end if it is the last, 0 if it is
+/// truncated or malformed. Sets machine to that of the entry.
+void const* SmReplay_next( void const* entry, void const* end, uint32_t* machine );
+
+/// Dispatch the entry at entry, which SmReplay_next() has accepted, to
+/// target, or compare the final state that it holds. Adds to report and
+/// latencies, which shall be zeroed first; the wall time of report, the
+/// time of latencies and the percentiles are left to the caller.
+void SmReplay_entry( void const*           entry,
+                     SmReplayTarget const* target,
+                     SmReplayReport*       report,
+                     SmReplayLatencies*    latencies );
+
+/// Add the report and latencies of a shard to those of the whole replay.
+/// The wall time of report is left to the caller.
+void SmReplay_merge( SmReplayReport*          report,
+                     SmReplayLatencies*       latencies,
+                     SmReplayReport const*    shardReport,
+                     SmReplayLatencies const* shardLatencies );
+
+/// Set the percentiles and max of report from latencies.
+void SmReplay_percentiles( SmReplayReport*          report,
+                           SmReplayLatencies const* latencies );
+
+#if defined ( __cplusplus )
+}
+#endif /* __cplusplus */
+
+//==============================================================================
+#endif /* BASE_SM_RECORD_H_ */
+//==============================================================================
@@ -0,0 +1,292 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmShardedReplay.h
+// Author        Tommy Carlsson (topcatse)
+//
+// This file contains the interfaces of SmShardedReplay.
+//==============================================================================
+#pragma once
+#if !defined ( BASE_SM_SHARDED_REPLAY_H_ )
+#define BASE_SM_SHARDED_REPLAY_H_
+//==============================================================================
+
+#include "SmEventQueue.h"
+#include "SmRecord.h"
+#include "SmTrace.h"
+
+// ANSI/STL
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+//==============================================================================
+
+// This section should be defined elsewhere.
+
+/// Entries handed to a shard at a time, see SmShardedReplay.
+#if !defined ( SM_REPLAY_BATCH )
+#   define SM_REPLAY_BATCH 1024
+#endif /* SM_REPLAY_BATCH */
+
+/// Batches of a shard, and so how far ahead of it the reader may get. A
+/// power of two.
+#if !defined ( SM_REPLAY_BATCHES )
+#   define SM_REPLAY_BATCHES 8
+#endif /* SM_REPLAY_BATCHES */
+
+//==============================================================================
+namespace Base {
+//==============================================================================
+
+/**
+ * Replay of a recording (see SmRecord.h) on many threads. The calling
+ * thread reads the recording once, from start to end, and partitions its
+ * entries into shards by machine % shards. It hands them over in batches
+ * of SM_REPLAY_BATCH to one thread per shard, which replays them by
+ * SmReplay_entry() to a target of its own, e.g. its own StateMachine
+ * instances. The events of a machine are thus dispatched by one thread,
+ * in the order recorded.
+ *
+ * A shard has SM_REPLAY_BATCHES batches, and the reader waits for one to
+ * be done before it gets further ahead of that shard. Map the recording,
+ * e.g. by SmSnapshotFile, rather than read it: it is then streamed from
+ * disk, each page read by the reader and by the shards shortly after, and
+ * never held in memory as a whole.
+ */
+class SmShardedReplay
+{
+public:
+    /// Constructor. By default one shard per core but one, which is left
+    /// to the reader.
+    explicit SmShardedReplay( unsigned shards = std::thread::hardware_concurrency() > 1
+                                              ? std::thread::hardware_concurrency() - 1
+                                              : 1 );
+
+    unsigned shards() const { return static_cast< unsigned >( shards_.size() ); }
+
+    /// Replay the recording of size bytes at data, shard s to targets[ s ]
+    /// on a thread of its own, and merge the reports of the shards into
+    /// report, the wall time being that of the whole. Returns 0 on success,
+    /// -1 if data is not a recording or is truncated.
+    int run( void const*           data,
+             std::size_t           size,
+             SmReplayTarget const* targets,
+             SmReplayReport&       report );
+
+    /// The report of shard s in the last run, e.g. to see how even the
+    /// shards are.
+    SmReplayReport const& shard( unsigned s ) const { return shards_[ s ]->report; }
+
+private:
+    /// Entries of a shard, in the order recorded.
+    struct Batch
+    {
+        unsigned    count;
+        void const* entries[ SM_REPLAY_BATCH ];
+    };
+
+    /// The batches of a shard: those handed over, with 0 for the end, and
+    /// those done with.
+    struct Shard
+    {
+        SmEventQueue< Batch*, SM_REPLAY_BATCHES > full;
+        SmEventQueue< Batch*, SM_REPLAY_BATCHES > free;
+        Batch                                     batches[ SM_REPLAY_BATCHES ];
+
+        SmReplayReport                            report;
+        SmReplayLatencies                         latencies;
+    };
+
+    /// A batch that shard is done with, waiting for one if need be. Reader
+    /// only.
+    static Batch* take( Shard& shard );
+
+    /// Replay the batches handed to shard until the end, on a thread of
+    /// its own.
+    static void replay( Shard* shard, SmReplayTarget const* target );
+
+    std::vector< std::unique_ptr< Shard > > shards_;
+};
+
+//------------------------------------------------------------------------------
+
+inline
+SmShardedReplay::SmShardedReplay( unsigned shards )
+    : shards_( shards > 0 ? shards : 1 )
+{
+    for ( std::size_t s = 0; s < shards_.size(); ++s )
+    {
+        shards_[ s ].reset( new Shard );
+    }
+}
+
+//------------------------------------------------------------------------------
+
+inline
+SmShardedReplay::Batch*
+SmShardedReplay::take( Shard& shard )
+{
+    Batch* batch;
+
+    for ( ;; )
+    {
+        uint32_t seen = shard.free.ticket();
+        if ( shard.free.tryPop( batch ) )
+        {
+            break;
+        }
+        shard.free.wait( seen );
+    }
+
+    batch->count = 0;
+    return batch;
+}
+
+//------------------------------------------------------------------------------
+
+inline
+void
+SmShardedReplay::replay( Shard* shard, SmReplayTarget const* target )
+{
+    // Kept on this thread's stack until done, so that the shards do not
+    // share cache lines.
+    SmReplayReport    report;
+    SmReplayLatencies latencies;
+    std::memset( &report, 0, sizeof( report ) );
+    std::memset( &latencies, 0, sizeof( latencies ) );
+
+    uint64_t                              startTicks = smTraceNow();
+    std::chrono::steady_clock::time_point start      = std::chrono::steady_clock::now();
+
+    for ( ;; )
+    {
+        Batch*   batch;
+        uint32_t seen = shard->full.ticket();
+        if ( !shard->full.tryPop( batch ) )
+        {
+            shard->full.wait( seen );
+            continue;
+        }
+
+        if ( !batch )
+        {
+            break;
+        }
+
+        for ( unsigned i = 0; i < batch->count; ++i )
+        {
+            SmReplay_entry( batch->entries[ i ], target, &report, &latencies );
+        }
+        shard->free.push( batch );
+    }
+
+    latencies.ticks       = smTraceNow() - startTicks;
+    latencies.nanoseconds = std::chrono::duration_cast< std::chrono::nanoseconds >(
+                                std::chrono::steady_clock::now() - start ).count();
+    report.nanoseconds    = latencies.nanoseconds;
+
+    shard->report    = report;
+    shard->latencies = latencies;
+}
+
+//------------------------------------------------------------------------------
+
+inline
+int
+SmShardedReplay::run( void const*           data,
+                      std::size_t           size,
+                      SmReplayTarget const* targets,
+                      SmReplayReport&       report )
+{
+    assert( targets );
+
+    std::memset( &report, 0, sizeof( report ) );
+
+    void const* end   = static_cast< unsigned char const* >( data ) + size;
+    void const* entry = SmReplay_first( data, size );
+    if ( !entry )
+    {
+        return -1;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::vector< std::thread > threads( shards() );
+    std::vector< Batch* >      filling( shards() );
+    for ( unsigned s = 0; s < shards(); ++s )
+    {
+        Shard& shard = *shards_[ s ];
+        for ( unsigned b = 0; b < SM_REPLAY_BATCHES; ++b )
+        {
+            shard.free.push( &shard.batches[ b ] );
+        }
+        filling[ s ] = take( shard );
+        threads[ s ] = std::thread( &SmShardedReplay::replay, &shard, &targets[ s ] );
+    }
+
+    int result = 0;
+    while ( entry != end )
+    {
+        uint32_t    machine;
+        void const* next = SmReplay_next( entry, end, &machine );
+        if ( !next )
+        {
+            result = -1;
+            break;
+        }
+
+        unsigned s     = machine % shards();
+        Batch*   batch = filling[ s ];
+        batch->entries[ batch->count++ ] = entry;
+        if ( batch->count == SM_REPLAY_BATCH )
+        {
+            shards_[ s ]->full.push( batch );
+            filling[ s ] = take( *shards_[ s ] );
+        }
+        entry = next;
+    }
+
+    for ( unsigned s = 0; s < shards(); ++s )
+    {
+        shards_[ s ]->full.push( filling[ s ] );
+        shards_[ s ]->full.push( 0 );
+    }
+
+    for ( unsigned s = 0; s < shards(); ++s )
+    {
+        threads[ s ].join();
+
+        // Back to where the next run starts from.
+        Batch* batch;
+        while ( shards_[ s ]->free.tryPop( batch ) )
+        {
+        }
+    }
+    std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+
+    if ( result != 0 )
+    {
+        return -1;
+    }
+
+    SmReplayLatencies latencies;
+    std::memset( &latencies, 0, sizeof( latencies ) );
+    for ( unsigned s = 0; s < shards(); ++s )
+    {
+        SmReplay_merge( &report, &latencies, &shards_[ s ]->report, &shards_[ s ]->latencies );
+    }
+    SmReplay_percentiles( &report, &latencies );
+    report.nanoseconds =
+        std::chrono::duration_cast< std::chrono::nanoseconds >( elapsed ).count();
+    return 0;
+}
+
+//==============================================================================
+} // namespace Base
+//==============================================================================
+#endif /* BASE_SM_SHARDED_REPLAY_H_ */
+//==============================================================================
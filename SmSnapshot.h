@@ -0,0 +1,194 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmSnapshot.h
+// Author        Tommy Carlsson (topcatse)
+//
+// This file contains the interfaces of SmSnapshotHeader and SmSnapshotFile.
+//==============================================================================
+#pragma once
+#if !defined ( BASE_SM_SNAPSHOT_H_ )
+#define BASE_SM_SNAPSHOT_H_
+//==============================================================================
+
+#include "StateMachine.h"
+
+// ANSI/STL
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if defined ( __unix__ ) || defined ( __APPLE__ )
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#   define SM_SNAPSHOT_MMAP 1
+#endif /* __unix__ */
+
+//==============================================================================
+namespace Base {
+//==============================================================================
+
+/**
+ * A snapshot of the members of an SmFamily, see SmFamily::save(): this
+ * header, then the declared id of the current state of each member, in
+ * member order. Written in one sequential pass and read in place, e.g.
+ * from an SmSnapshotFile. Ids are in the byte order of the host.
+ */
+struct SmSnapshotHeader
+{
+    /// SM_SNAPSHOT_MAGIC.
+    char     magic[ 4 ];
+    uint32_t version;
+
+    /// Of the declared hierarchy, see smFingerprint().
+    uint64_t fingerprint;
+    uint64_t members;
+};
+
+#define SM_SNAPSHOT_MAGIC   "SmSs"
+#define SM_SNAPSHOT_VERSION 1
+
+/// Write a snapshot of count ids of machines of OWNER to file. Returns
+/// false if it could not be written.
+template < class OWNER, class T >
+bool smWriteSnapshot( std::FILE* file, SmStateId const* ids, uint64_t count )
+{
+    SmSnapshotHeader header;
+    std::memcpy( header.magic, SM_SNAPSHOT_MAGIC, sizeof( header.magic ) );
+    header.version     = SM_SNAPSHOT_VERSION;
+    header.fingerprint = smFingerprint< OWNER, T >();
+    header.members     = count;
+
+    return std::fwrite( &header, sizeof( header ), 1, file ) == 1 &&
+           std::fwrite( ids, sizeof( SmStateId ), count, file ) == count;
+}
+
+/// The ids of a snapshot of machines of OWNER, of size bytes at data, and
+/// their count. 0 if it is not one, or not of OWNER's hierarchy.
+template < class OWNER, class T >
+SmStateId const* smReadSnapshot( void const* data, std::size_t size, uint64_t& count )
+{
+    SmSnapshotHeader header;
+    if ( !data || size < sizeof( header ) )
+    {
+        return 0;
+    }
+
+    std::memcpy( &header, data, sizeof( header ) );
+    if ( std::memcmp( header.magic, SM_SNAPSHOT_MAGIC, sizeof( header.magic ) ) != 0 ||
+         header.version     != SM_SNAPSHOT_VERSION ||
+         header.fingerprint != smFingerprint< OWNER, T >() ||
+         header.members     >  ( size - sizeof( header ) ) / sizeof( SmStateId ) )
+    {
+        return 0;
+    }
+
+    count = header.members;
+    return reinterpret_cast< SmStateId const* >(
+        static_cast< char const* >( data ) + sizeof( header ) );
+}
+
+//==============================================================================
+
+/**
+ * A file mapped read only, e.g. a snapshot to restore. Pages are read in
+ * as they are touched, sequentially, rather than copied up front. Read
+ * into memory where there is no mmap.
+ */
+class SmSnapshotFile
+{
+public:
+    /// Map the file at path. valid() tells whether it could be.
+    explicit SmSnapshotFile( char const* path );
+
+    /// Dtor. Unmaps the file.
+    ~SmSnapshotFile();
+
+    bool valid() const { return data_ != 0; }
+
+    void const* data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+    SmSnapshotFile( SmSnapshotFile const& );
+    SmSnapshotFile& operator=( SmSnapshotFile const& );
+
+    void const*         data_;
+    std::size_t         size_;
+
+    /// The content, where it is read rather than mapped.
+    std::vector< char > buffer_;
+};
+
+//------------------------------------------------------------------------------
+
+inline
+SmSnapshotFile::SmSnapshotFile( char const* path )
+    : data_( 0 ), size_( 0 )
+{
+#if defined ( SM_SNAPSHOT_MMAP )
+    int fd = ::open( path, O_RDONLY );
+    if ( fd < 0 )
+    {
+        return;
+    }
+
+    struct stat st;
+    if ( ::fstat( fd, &st ) == 0 && st.st_size > 0 )
+    {
+        void* data = ::mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if ( data != MAP_FAILED )
+        {
+#   if defined ( MADV_SEQUENTIAL )
+            ::madvise( data, st.st_size, MADV_SEQUENTIAL );
+#   endif /* MADV_SEQUENTIAL */
+            data_ = data;
+            size_ = st.st_size;
+        }
+    }
+    ::close( fd );
+#else
+    std::FILE* file = std::fopen( path, "rb" );
+    if ( !file )
+    {
+        return;
+    }
+
+    char   chunk[ 65536 ];
+    size_t count;
+    while ( ( count = std::fread( chunk, 1, sizeof( chunk ), file ) ) > 0 )
+    {
+        buffer_.insert( buffer_.end(), chunk, chunk + count );
+    }
+    std::fclose( file );
+
+    if ( !buffer_.empty() )
+    {
+        data_ = &buffer_[ 0 ];
+        size_ = buffer_.size();
+    }
+#endif /* SM_SNAPSHOT_MMAP */
+}
+
+//------------------------------------------------------------------------------
+
+inline
+SmSnapshotFile::~SmSnapshotFile()
+{
+#if defined ( SM_SNAPSHOT_MMAP )
+    if ( data_ )
+    {
+        ::munmap( const_cast< void* >( data_ ), size_ );
+    }
+#endif /* SM_SNAPSHOT_MMAP */
+}
+
+//------------------------------------------------------------------------------
+} // namespace Base {
+//------------------------------------------------------------------------------
+
+//==============================================================================
+#endif /* BASE_SM_SNAPSHOT_H_ */
+//==============================================================================
@@ -0,0 +1,268 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmTimer.h
+// Author        Tommy Carlsson (topcatse)
+//
+// This file contains the interfaces of SmTimerWheel and SmTimerNode.
+//==============================================================================
+#pragma once
+#if !defined ( BASE_SM_TIMER_H_ )
+#define BASE_SM_TIMER_H_
+//==============================================================================
+
+// ANSI/STL
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+//==============================================================================
+namespace Base {
+//==============================================================================
+
+// This section should be defined elsewhere.
+
+/// Slots per level of SmTimerWheel, as a power of two.
+#if !defined ( SM_TIMER_WHEEL_BITS )
+#   define SM_TIMER_WHEEL_BITS 8
+#endif /* SM_TIMER_WHEEL_BITS */
+
+/// Levels of SmTimerWheel. Timers further out than the levels reach,
+/// 2^( SM_TIMER_WHEEL_BITS * SM_TIMER_WHEEL_LEVELS ) ticks, are moved
+/// closer as the wheel turns.
+#if !defined ( SM_TIMER_WHEEL_LEVELS )
+#   define SM_TIMER_WHEEL_LEVELS 4
+#endif /* SM_TIMER_WHEEL_LEVELS */
+
+//==============================================================================
+
+/// Link of a circular list of timers, the head of a list being a plain
+/// SmTimerLink.
+struct SmTimerLink
+{
+    SmTimerLink() : prev( 0 ), next( 0 ) {}
+
+    SmTimerLink* prev;
+    SmTimerLink* next;
+};
+
+/**
+ * A timer of an SmTimerWheel. expire() is called when it is due, by the
+ * thread that advances the wheel. A timer is not copied.
+ */
+class SmTimerNode : private SmTimerLink
+{
+public:
+    /// True if armed in a wheel.
+    bool armed() const { return next != 0; }
+
+    /// The tick that it expires at, if armed.
+    uint64_t deadline() const { return deadline_; }
+
+    /// Disarm, if armed. O(1).
+    void cancel()
+    {
+        if ( next )
+        {
+            prev->next = next;
+            next->prev = prev;
+            prev       = 0;
+            next       = 0;
+        }
+    }
+
+protected:
+    /// Constructor.
+    SmTimerNode() : deadline_( 0 ) {}
+
+    /// Dtor. Disarms.
+    virtual ~SmTimerNode() { cancel(); }
+
+    /// Called when due, disarmed. The timer may be armed again.
+    virtual void expire() = 0;
+
+private:
+    friend class SmTimerWheel;
+
+    SmTimerNode( SmTimerNode const& );
+    SmTimerNode& operator=( SmTimerNode const& );
+
+    uint64_t deadline_;
+};
+
+/**
+ * Hierarchical timing wheel (cf. Varghese and Lauck, "Hashed and
+ * Hierarchical Timing Wheels"). Arm and cancel are O(1); a timer moves
+ * down at most once per level on its way to expiry. Time is in ticks of
+ * the user's choice, driven by advance(). Not thread safe: one thread
+ * arms, cancels and advances.
+ */
+class SmTimerWheel
+{
+public:
+    /// Constructor.
+    SmTimerWheel() : now_( 0 )
+    {
+        for ( unsigned level = 0; level < LEVELS; ++level )
+        {
+            for ( unsigned slot = 0; slot < SLOTS; ++slot )
+            {
+                SmTimerLink& head = slots_[ level ][ slot ];
+                head.prev = head.next = &head;
+            }
+        }
+    }
+
+    /// Dtor. Timers still armed are disarmed, without expiring.
+    ~SmTimerWheel()
+    {
+        for ( unsigned level = 0; level < LEVELS; ++level )
+        {
+            for ( unsigned slot = 0; slot < SLOTS; ++slot )
+            {
+                SmTimerLink& head = slots_[ level ][ slot ];
+                while ( head.next != &head )
+                {
+                    static_cast< SmTimerNode* >( head.next )->cancel();
+                }
+            }
+        }
+    }
+
+    /// Ticks advanced since construction.
+    uint64_t now() const { return now_; }
+
+    /// Arm timer to expire ticks from now, at least one. An armed timer
+    /// is moved.
+    void arm( SmTimerNode& timer, uint64_t ticks )
+    {
+        timer.cancel();
+        timer.deadline_ = now_ + ( ticks > 0 ? ticks : 1 );
+        place( timer );
+    }
+
+    /// Advance time by ticks, expiring the timers that fall due, tick by
+    /// tick. Returns the number of timers expired.
+    std::size_t advance( uint64_t ticks = 1 );
+
+private:
+    enum
+    {
+        BITS   = SM_TIMER_WHEEL_BITS,
+        LEVELS = SM_TIMER_WHEEL_LEVELS,
+        SLOTS  = 1u << SM_TIMER_WHEEL_BITS,
+        MASK   = SLOTS - 1
+    };
+
+    static_assert( BITS * LEVELS < 64, "SmTimerWheel reach exceeds 64 bits" );
+
+    /// Put timer in the slot of its deadline, on the lowest level that
+    /// reaches it.
+    void place( SmTimerNode& timer );
+
+    /// Move the timers of a slot to the list at head, emptying the slot.
+    static void take( SmTimerLink& slot, SmTimerLink& head );
+
+    uint64_t    now_;
+    SmTimerLink slots_[ LEVELS ][ SLOTS ];
+};
+
+//------------------------------------------------------------------------------
+
+inline
+void
+SmTimerWheel::place( SmTimerNode& timer )
+{
+    uint64_t key   = timer.deadline_;
+    unsigned level = 0;
+
+    // Beyond reach, kept in the last slot to come round on the top level.
+    uint64_t reach = uint64_t( 1 ) << ( BITS * LEVELS );
+    if ( key - now_ >= reach )
+    {
+        key = now_ + reach - 1;
+    }
+
+    while ( level + 1 < LEVELS &&
+            ( key - now_ ) >= ( uint64_t( 1 ) << ( BITS * ( level + 1 ) ) ) )
+    {
+        ++level;
+    }
+
+    SmTimerLink& head = slots_[ level ][ ( key >> ( BITS * level ) ) & MASK ];
+    timer.prev      = head.prev;
+    timer.next      = &head;
+    head.prev->next = &timer;
+    head.prev       = &timer;
+}
+
+//------------------------------------------------------------------------------
+
+inline
+void
+SmTimerWheel::take( SmTimerLink& slot, SmTimerLink& head )
+{
+    if ( slot.next == &slot )
+    {
+        head.prev = head.next = &head;
+        return;
+    }
+
+    head.next       = slot.next;
+    head.prev       = slot.prev;
+    head.next->prev = &head;
+    head.prev->next = &head;
+    slot.prev = slot.next = &slot;
+}
+
+//------------------------------------------------------------------------------
+
+inline
+std::size_t
+SmTimerWheel::advance( uint64_t ticks )
+{
+    std::size_t expired = 0;
+    SmTimerLink list;
+
+    while ( ticks-- > 0 )
+    {
+        ++now_;
+
+        // Each level that turns over moves the timers of the slot it has
+        // come to down to the levels below.
+        for ( unsigned level = 1; level < LEVELS; ++level )
+        {
+            if ( ( now_ & ( ( uint64_t( 1 ) << ( BITS * level ) ) - 1 ) ) != 0 )
+            {
+                break;
+            }
+
+            take( slots_[ level ][ ( now_ >> ( BITS * level ) ) & MASK ], list );
+            while ( list.next != &list )
+            {
+                SmTimerNode* timer = static_cast< SmTimerNode* >( list.next );
+                timer->cancel();
+                place( *timer );
+            }
+        }
+
+        // Expired timers may arm and cancel any timer, those in list too.
+        take( slots_[ 0 ][ now_ & MASK ], list );
+        while ( list.next != &list )
+        {
+            SmTimerNode* timer = static_cast< SmTimerNode* >( list.next );
+            timer->cancel();
+            assert( timer->deadline_ == now_ && "SmTimerWheel misplaced timer" );
+            ++expired;
+            timer->expire();
+        }
+    }
+    return expired;
+}
+
+//------------------------------------------------------------------------------
+} // namespace Base {
+//------------------------------------------------------------------------------
+
+//==============================================================================
+#endif /* BASE_SM_TIMER_H_ */
+//==============================================================================
@@ -0,0 +1,328 @@
+//=============================================- -*- C -*- ===================
+//
+// File Name     SmTrace.c
+// Author        Tommy Carlsson
+//
+// This file contains the implementation of the binary trace.
+//
+//==============================================================================
+
+#if !defined ( _POSIX_C_SOURCE )
+#   define _POSIX_C_SOURCE 200112L
+#endif /* _POSIX_C_SOURCE */
+
+#include "SmTrace.h"
+#include <stdlib.h>
+#if !defined ( SM_NO_MALLOC )
+#   include <pthread.h>
+#endif /* SM_NO_MALLOC */
+#include <string.h>
+#include <time.h>
+
+#if defined ( __x86_64__ ) || defined ( __i386__ )
+#   include <x86intrin.h>
+#   define SM_TRACE_TSC 1
+#endif /* __x86_64__ */
+
+#if defined ( __STDC_VERSION__ ) && __STDC_VERSION__ >= 201112L
+#   define SM_THREAD_LOCAL _Thread_local
+#else
+#   define SM_THREAD_LOCAL __thread
+#endif /* __STDC_VERSION__ */
+
+/// The ring of one thread. Only that thread writes it.
+typedef struct SmTraceRing
+{
+    /// Index of the next record, records are at index & mask.
+    uint64_t head;
+
+    uint32_t thread;
+
+    /// Next ring, in the list of all rings.
+    struct SmTraceRing* next;
+
+    /// Next ring, in the list of rings of exited threads.
+    struct SmTraceRing* orphan;
+
+    SmTraceRecord records[ SM_TRACE_RING_SIZE ];
+} SmTraceRing;
+
+/// All rings, newest first. Rings are never freed, so that the records of
+/// threads that have exited can still be dumped. The ring of an exited
+/// thread is taken over by the next new thread instead.
+static SmTraceRing* rings = 0;
+
+static uint32_t threads = 0;
+
+/// smTraceNow() and ns at the first record, see SmTraceFileHeader.
+static uint64_t startTicks       = 0;
+static uint64_t startNanoseconds = 0;
+
+static SM_THREAD_LOCAL SmTraceRing* ring = 0;
+
+#if !defined ( SM_NO_MALLOC )
+/// Rings of exited threads, dumpable until taken over.
+static SmTraceRing*    orphans     = 0;
+static pthread_mutex_t orphansLock = PTHREAD_MUTEX_INITIALIZER;
+
+/// Its destructor hands the ring of an exiting thread to orphans.
+static pthread_key_t   exitKey;
+static pthread_once_t  exitOnce    = PTHREAD_ONCE_INIT;
+static int             exitKeyed   = 0;
+#endif /* SM_NO_MALLOC */
+
+#if defined ( SM_NO_MALLOC )
+static SmTraceRing   pool[ SM_TRACE_THREADS ];
+static uint32_t      pooled = 0;
+
+/// Dump buffer, smTraceDump() is not reentrant in this profile.
+static SmTraceRecord dumped[ SM_TRACE_RING_SIZE ];
+#endif /* SM_NO_MALLOC */
+
+//------------------------------------------------------------------------------
+
+static uint64_t SmTrace_nanoseconds( void )
+{
+   struct timespec now;
+   clock_gettime( CLOCK_MONOTONIC, &now );
+   return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+
+#if !defined ( SM_NO_MALLOC )
+static void SmTrace_orphan( void* exited )
+{
+   SmTraceRing* r = exited;
+
+   // A record written after this, e.g. by a later destructor, takes a ring
+   // anew instead of writing one that another thread may have taken.
+   ring = 0;
+
+   pthread_mutex_lock( &orphansLock );
+   r->orphan = orphans;
+   orphans   = r;
+   pthread_mutex_unlock( &orphansLock );
+}
+
+//------------------------------------------------------------------------------
+
+static void SmTrace_keyExit( void )
+{
+   exitKeyed = pthread_key_create( &exitKey, SmTrace_orphan ) == 0;
+}
+
+//------------------------------------------------------------------------------
+
+/// Take over the ring of an exited thread, if any. Its records are
+/// invalidated rather than dumped as the calling thread's.
+static SmTraceRing* SmTrace_adopt( void )
+{
+   SmTraceRing* r;
+   uint32_t     i;
+
+   pthread_mutex_lock( &orphansLock );
+   r = orphans;
+   if ( r )
+   {
+      orphans = r->orphan;
+   }
+   pthread_mutex_unlock( &orphansLock );
+
+   if ( r )
+   {
+      // head goes on, so no stale record holds an index in the ring again.
+      for ( i = 0; i < SM_TRACE_RING_SIZE; ++i )
+      {
+         __atomic_store_n( &r->records[ i ].seq, (uint32_t)~0u, __ATOMIC_RELAXED );
+      }
+      __atomic_store_n( &r->thread,
+                        __atomic_fetch_add( &threads, 1, __ATOMIC_RELAXED ),
+                        __ATOMIC_RELEASE );
+   }
+   return r;
+}
+#endif /* SM_NO_MALLOC */
+
+//------------------------------------------------------------------------------
+
+static SmTraceRing* SmTrace_ring( void )
+{
+#if !defined ( SM_NO_MALLOC )
+   pthread_once( &exitOnce, SmTrace_keyExit );
+
+   SmTraceRing* adopted = exitKeyed ? SmTrace_adopt() : 0;
+   if ( adopted )
+   {
+      pthread_setspecific( exitKey, adopted );
+      return adopted;
+   }
+#endif /* SM_NO_MALLOC */
+
+#if defined ( SM_NO_MALLOC )
+   uint32_t index = __atomic_fetch_add( &pooled, 1, __ATOMIC_RELAXED );
+   if ( index >= SM_TRACE_THREADS )
+   {
+      return 0;
+   }
+   SmTraceRing* r = &pool[ index ];
+#else
+   SmTraceRing* r = malloc( sizeof( SmTraceRing ) );
+   if ( r == 0 )
+   {
+      return 0;
+   }
+#endif /* SM_NO_MALLOC */
+
+   memset( r, 0, sizeof( SmTraceRing ) );
+   r->thread = __atomic_fetch_add( &threads, 1, __ATOMIC_RELAXED );
+
+   if ( r->thread == 0 )
+   {
+      startNanoseconds = SmTrace_nanoseconds();
+      startTicks       = smTraceNow();
+   }
+
+   r->next = __atomic_load_n( &rings, __ATOMIC_RELAXED );
+   while ( !__atomic_compare_exchange_n( &rings, &r->next, r, 1,
+                                         __ATOMIC_RELEASE,
+                                         __ATOMIC_RELAXED ) )
+      ;
+
+#if !defined ( SM_NO_MALLOC )
+   if ( exitKeyed )
+   {
+      pthread_setspecific( exitKey, r );
+   }
+#endif /* SM_NO_MALLOC */
+   return r;
+}
+
+//------------------------------------------------------------------------------
+
+uint64_t smTraceNow( void )
+{
+#if defined ( SM_TRACE_TSC )
+   return __rdtsc();
+#else
+   return SmTrace_nanoseconds();
+#endif /* SM_TRACE_TSC */
+}
+
+//------------------------------------------------------------------------------
+
+void smTraceWrite( SmTraceEvent event,
+                   void const*  machine,
+                   uint16_t     state,
+                   uint16_t     next,
+                   uint16_t     signal,
+                   uint8_t      kase )
+{
+   if ( ring == 0 && ( ring = SmTrace_ring() ) == 0 )
+   {
+      return;
+   }
+
+   uint64_t       head = ring->head;
+   SmTraceRecord* r    = &ring->records[ head & ( SM_TRACE_RING_SIZE - 1 ) ];
+
+   // Invalidate the slot while it is being written.
+   __atomic_store_n( &r->seq, (uint32_t)~0u, __ATOMIC_RELAXED );
+   __atomic_thread_fence( __ATOMIC_RELEASE );
+
+   r->time    = smTraceNow();
+   r->machine = (uint64_t)(uintptr_t)machine;
+   r->state   = state;
+   r->next    = next;
+   r->signal  = signal;
+   r->event   = (uint8_t)event;
+   r->kase    = kase;
+
+   __atomic_store_n( &r->seq, (uint32_t)head, __ATOMIC_RELEASE );
+   __atomic_store_n( &ring->head, head + 1, __ATOMIC_RELEASE );
+}
+
+//------------------------------------------------------------------------------
+
+int smTraceDump( FILE* file )
+{
+   SmTraceFileHeader header;
+   SmTraceRing*      r;
+
+   memcpy( header.magic, "SMTR", 4 );
+   header.version    = 1;
+   header.recordSize = sizeof( SmTraceRecord );
+   header.rings      = 0;
+   header.reserved   = 0;
+
+   SmTraceRing* first = __atomic_load_n( &rings, __ATOMIC_ACQUIRE );
+
+   // Published along with the first ring.
+   header.ticks[ 0 ]       = startTicks;
+   header.nanoseconds[ 0 ] = startNanoseconds;
+   header.ticks[ 1 ]       = smTraceNow();
+   header.nanoseconds[ 1 ] = SmTrace_nanoseconds();
+
+   for ( r = first; r; r = r->next )
+   {
+      ++header.rings;
+   }
+
+   if ( fwrite( &header, sizeof( header ), 1, file ) != 1 )
+   {
+      return -1;
+   }
+
+#if defined ( SM_NO_MALLOC )
+   SmTraceRecord* copy = dumped;
+#else
+   SmTraceRecord* copy = malloc( sizeof( r->records ) );
+   if ( copy == 0 )
+   {
+      return -1;
+   }
+#endif /* SM_NO_MALLOC */
+
+   int result = 0;
+   for ( r = first; r && result == 0; r = r->next )
+   {
+      uint64_t head  = __atomic_load_n( &r->head, __ATOMIC_ACQUIRE );
+      uint64_t begin = head > SM_TRACE_RING_SIZE ? head - SM_TRACE_RING_SIZE : 0;
+      uint32_t count = 0;
+      uint64_t i;
+
+      // Keep the records that still hold the index they were written at.
+      for ( i = begin; i < head; ++i )
+      {
+         SmTraceRecord const* from = &r->records[ i & ( SM_TRACE_RING_SIZE - 1 ) ];
+         uint32_t seq = __atomic_load_n( &from->seq, __ATOMIC_ACQUIRE );
+
+         copy[ count ] = *from;
+         __atomic_thread_fence( __ATOMIC_ACQUIRE );
+
+         if ( seq == (uint32_t)i &&
+              __atomic_load_n( &from->seq, __ATOMIC_RELAXED ) == seq )
+         {
+            copy[ count ].seq = seq;
+            ++count;
+         }
+      }
+
+      SmTraceRingHeader ringHeader;
+      ringHeader.thread = __atomic_load_n( &r->thread, __ATOMIC_ACQUIRE );
+      ringHeader.count  = count;
+
+      if ( fwrite( &ringHeader, sizeof( ringHeader ), 1, file ) != 1 ||
+           fwrite( copy, sizeof( SmTraceRecord ), count, file ) != count )
+      {
+         result = -1;
+      }
+   }
+
+#if !defined ( SM_NO_MALLOC )
+   free( copy );
+#endif /* SM_NO_MALLOC */
+   return result;
+}
+
+//==============================================================================
@@ -0,0 +1,145 @@
+//=============================================- -*- C -*- ===================
+//
+// File Name     SmTrace.h
+// Author        Tommy Carlsson (topcatse)
+//
+// This file contains the interfaces of the binary trace of the C and C++
+// StateMachine engines.
+//==============================================================================
+#if !defined ( BASE_SM_TRACE_H_ )
+#define BASE_SM_TRACE_H_
+//==============================================================================
+
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined ( __cplusplus )
+extern "C" {
+#endif /* __cplusplus */
+
+//==============================================================================
+
+// This section should be defined elsewhere.
+
+/// Define this to 1 to let dispatch write SmTraceRecords. SmTrace.c shall
+/// then be linked in.
+//#define SM_BINARY_TRACE 1
+
+#if !defined ( SM_BINARY_TRACE )
+#   define SM_BINARY_TRACE 0
+#endif /* SM_BINARY_TRACE */
+
+/// Records per thread. Shall be a power of two.
+#if !defined ( SM_TRACE_RING_SIZE )
+#   define SM_TRACE_RING_SIZE 4096
+#endif /* SM_TRACE_RING_SIZE */
+
+/// Threads that can trace when built with SM_NO_MALLOC, which takes the
+/// rings from a static pool. Records of further threads are dropped.
+#if !defined ( SM_TRACE_THREADS )
+#   define SM_TRACE_THREADS 8
+#endif /* SM_TRACE_THREADS */
+
+//==============================================================================
+
+/// What a record is about.
+typedef enum
+{
+    SM_TRACE_OPEN     = 1,  ///< Machine opened, next is the initial state.
+    SM_TRACE_DISPATCH = 2   ///< Event dispatched.
+} SmTraceEvent;
+
+/// State of a record whose state is not known.
+#define SM_TRACE_NO_STATE 0xFFFF
+
+/// State of a record whose state is not declared, from a hash of it.
+/// 0x8000 .. 0xFFFD, clear of declared ids and SM_TRACE_NO_STATE.
+#define SM_TRACE_HASHED( hash ) \
+    ( (uint16_t)( 0x8000 | ( ( (hash) ^ ( (hash) >> 16 ) ) % 0x7FFE ) ) )
+
+/**
+ * One trace record, 32 bytes. A state is identified by its declared id
+ * (below 0x8000), or else by 0x8000 or'ed with a hash of the state.
+ */
+typedef struct
+{
+    /// smTraceNow(), see SmTraceFileHeader for converting to ns.
+    uint64_t time;
+
+    /// Address of the machine.
+    uint64_t machine;
+
+    /// Index of this record in the ring of its thread. Written last.
+    uint32_t seq;
+
+    /// State before and after the dispatch.
+    uint16_t state;
+    uint16_t next;
+
+    uint16_t signal;
+
+    /// SmTraceEvent.
+    uint8_t  event;
+
+    /// Transition case, 'a' .. 'h', or 0 if the event was not handled.
+    uint8_t  kase;
+
+    uint8_t  reserved[ 4 ];
+} SmTraceRecord;
+
+/**
+ * Layout of a dump, see smTraceDump(). All fields in host byte order.
+ *
+ *   SmTraceFileHeader
+ *   rings times: SmTraceRingHeader, followed by count SmTraceRecords,
+ *                oldest first
+ */
+typedef struct
+{
+    char     magic[ 4 ];   ///< "SMTR"
+    uint16_t version;      ///< 1
+    uint16_t recordSize;   ///< sizeof( SmTraceRecord )
+    uint32_t rings;
+    uint32_t reserved;
+
+    /// smTraceNow() and CLOCK_MONOTONIC ns, sampled at the first record
+    /// and at the dump. Time is linear between them.
+    uint64_t ticks[ 2 ];
+    uint64_t nanoseconds[ 2 ];
+} SmTraceFileHeader;
+
+typedef struct
+{
+    /// Thread number, in order of first record.
+    uint32_t thread;
+    uint32_t count;
+} SmTraceRingHeader;
+
+//==============================================================================
+
+/// Current time for SmTraceRecord. The time stamp counter on x86, since
+/// reading it costs a fraction of reading the clock, else ns.
+uint64_t smTraceNow( void );
+
+/// Append a record to the ring of the calling thread, overwriting the
+/// oldest if full. Lock free, but for the first record of a thread, which
+/// may take over the ring of an exited one.
+void smTraceWrite( SmTraceEvent event,
+                   void const*  machine,
+                   uint16_t     state,
+                   uint16_t     next,
+                   uint16_t     signal,
+                   uint8_t      kase );
+
+/// Write the rings of all threads to file, see SmTraceFileHeader.
+/// Records that are overwritten while dumping are left out.
+/// Returns 0 on success.
+int smTraceDump( FILE* file );
+
+#if defined ( __cplusplus )
+}
+#endif /* __cplusplus */
+
+//==============================================================================
+#endif /* BASE_SM_TRACE_H_ */
+//==============================================================================
@@ -10,7 +10,9 @@
 #include "StateMachineC.h"
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
+#if !defined ( SM_NO_MALLOC )
 State State_ctor( OWNER owner, StateFcn stateFcn )
 {
    State state = malloc(sizeof(struct State));
@@ -22,12 +24,18 @@ void State_dtor( State self )
 {
    free(self);
 }
+#endif /* SM_NO_MALLOC */
 
 /// Initializer. Object takes ownership of load.
 void State_init( State self, OWNER owner, StateFcn stateFcn )
 {
 	self->owner_    = owner;
 	self->stateFcn_ = stateFcn;
+	self->signals_   = 0;
+	self->reach_     = 0;
+	self->ancestors_ = 0;
+	self->numbering_ = 0;
+	self->bit_       = 0;
 }
 
 /// Conversion operator to StateFcn.
@@ -36,6 +44,12 @@ StateFcn State_stateFcn( State self )
 	return self->stateFcn_;
 }
 
+/// Identity.
+bool State_isSame( State self, State const rhs )
+{
+	return self == rhs;
+}
+
 /// Equality operator.
 bool State_isEqual( State self, State const rhs )
 {
@@ -56,11 +70,85 @@ State State_invoke( State self, Signal e )
 	return self->stateFcn_( self->owner_, e );
 }
 
+/// Publish handled signals. Bit INIT marks them published.
+void State_handles( State self, SmSignalMask signals )
+{
+	self->signals_ = signals | SM_SIGNAL( SM_INIT );
+	self->reach_   = 0;
+}
+
 //------------------------------------------------------------------------------
 
-static int8_t state_comparator(const void * a, const void * b)
+/// Slots of StatePath, a power of two at least twice DEQUE_MAX_NODES.
+#define SM_PATH_SLOTS ( 2 * DEQUE_MAX_NODES )
+
+/// The states of the path traced in cases (e) - (g), from the target up,
+/// and open addressed on their address, so that the least common ancestor
+/// is found in one probe per ancestor of the pitcher. The states below it
+/// are then entered from the path, in reverse.
+typedef struct
+{
+   State    states[ DEQUE_MAX_NODES ];
+   uint32_t count;
+
+   /// Index + 1 into states, 0 if free. Valid after StatePath_index().
+   uint8_t  slots[ SM_PATH_SLOTS ];
+} StatePath;
+
+static uint32_t StatePath_hash( State state )
+{
+   uintptr_t h = (uintptr_t)state;
+   return (uint32_t)( ( h * 0x9E3779B1u ) >> 16 ) & ( SM_PATH_SLOTS - 1 );
+}
+
+/// A transition path deeper than DEQUE_MAX_NODES. The exits are done by
+/// then, so the machine cannot be left consistent: a hard error.
+static void StatePath_overflow( void )
+{
+   assert( false && "StateMachine path overflow, increase DEQUE_MAX_NODES" );
+   abort();
+}
+
+static void StatePath_append( StatePath* path, State state )
+{
+   if ( path->count >= DEQUE_MAX_NODES )
+   {
+      StatePath_overflow();
+   }
+   path->states[ path->count++ ] = state;
+}
+
+static void StatePath_index( StatePath* path )
+{
+   uint32_t i;
+
+   memset( path->slots, 0, sizeof( path->slots ) );
+   for ( i = 0; i < path->count; ++i )
+   {
+      uint32_t h = StatePath_hash( path->states[ i ] );
+      while ( path->slots[ h ] != 0 )
+      {
+         h = ( h + 1 ) & ( SM_PATH_SLOTS - 1 );
+      }
+      path->slots[ h ] = (uint8_t)( i + 1 );
+   }
+}
+
+/// Position of state in the path counted from the last appended state,
+/// starting @ 1. 0 if not in path.
+static uint32_t StatePath_find( StatePath const* path, State state )
 {
-   return State_isEqual((State)a, (State)b) ? 0 : 1;
+   uint32_t h = StatePath_hash( state );
+
+   while ( path->slots[ h ] != 0 )
+   {
+      if ( path->states[ path->slots[ h ] - 1 ] == state )
+      {
+         return path->count - path->slots[ h ] + 1;
+      }
+      h = ( h + 1 ) & ( SM_PATH_SLOTS - 1 );
+   }
+   return 0;
 }
 
 //==============================================================================
@@ -89,33 +177,70 @@ static void StateMachine_init(StateMachine self, State state);
 /// Releases the event.
 static bool StateMachine_findPitcher(StateMachine self, Signal e);
 
+/// Give the state and its superstates a bit each, 1 .. 62, and fold them
+/// into State::ancestors_ of the state. Bit 0 is set if all of them got
+/// one, bit 63 marks ancestors_ folded.
+static void StateMachine_number(StateMachine self, State state);
+
+/// Take state into the numbering of the machine: the bit and ancestors_
+/// given by an earlier machine are dropped. Returns state.
+static State StateMachine_claim(StateMachine self, State state);
+
+/// A numbering not taken by any machine so far.
+static uint32_t StateMachine_nextNumbering(void);
+
+/// True if no state handles signal e in the current state, by the
+/// published signals.
+static bool StateMachine_rejects(StateMachine self, Signal e);
+
+/// Carry out dispatch of given event.
+/// Returns the transition case, 'a' .. 'h', or 0 if not handled.
+static char StateMachine_transit(StateMachine self, Signal e);
+
+#if SM_BINARY_TRACE
+/// State field of SmTraceRecord for given state.
+static uint16_t StateMachine_traceId(State state);
+#endif /* SM_BINARY_TRACE */
+
 /// Invoke exit on all states from current state down to
 /// pitcher state.
 static void StateMachine_exitDownToPitcher(StateMachine self );
 
-/// Invoke entry event in given path.
+/// Invoke entry event in given path, but for its last skip states.
 /// path: all states between pitcher and target..
 /// path: the states in the path might be updated but
 /// not the path itself.
-static void StateMachine_retraceEntryPath(StateMachine self, Deque path);
+static void StateMachine_retraceEntryPath(StateMachine self,
+                                          StatePath const* path,
+                                          uint32_t skip);
 
-static struct State topState;
-static struct State handledState;
+/// The sentinels are told by address only, hence shared by all machines.
+static struct State topState     = { .stateFcn_ = StateMachine_topState };
+static struct State handledState = { .stateFcn_ = StateMachine_handled };
 
 //===========================================================================
 
 #define PITCHER() StateMachine_pitcher(self)
 #define TARGET() StateMachine_target(self)
 #define CURRENT() StateMachine_current(self)
-#define EQUAL(state1, state2) State_isEqual(state1, state2)
-#define NEQUAL(state1, state2) State_isNotEqual(state1, state2)
-#define APPEND(t, s) do{ result = deque_appendleft(t, s); assert(result==DEQUE_SUCCESS); }while(0)
+/// A state is identified by its State object, see State_isSame(). The
+/// assert catches a state that is represented by two objects.
+#define EQUAL(state1, state2) \
+   ( assert( (state1) == (state2) || State_isNotEqual(state1, state2) ), \
+     (state1) == (state2) )
+#define NEQUAL(state1, state2) ( !EQUAL(state1, state2) )
 
 //------------------------------------------------------------------------------
 
+#if !defined ( SM_NO_MALLOC )
 StateMachine StateMachine_ctor()
 {
-    return malloc( sizeof( struct StateMachine_t ) );
+    StateMachine self = calloc( 1, sizeof( struct StateMachine_t ) );
+    if ( self )
+    {
+        self->numbering_ = StateMachine_nextNumbering();
+    }
+    return self;
 }
 
 //------------------------------------------------------------------------------
@@ -124,6 +249,58 @@ void StateMachine_dtor(StateMachine self)
 {
     free( self );
 }
+#endif /* SM_NO_MALLOC */
+
+//------------------------------------------------------------------------------
+
+void SmArena_init( SmArena* self, void* memory, unsigned long size )
+{
+   self->next = memory;
+   self->end  = self->next + size;
+}
+
+//------------------------------------------------------------------------------
+
+/// Take size bytes of arena, rounded up to keep the next one aligned as
+/// an SmArenaAlign.
+static void* SmArena_take( SmArena* self, unsigned long size )
+{
+   unsigned long aligned = SM_ARENA_ROUND( size );
+
+   if ( (unsigned long)( self->end - self->next ) < aligned )
+   {
+      return 0;
+   }
+
+   void* memory = self->next;
+   self->next += aligned;
+   return memory;
+}
+
+//------------------------------------------------------------------------------
+
+State State_create( SmArena* arena, OWNER owner, StateFcn stateFcn )
+{
+   State state = SmArena_take( arena, sizeof( struct State ) );
+   if ( state )
+   {
+      State_init( state, owner, stateFcn );
+   }
+   return state;
+}
+
+//------------------------------------------------------------------------------
+
+StateMachine StateMachine_create( SmArena* arena )
+{
+   StateMachine self = SmArena_take( arena, sizeof( struct StateMachine_t ) );
+   if ( self )
+   {
+      memset( self, 0, sizeof( struct StateMachine_t ) );
+      self->numbering_ = StateMachine_nextNumbering();
+   }
+   return self;
+}
 
 //------------------------------------------------------------------------------
 
@@ -133,11 +310,6 @@ void StateMachine_open(StateMachine   self,
 {
    SM_TRACE( "StateMachine_open" );
 
-   topState.stateFcn_     = StateMachine_topState;
-   topState.owner_        = owner;
-   handledState.stateFcn_ = StateMachine_handled;
-   handledState.owner_    = owner;
-   
    self->owner_   = owner;
    self->pitcher_ = &topState;
    self->current_ = &handledState;
@@ -147,6 +319,51 @@ void StateMachine_open(StateMachine   self,
    State_invoke( target, SM_ENTRY );
 
    StateMachine_init(self, target);
+
+#if SM_BINARY_TRACE
+   smTraceWrite( SM_TRACE_OPEN, self, SM_TRACE_NO_STATE,
+                 StateMachine_traceId( CURRENT() ), 0, 0 );
+#endif /* SM_BINARY_TRACE */
+}
+
+//------------------------------------------------------------------------------
+
+void StateMachine_restore(StateMachine   self,
+                          OWNER          owner,
+                          State const    current)
+{
+   SM_TRACE( "StateMachine_restore" );
+
+   self->owner_   = owner;
+   self->pitcher_ = &topState;
+   self->target_  = &topState;
+   StateMachine_setCurrent( self, current );
+
+   if ( StateMachine_claim( self, CURRENT() )->ancestors_ == 0 )
+   {
+      StateMachine_number( self, CURRENT() );
+   }
+
+#if SM_BINARY_TRACE
+   smTraceWrite( SM_TRACE_OPEN, self, SM_TRACE_NO_STATE,
+                 StateMachine_traceId( CURRENT() ), 0, 0 );
+#endif /* SM_BINARY_TRACE */
+}
+
+//------------------------------------------------------------------------------
+
+uint16_t StateMachine_save(StateMachine self,
+                           State const* states,
+                           uint16_t     count)
+{
+   SM_TRACE( "StateMachine_save" );
+
+   uint16_t index = 0;
+   while ( index < count && states[ index ] != CURRENT() )
+   {
+      ++index;
+   }
+   return index;
 }
 
 //------------------------------------------------------------------------------
@@ -160,6 +377,14 @@ int StateMachine_isInState(StateMachine self, State const state)
       return 2;
    }
 
+   // All superstates of current have a bit.
+   uint64_t ancestors = CURRENT()->ancestors_;
+   if ( ancestors & 1 )
+   {
+      return state->numbering_ == self->numbering_ && state->bit_ != 0 &&
+             ( ancestors >> state->bit_ & 1 ) ? 1 : 0;
+   }
+
    // and all states down to (not including) top.
 
    State next = State_invoke( CURRENT(), SM_INQUIRE );
@@ -192,14 +417,36 @@ bool StateMachine_dispatch(StateMachine self, Signal e)
     
     assert( e && "Bad event to StateMachine::dispatch" );
     
+#if SM_BINARY_TRACE
+    uint16_t state = StateMachine_traceId( CURRENT() );
+    char     kind  = StateMachine_transit( self, e );
+    smTraceWrite( SM_TRACE_DISPATCH, self, state,
+                  StateMachine_traceId( CURRENT() ), e, (uint8_t)kind );
+    return kind != 0;
+#else
+    return StateMachine_transit( self, e ) != 0;
+#endif /* SM_BINARY_TRACE */
+}
+
+//------------------------------------------------------------------------------
+
+static char StateMachine_transit(StateMachine self, Signal e)
+{
     // Used to elaborate internal transition.
     StateMachine_setTarget( self, &topState );
    
+    if ( StateMachine_rejects( self, e ) )
+    {
+        SM_TRACE( "StateMachine signal not published" );
+        StateMachine_setPitcher( self, &topState );
+        return 0;
+    }
+
     if ( !StateMachine_findPitcher( self, e ) )
     {
         // Signal is not handled.
         SM_TRACE( "StateMachine no pitcher" );
-        return false;
+        return 0;
     }
     
     // ( h) Internal transition.
@@ -209,7 +456,7 @@ bool StateMachine_dispatch(StateMachine self, Signal e)
     if ( EQUAL( TARGET(), &topState ) )
     {
         SM_TRACE( "StateMachine handled case (h)" );
-        return true;
+        return 'h';
     }
     
     StateMachine_exitDownToPitcher(self);
@@ -221,7 +468,7 @@ bool StateMachine_dispatch(StateMachine self, Signal e)
         State_invoke( PITCHER(), SM_EXIT );
         State_invoke( TARGET(), SM_ENTRY );
         StateMachine_init( self, TARGET() );
-        return true;
+        return 'a';
     }
     
     // (b) Handle pitcher == targets' parent.
@@ -231,7 +478,7 @@ bool StateMachine_dispatch(StateMachine self, Signal e)
         SM_TRACE( "StateMachine handled case (b)" );
         State_invoke( TARGET(), SM_ENTRY );
         StateMachine_init( self, TARGET() );
-        return true;
+        return 'b';
     }
     
     // (c) Handle pitcher's parent == targets' parent.
@@ -242,7 +489,7 @@ bool StateMachine_dispatch(StateMachine self, Signal e)
         State_invoke( PITCHER(), SM_EXIT );
         State_invoke( TARGET(), SM_ENTRY );
         StateMachine_init( self, TARGET() );
-        return true;
+        return 'c';
     }
     
     // (d) Handle pitcher's parent == target.
@@ -251,17 +498,15 @@ bool StateMachine_dispatch(StateMachine self, Signal e)
         SM_TRACE( "StateMachine handled case (d)" );
         State_invoke( PITCHER(), SM_EXIT );
         StateMachine_init( self, TARGET() );
-        return true;
+        return 'd';
     }
     
     // The target state hierarchy needs to be recorded.
-    deque_result_t result;
-    struct deque_t trace_instance;
-    Deque trace = &trace_instance;
-    deque_init( trace, state_comparator );
+    StatePath path;
+    path.count = 0;
     
-    APPEND( trace, TARGET() );
-    APPEND( trace, targetParent );
+    StatePath_append( &path, TARGET() );
+    StatePath_append( &path, targetParent );
     
     // (e) Handle pitcher == target's parent parent ... hierarchy.
     State next = State_invoke( targetParent, SM_INQUIRE );
@@ -270,29 +515,29 @@ bool StateMachine_dispatch(StateMachine self, Signal e)
         if ( EQUAL( next, PITCHER() ) )
         {
             SM_TRACE( "StateMachine handled case (e)" );
-            StateMachine_retraceEntryPath( self, trace );
+            StateMachine_retraceEntryPath( self, &path, 0 );
             StateMachine_init( self, TARGET() );
-            return true;
+            return 'e';
         }
-        APPEND( trace, next );
+        StatePath_append( &path, next );
         next = State_invoke( next, SM_INQUIRE );
     }
-    APPEND( trace, &topState );
+    StatePath_append( &path, &topState );
     
     // The remaining cases impose EXIT of pitcher.
     State_invoke( PITCHER(), SM_EXIT );
     
     // (f) Handle pitcher's parent == target's parent parent ... hierarchy.
-    unsigned int pos = deque_contains( trace, pitcherParent );
+    StatePath_index( &path );
+    unsigned int pos = StatePath_find( &path, pitcherParent );
     if ( pos > 0 )
     {
         // Found Least Base Ancestor @ pos.
-        // Erase it and its ancestors because ENTRY on these is not correct.
+        // Skip it and its ancestors because ENTRY on these is not correct.
         SM_TRACE( "StateMachine handled case (f)" );
-        deque_popnleft( trace, pos );
-        StateMachine_retraceEntryPath( self, trace );
+        StateMachine_retraceEntryPath( self, &path, pos );
         StateMachine_init( self, TARGET() );
-        return true;
+        return 'f';
     }
     
     // (g) Handle pitcher's parent parent ... hierarchy for each target.
@@ -300,17 +545,16 @@ bool StateMachine_dispatch(StateMachine self, Signal e)
     next = pitcherParent;
     while ( search )
     {
-        pos = deque_contains( trace, next );
+        pos = StatePath_find( &path, next );
         if ( pos > 0 )
         {
             // Found Least Base Ancestor @ pos.
-            // Erase it and its ancestors because ENTRY on these
+            // Skip it and its ancestors because ENTRY on these
             // is not correct.
             SM_TRACE( "StateMachine handled case (g)" );
-            deque_popnleft( trace, pos );
-            StateMachine_retraceEntryPath( self, trace );
+            StateMachine_retraceEntryPath( self, &path, pos );
             StateMachine_init( self, TARGET() );
-            return true;
+            return 'g';
         }
         
         if ( NEQUAL( next, &topState ) )
@@ -325,7 +569,7 @@ bool StateMachine_dispatch(StateMachine self, Signal e)
     }
     
     assert( false && "Impossible StateMachine transition case" );
-    return false;
+    return 0;
 }
 
 //------------------------------------------------------------------------------
@@ -362,6 +606,17 @@ State StateMachine_handled(OWNER owner, Signal e)
 
 //------------------------------------------------------------------------------
 
+#if SM_BINARY_TRACE
+static uint16_t StateMachine_traceId(State state)
+{
+   // States are told apart by their handler, see State_isEqual().
+   uint32_t hash = (uint32_t)( (uintptr_t)state->stateFcn_ * 0x9E3779B1u );
+   return SM_TRACE_HASHED( hash );
+}
+#endif /* SM_BINARY_TRACE */
+
+//------------------------------------------------------------------------------
+
 static void StateMachine_setCurrent(StateMachine self, State const current)
 {
    SM_TRACE( "StateMachine_setCurrent( State current )" );
@@ -421,6 +676,40 @@ bool StateMachine_findPitcher( StateMachine self, Signal e )
 
 //------------------------------------------------------------------------------
 
+bool StateMachine_rejects( StateMachine self, Signal e )
+{
+   State state = CURRENT();
+
+   if ( e >= SM_SIGNAL_MASK_BITS )
+   {
+      return false;
+   }
+
+   if ( state->reach_ == 0 )
+   {
+      // Fold the published signals of the state and its superstates, all
+      // signals if any of them does not publish.
+      SmSignalMask reach = 0;
+      State        next  = state;
+
+      while ( NEQUAL( next, &topState ) )
+      {
+         if ( next->signals_ == 0 )
+         {
+            reach = ~(SmSignalMask)0;
+            break;
+         }
+         reach |= next->signals_;
+         next = State_invoke( next, SM_INQUIRE );
+      }
+      state->reach_ = reach | SM_SIGNAL( SM_INIT );
+   }
+
+   return ( state->reach_ & SM_SIGNAL( e ) ) == 0;
+}
+
+//------------------------------------------------------------------------------
+
 void StateMachine_exitDownToPitcher(StateMachine self)
 {
    SM_TRACE( "StateMachine_exitDownToPitcher" );
@@ -450,14 +739,16 @@ void StateMachine_exitDownToPitcher(StateMachine self)
 
 //------------------------------------------------------------------------------
 
-void StateMachine_retraceEntryPath( StateMachine self, Deque trace )
+void StateMachine_retraceEntryPath( StateMachine     self,
+                                    StatePath const* path,
+                                    uint32_t         skip )
 {
     SM_TRACE( "StateMachine_retraceEntryPath" );
 
-    State state = 0;
-    while ( (state = deque_popleft( trace )) )
+    uint32_t i = path->count - skip;
+    while ( i-- > 0 )
     {
-        State_invoke( state, SM_ENTRY );
+        State_invoke( path->states[ i ], SM_ENTRY );
     }
 }
 
@@ -477,6 +768,63 @@ void StateMachine_init( StateMachine self, State state )
       next = CURRENT();
       State_invoke( next, SM_ENTRY );
    }
+
+   if ( StateMachine_claim( self, CURRENT() )->ancestors_ == 0 )
+   {
+      StateMachine_number( self, CURRENT() );
+   }
+}
+
+//------------------------------------------------------------------------------
+
+void StateMachine_number( StateMachine self, State state )
+{
+   SM_TRACE( "StateMachine_number" );
+
+   uint64_t ancestors = 1 | (uint64_t)1 << 63;
+   State    next      = state;
+
+   while ( NEQUAL( next, &topState ) )
+   {
+      StateMachine_claim( self, next );
+      if ( next->bit_ == 0 && self->numbered_ < 62 )
+      {
+         next->bit_ = ++self->numbered_;
+      }
+      ancestors = next->bit_ != 0 ? ancestors | (uint64_t)1 << next->bit_
+                                  : ancestors & ~(uint64_t)1;
+      next = State_invoke( next, SM_INQUIRE );
+   }
+
+   state->ancestors_ = ancestors;
+}
+
+//------------------------------------------------------------------------------
+
+State StateMachine_claim( StateMachine self, State state )
+{
+   if ( state->numbering_ != self->numbering_ )
+   {
+      state->numbering_ = self->numbering_;
+      state->ancestors_ = 0;
+      state->bit_       = 0;
+   }
+   return state;
+}
+
+//------------------------------------------------------------------------------
+
+uint32_t StateMachine_nextNumbering( void )
+{
+   // Machines created at once by two threads may share one, which is
+   // harmless since they do not share states. 0 is that of no machine.
+   static uint32_t numberings = 0;
+
+   if ( ++numberings == 0 )
+   {
+      ++numberings;
+   }
+   return numberings;
 }
 
 //==============================================================================
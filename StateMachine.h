@@ -11,7 +11,18 @@
 //==============================================================================
 
 // ANSI/STL
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
 #include <stack>
+#include <vector>
+
+// Base
+#include "SmTimer.h"
+#include "SmTrace.h"
 
 //==============================================================================
 namespace Base {
@@ -34,6 +45,42 @@ namespace Base {
 #   define SM_TRACE( X ) LOG( DEBUG ) << X
 #endif /* SM_TRACE */
 
+// SM_BINARY_TRACE, see SmTrace.h, records dispatch without formatting.
+
+
+/// Number of resolved transitions cached per machine definition and thread.
+/// Shall be a power of two.
+#if !defined ( SM_TRANSITION_CACHE_SIZE )
+#   define SM_TRANSITION_CACHE_SIZE 64
+#endif /* SM_TRANSITION_CACHE_SIZE */
+
+/// Define this to resolve every transition through INQUIRE, e.g. for 
+/// machines whose state hierarchy changes at runtime.
+//#define SM_NO_TRANSITION_CACHE
+
+/// Number of (state, signal) pairs whose pitcher is memoized per machine
+/// definition and thread, see SmPitcherCache. Shall be a power of two.
+#if !defined ( SM_PITCHER_CACHE_SIZE )
+#   define SM_PITCHER_CACHE_SIZE 256
+#endif /* SM_PITCHER_CACHE_SIZE */
+
+/// Number of states per machine definition whose handler invocations are
+/// counted one by one, see StateMachine::metrics(). Shall be a power of two.
+#if !defined ( SM_METRICS_STATES )
+#   define SM_METRICS_STATES 64
+#endif /* SM_METRICS_STATES */
+
+/// Define this to compile the StateMachine counters out.
+//#define SM_NO_METRICS
+
+/// Histories and armed timers kept by an SmImage, see StateMachine::save().
+#if !defined ( SM_IMAGE_HISTORIES )
+#   define SM_IMAGE_HISTORIES 4
+#endif /* SM_IMAGE_HISTORIES */
+
+#if !defined ( SM_IMAGE_TIMERS )
+#   define SM_IMAGE_TIMERS 4
+#endif /* SM_IMAGE_TIMERS */
 
 #if !defined ( SM_LACKS_INCLASS_MEMBER_INITIALIZATION )
 #  define SM_STATIC_CONSTANT( type, assignment ) static const type assignment
@@ -43,6 +90,9 @@ namespace Base {
 
 //==============================================================================
 
+// Forward declaration, see SmEventPool.h.
+template < class T, std::size_t SIZE > class SmEventPool;
+
 /**
  * The base class of any StateMachine event.
  * This class is targeted to be used togheter with
@@ -55,11 +105,37 @@ public:
     typedef unsigned short Signal;
     
     /// Constructor.
-    SmEvent( Signal const& s, T* p = 0 ) : ptr_( p ), signal_( s ) {}
+    SmEvent( Signal const& s, T* p = 0 )
+        : ptr_( p ), release_( 0 ), signal_( s ) {}
+
+    /// Copy constructor. The copy is not pooled.
+    SmEvent( SmEvent const& other )
+        : ptr_( other.ptr_ ), release_( 0 ), signal_( other.signal_ ) {}
+
+    /// Assignment operator. Whether pooled is kept.
+    SmEvent& operator=( SmEvent const& other )
+    {
+        ptr_    = other.ptr_;
+        signal_ = other.signal_;
+        return *this;
+    }
 
     /// Destructor.
     ~SmEvent() {}
 
+    /// True if taken from an SmEventPool.
+    bool pooled() const { return release_ != 0; }
+
+    /// Return a pooled event to its pool, see SmEventPool, else nothing.
+    /// Called by dispatch once the event is dispatched.
+    void release()
+    {
+        if ( release_ )
+        {
+            release_( this );
+        }
+    }
+
     /// User shall start numering his signals with USER_START.
     SM_STATIC_CONSTANT( Signal, USER_START = 3 );
 
@@ -73,12 +149,67 @@ public:
     T* get() const { return ptr_; }
     
 private:
+    template < class, std::size_t > friend class SmEventPool;
+
     T*     ptr_;
+
+    /// Set if pooled.
+    void ( *release_ )( SmEvent* );
+
     Signal signal_;    
 };
 
 //==============================================================================
 
+/// Kinds of signal that a state handler is invoked with. The first three
+/// equal the standard signals of StateMachine.
+enum SmSignalKind
+{
+    SM_KIND_INIT,
+    SM_KIND_ENTRY,
+    SM_KIND_EXIT,
+    SM_KIND_INQUIRE,
+    SM_KIND_USER,
+    SM_SIGNAL_KINDS
+};
+
+/**
+ * Counter incremented by one thread and read by any. The increment is a
+ * relaxed load and store, no read-modify-write, so it costs as much as a
+ * plain counter.
+ */
+class SmCounter
+{
+public:
+    /// Constructor.
+    SmCounter() : value_( 0 ) {}
+
+    /// Count one. Owning thread only.
+    void increment( unsigned long n = 1 )
+    {
+        value_.store( value_.load( std::memory_order_relaxed ) + n,
+                      std::memory_order_relaxed );
+    }
+
+    /// The count, possibly a little behind. Any thread.
+    unsigned long get() const
+    {
+        return value_.load( std::memory_order_relaxed );
+    }
+
+private:
+    std::atomic< unsigned long > value_;
+};
+
+//==============================================================================
+
+/// Identity of a state in a declared hierarchy (see SmHierarchy).
+typedef unsigned short SmStateId;
+
+/// SM_TOP_ID is the parent of the outermost states.
+/// SM_NO_ID is the id of a state that is not declared.
+enum SmStateIds { SM_TOP_ID = 0xFFFE, SM_NO_ID = 0xFFFF };
+
 // Forward declaration
 template < class OWNER, class T = int > class StatePtr; 
 
@@ -87,6 +218,7 @@ template < class OWNER, class T >
 class StatePtr
 {
     typedef SmEvent< T > UserEvent;
+    typedef typename UserEvent::Signal Signal;
     
 public:
     /// User shall start numering his signals with USER_START.
@@ -96,24 +228,36 @@ public:
     typedef StatePtr ( OWNER::* State )( SmEvent< T > const* );
  
     /// Constructor.
-    explicit StatePtr( State state = 0 ) : owner_( 0 )
-                                         , state_( state ) 
+    explicit StatePtr( State state = 0, SmStateId id = SM_NO_ID ) 
+        : state_( state )
+        , owner_( 0 )
+        , id_( id )
     {}
     
     /// This class is not to be inherited from even though the destructor
     /// is defined in the public area.
     ~StatePtr() {}
 
+    /// Constructor, see init().
+    StatePtr( OWNER* owner, State state, SmStateId id )
+        : state_( state )
+        , owner_( owner )
+        , id_( id )
+    {}
+
     /// Initializer. Object takes ownership of load.
-    void init( OWNER* owner, State state ) 
+    /// id: the state's index in SmHierarchy< OWNER, T >, if declared.
+    void init( OWNER* owner, State state, SmStateId id = SM_NO_ID ) 
     {
         owner_ = owner;
         state_ = state;
+        id_    = id;
     }
         
     /// Copy constructor.
-    StatePtr( StatePtr const& other ) : owner_( other.owner_ )
-                                      , state_( other.state_ ) 
+    StatePtr( StatePtr const& other ) : state_( other.state_ )
+                                      , owner_( other.owner_ )
+                                      , id_( other.id_ )
     {}		
 
     /// Utility swap method.
@@ -121,6 +265,7 @@ public:
     {
         std::swap( owner_, other.owner_ );
         std::swap( state_, other.state_ );
+        std::swap( id_,    other.id_ );
     }
         
     /// Assignment operator.
@@ -132,7 +277,10 @@ public:
     }
 
     /// Conversion operator to State.
-    operator State() { return state_; }
+    operator State() const { return state_; }
+
+    /// Declared id accessor, SM_NO_ID if not declared.
+    SmStateId id() const { return id_; }
 
     /// Equality operator.
     bool operator==( StatePtr const& rhs )
@@ -155,14 +303,700 @@ public:
 private:
     State               state_;
     OWNER*              owner_;
+    SmStateId           id_;
 };
 
 //==============================================================================
 
+/// Set of signals, bit s for signal s. Bit INIT marks a published set,
+/// see smSignals().
+typedef unsigned long long SmSignalMask;
+
+/// Signals that fit in an SmSignalMask.
+enum { SM_SIGNAL_MASK_BITS = 64 };
+
+/// The published set of no signal.
+constexpr SmSignalMask smSignals() { return 1; }
+
+/// The published set of given signals. Signals from SM_SIGNAL_MASK_BITS
+/// and up are never rejected, hence need not be given.
+template < typename... SIGNALS >
+constexpr SmSignalMask smSignals( unsigned signal, SIGNALS... signals )
+{
+    return ( signal < SM_SIGNAL_MASK_BITS ? SmSignalMask( 1 ) << signal : 0 ) |
+           smSignals( signals... );
+}
+
+/// One entry of a declared state hierarchy.
+template < class OWNER, class T = int >
+struct SmStateDecl
+{
+    /// The state handler.
+    typename StatePtr< OWNER, T >::State state;
+
+    /// Id of the parent state, SM_TOP_ID for the outermost states.
+    SmStateId parent;
+
+    /// The user signals that the state handles, by smSignals(), or 0 if
+    /// not published. A state that publishes its signals shall return its
+    /// parent for all other user signals.
+    SmSignalMask signals;
+};
+
 /**
- * A Hierarchical State Machine framework.
+ * Compile-time declaration of the state hierarchy of StateMachine< OWNER, T >.
+ * The default is an undeclared hierarchy, i.e. the parent of a state is 
+ * found by INQUIRE. Specialize it to let the machine look parents up instead.
+ * The id of a state is its index in states, and shall be given to 
+ * StatePtr::init(), or the constructor, wherever the state is named; it is
+ * not looked up, and a declared state without it is asserted. Every parent
+ * shall precede its children.
+ *
+ *   template <>
+ *   struct SmHierarchy< Tester >
+ *   {
+ *       SM_STATIC_CONSTANT( bool, declared = true );
+ *       static constexpr SmStateDecl< Tester > states[] = 
+ *       {
+ *           { &Tester::s0,  SM_TOP_ID },  // S0
+ *           { &Tester::s1,  S0 },         // S1
+ *           { &Tester::s11, S1, smSignals( SIG_A, SIG_B ) }  // S11
+ *       };
+ *   };
+ *
+ * A dispatched signal that neither the current state nor any of its
+ * superstates handles, by their published signals, is rejected without
+ * invoking any state. A state that does not publish may handle any.
+ *
+ * Before C++17 states shall also be defined in one translation unit:
+ *
+ *   constexpr SmStateDecl< Tester > SmHierarchy< Tester >::states[];
+ */
+template < class OWNER, class T = int >
+struct SmHierarchy
+{
+    SM_STATIC_CONSTANT( bool, declared = false );
+    static constexpr SmStateDecl< OWNER, T > states[ 1 ] = { { 0, SM_TOP_ID, 0 } };
+};
+
+template < class OWNER, class T >
+constexpr SmStateDecl< OWNER, T > SmHierarchy< OWNER, T >::states[ 1 ];
+
+/// Hash of the declared hierarchy of OWNER, its states and their parents,
+/// which a snapshot or an SmImage shall be restored into. Handlers are not part of it
+/// since their addresses differ from one build, or run, to the next.
+template < class OWNER, class T >
+uint64_t smFingerprint()
+{
+    typedef SmHierarchy< OWNER, T > Hierarchy;
+
+    enum { SIZE = sizeof( Hierarchy::states ) / sizeof( Hierarchy::states[ 0 ] ) };
+
+    // FNV-1a.
+    uint64_t hash = 14695981039346656037ull;
+    hash = ( hash ^ SIZE ) * 1099511628211ull;
+    for ( unsigned id = 0; id < SIZE; ++id )
+    {
+        hash = ( hash ^ Hierarchy::states[ id ].parent ) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * Opt-in jump table execution of StateMachine< OWNER, T >, for machines
+ * with a declared hierarchy (see SmHierarchy) whose transitions are fixed.
+ * The outcome of the first dispatch of a signal in a leaf state is kept in
+ * a flat table indexed by [leaf][signal]: the state that handled it, the
+ * target and the EXIT/ENTRY sequence. Later dispatches of the signal in
+ * that leaf invoke the recorded state right away and run the sequence.
+ *
+ * Fixed means that the states below the recorded one never handle the
+ * signal in that leaf, and that a signal that no state handled is never
+ * handled there. The recorded state may still decline the signal or pick
+ * another target, e.g. by a guard; the table entry is then updated.
+ *
+ *   template <>
+ *   struct SmJumpTable< Tester >
+ *   {
+ *       SM_STATIC_CONSTANT( unsigned, signals = SIG_LAST );
+ *   };
+ *
+ * Signals from signals and up are dispatched as usual. The table is kept
+ * per thread, in thread local storage of states x signals entries rather
+ * than on the heap, and dropped by StateMachine::invalidateTransitionCache().
+ *
+ * What it saves is the search for the pitcher and, for a signal that no
+ * state handles, the dispatch as a whole. A signal handled by the leaf
+ * itself, with a transition whose plan is cached anyway, costs a few ns
+ * more or less than without the table; opt in for machines that see many
+ * signals they ignore, or that handle them well above the leaf.
+ */
+template < class OWNER, class T = int >
+struct SmJumpTable
+{
+    SM_STATIC_CONSTANT( unsigned, signals = 0 );
+};
+
+/**
+ * Opt-in memo of the pitcher, the state that handles a signal, per current
+ * state and signal of StateMachine< OWNER, T >. The hierarchy need not be
+ * declared. Later dispatches of the signal in that state invoke the
+ * memoized pitcher right away instead of every state up to it.
+ *
+ * The contract is that of SmJumpTable: the states below the memoized one
+ * never handle the signal in that state, and a signal that no state
+ * handled is never handled there. A memoized pitcher that declines the
+ * signal, e.g. by a guard, is replaced by the one found above it. Handlers
+ * whose choice depends on guards further down shall not be memoized, or
+ * StateMachine::invalidateTransitionCache() be called when a guard changes.
+ *
+ *   template <>
+ *   struct SmPitcherCache< Tester >
+ *   {
+ *       SM_STATIC_CONSTANT( bool, enabled = true );
+ *   };
+ *
+ * The memo is a direct mapped table of SM_PITCHER_CACHE_SIZE pairs, shared
+ * by all machines of the definition in a thread. SmJumpTable, if any,
+ * takes precedence for the signals that it covers.
  */
 template < class OWNER, class T = int >
+struct SmPitcherCache
+{
+    SM_STATIC_CONSTANT( bool, enabled = false );
+};
+
+/**
+ * Opt-in compact layout of StateMachine< OWNER, T >, for machines that are
+ * kept by the million. A machine then holds the declared id of its current
+ * state only, 2 bytes; states are looked up in SmHierarchy, the owner is
+ * the machine itself and the pitcher and target of an ongoing dispatch
+ * are kept per thread.
+ *
+ *   template <>
+ *   struct SmCompact< Session >
+ *   {
+ *       SM_STATIC_CONSTANT( bool, enabled = true );
+ *   };
+ *
+ * The hierarchy shall be declared, and declare every state that the
+ * machine enters. OWNER shall derive publicly from the StateMachine and
+ * be given to open() as owner. Since it decides the layout, specialize it
+ * before OWNER is defined. The layout has no timers, see arm().
+ */
+template < class OWNER, class T = int >
+struct SmCompact
+{
+    SM_STATIC_CONSTANT( bool, enabled = false );
+};
+
+/**
+ * Opt-in orthogonal regions of StateMachine< OWNER, T >: the machine is in
+ * one state of each region at a time, see SmOrthogonal.
+ *
+ *   template <>
+ *   struct SmRegions< Link >
+ *   {
+ *       SM_STATIC_CONSTANT( unsigned, regions = 3 );
+ *       SM_STATIC_CONSTANT( bool, independent = true );
+ *   };
+ *
+ * Region r is the r:th outermost state declared in the hierarchy, and its
+ * substates. Regions are independent if no handler of one touches what
+ * those of another do, and may then be dispatched to in parallel. Needs
+ * the SmCompact layout and, as that, is specialized before OWNER is
+ * defined.
+ */
+template < class OWNER, class T = int >
+struct SmRegions
+{
+    SM_STATIC_CONSTANT( unsigned, regions = 0 );
+    SM_STATIC_CONSTANT( bool, independent = false );
+};
+
+/**
+ * A timeout of a StateMachine< OWNER, T >, bound to one of its states,
+ * see StateMachine::arm(). Typically a member of OWNER. Disarmed when
+ * destroyed.
+ */
+template < class OWNER, class T = int >
+class SmTimer : private SmTimerNode
+{
+public:
+    /// Constructor.
+    SmTimer() : owner_( 0 ), deliver_( 0 ), head_( 0 ),
+                prev_( 0 ), next_( 0 ), event_( 0 ) {}
+
+    /// Dtor.
+    ~SmTimer() { disarm(); }
+
+    using SmTimerNode::armed;
+    using SmTimerNode::deadline;
+
+private:
+    template < class, class, unsigned > friend class StateMachine;
+
+    /// Leave the wheel and the armed timers of the machine.
+    void disarm()
+    {
+        cancel();
+        if ( head_ )
+        {
+            *( prev_ ? &prev_->next_ : head_ ) = next_;
+            if ( next_ )
+            {
+                next_->prev_ = prev_;
+            }
+            head_ = 0;
+        }
+    }
+
+    /// Dispatch the timeout event.
+    virtual void expire()
+    {
+        disarm();
+        deliver_( owner_, &event_ );
+    }
+
+    OWNER*           owner_;
+    bool          ( *deliver_ )( OWNER*, SmEvent< T >* );
+
+    /// First of the armed timers of the machine, 0 if not armed.
+    SmTimer**        head_;
+
+    /// The state that it is bound to, its id included.
+    StatePtr< OWNER, T > state_;
+
+    SmTimer*         prev_;
+    SmTimer*         next_;
+    SmEvent< T >     event_;
+};
+
+/// What an SmHistory keeps of the states last active in its state.
+enum SmHistoryKind
+{
+    SM_SHALLOW_HISTORY, ///< The substate, entered by its initial transition.
+    SM_DEEP_HISTORY     ///< The innermost state, entered as it was.
+};
+
+/**
+ * The history of a state of a StateMachine< OWNER, T >, recorded each
+ * time the state is exited, see StateMachine::remember(). Typically a
+ * member of OWNER. A transition to it (see StateMachine::transition())
+ * enters the state last active in the state, or the state itself if none
+ * is recorded. Forgotten by the machine when destroyed.
+ */
+template < class OWNER, class T = int >
+class SmHistory
+{
+public:
+    /// Constructor.
+    SmHistory() : head_( 0 ), prev_( 0 ), next_( 0 ),
+                  kind_( SM_SHALLOW_HISTORY ) {}
+
+    /// Dtor.
+    ~SmHistory() { unbind(); }
+
+    /// True if a state is recorded.
+    bool recorded() const
+    {
+        return typename StatePtr< OWNER, T >::State( last_ ) != 0;
+    }
+
+    /// Forget the state recorded.
+    void clear() { last_ = StatePtr< OWNER, T >(); }
+
+private:
+    template < class, class, unsigned > friend class StateMachine;
+
+    SmHistory( SmHistory const& );
+    SmHistory& operator=( SmHistory const& );
+
+    /// Leave the histories of the machine.
+    void unbind()
+    {
+        if ( head_ )
+        {
+            *( prev_ ? &prev_->next_ : head_ ) = next_;
+            if ( next_ )
+            {
+                next_->prev_ = prev_;
+            }
+            head_ = 0;
+        }
+    }
+
+    /// First of the histories of the machine, 0 if not bound.
+    SmHistory**          head_;
+    SmHistory*           prev_;
+    SmHistory*           next_;
+
+    /// The state whose history it is, and the state recorded.
+    StatePtr< OWNER, T > state_;
+    StatePtr< OWNER, T > last_;
+    SmHistoryKind        kind_;
+};
+
+/**
+ * The active configuration of a StateMachine, by declared ids: the current
+ * state, the states recorded by its histories and its armed timers. Plain
+ * data of a fixed size, to be written as is. See StateMachine::save().
+ */
+struct SmImage
+{
+    struct History
+    {
+        /// The state whose history it is, and the state recorded, SM_NO_ID
+        /// if none.
+        SmStateId state;
+        SmStateId last;
+    };
+
+    struct Timer
+    {
+        /// The state that it is bound to, and the signal of its event.
+        SmStateId      state;
+        unsigned short signal;
+
+        /// Ticks left until it expires.
+        uint64_t       ticks;
+    };
+
+    /// Of the declared hierarchy, see smFingerprint().
+    uint64_t  fingerprint;
+
+    SmStateId current;
+    uint8_t   histories;
+    uint8_t   timers;
+    History   history[ SM_IMAGE_HISTORIES ];
+    Timer     timer[ SM_IMAGE_TIMERS ];
+};
+
+/// Per machine data of StateMachine< OWNER, T >, see SmCompact and
+/// SmRegions.
+template < class OWNER,
+           class T,
+           bool COMPACT     = SmCompact< OWNER, T >::enabled,
+           unsigned REGIONS = SmRegions< OWNER, T >::regions >
+class SmStorage
+{
+public:
+    typedef StatePtr< OWNER, T > Slot;
+
+    SmStorage() : owner_( 0 ), timers_( 0 ), histories_( 0 ) {}
+
+    Slot& current() { return current_; }
+    Slot& pitcher() { return pitcher_; }
+    Slot& target()  { return target_; }
+
+    Slot const& current() const { return current_; }
+    Slot const& pitcher() const { return pitcher_; }
+    Slot const& target()  const { return target_; }
+
+    /// Keeps the pitcher and target of a dispatch apart from those of
+    /// a dispatch that it is nested in.
+    struct Scope
+    {
+        explicit Scope( SmStorage& ) {}
+    };
+
+    OWNER* owner_;
+
+    /// The armed timers, see StateMachine::arm().
+    SmTimer< OWNER, T >* timers_;
+
+    /// The histories kept, see StateMachine::remember().
+    SmHistory< OWNER, T >* histories_;
+
+private:
+    Slot current_;
+    Slot pitcher_;
+    Slot target_;
+};
+
+/// The compact layout: states are declared ids, the pitcher and target
+/// are kept per thread, and the owner is not kept.
+template < class OWNER, class T >
+class SmStorage< OWNER, T, true, 0 >
+{
+public:
+    typedef SmStateId Slot;
+
+    SmStorage() : current_( SM_TOP_ID ) {}
+
+private:
+    /// The pitcher and target of the ongoing dispatch in the thread. Plain
+    /// data, so that the thread_local needs no guard.
+    struct Transient
+    {
+        SmStateId pitcher;
+        SmStateId target;
+    };
+
+    static Transient& transient()
+    {
+        static thread_local Transient ids;
+        return ids;
+    }
+
+public:
+    Slot& current() { return current_; }
+    Slot& pitcher() { return transient().pitcher; }
+    Slot& target()  { return transient().target; }
+
+    Slot const& current() const { return current_; }
+    Slot const& pitcher() const { return transient().pitcher; }
+    Slot const& target()  const { return transient().target; }
+
+    /// Saves those of the dispatch that it is nested in, if any, and
+    /// restores them when it ends.
+    class Scope
+    {
+    public:
+        explicit Scope( SmStorage& ) : saved_( transient() ) {}
+        ~Scope() { transient() = saved_; }
+
+    private:
+        Scope( Scope const& );
+        Scope& operator=( Scope const& );
+
+        Transient saved_;
+    };
+
+private:
+    Slot current_;
+};
+
+/// The compact layout with regions: the current state of each region, and
+/// the region dispatched to kept per thread along with the pitcher and
+/// target.
+template < class OWNER, class T, unsigned REGIONS >
+class SmStorage< OWNER, T, true, REGIONS >
+{
+public:
+    typedef SmStateId Slot;
+
+    SmStorage()
+    {
+        for ( unsigned r = 0; r < REGIONS; ++r )
+        {
+            current_[ r ] = SM_TOP_ID;
+        }
+    }
+
+private:
+    struct Transient
+    {
+        SmStateId pitcher;
+        SmStateId target;
+        unsigned  region;
+    };
+
+    static Transient& transient()
+    {
+        static thread_local Transient ids;
+        return ids;
+    }
+
+public:
+    Slot& current() { return current_[ transient().region ]; }
+    Slot& pitcher() { return transient().pitcher; }
+    Slot& target()  { return transient().target; }
+
+    Slot const& current() const { return current_[ transient().region ]; }
+    Slot const& pitcher() const { return transient().pitcher; }
+    Slot const& target()  const { return transient().target; }
+
+    /// The region that the thread dispatches to.
+    static unsigned& region() { return transient().region; }
+
+    /// The current state of given region.
+    Slot&       current( unsigned region )       { return current_[ region ]; }
+    Slot const& current( unsigned region ) const { return current_[ region ]; }
+
+    /// As that of the compact layout, the region included.
+    class Scope
+    {
+    public:
+        explicit Scope( SmStorage& ) : saved_( transient() ) {}
+        ~Scope() { transient() = saved_; }
+
+    private:
+        Scope( Scope const& );
+        Scope& operator=( Scope const& );
+
+        Transient saved_;
+    };
+
+private:
+    Slot current_[ REGIONS ];
+};
+
+/// The greater of two depths.
+constexpr unsigned smDeeper( unsigned a, unsigned b )
+{
+    return a > b ? a : b;
+}
+
+/// Number of states between id and top, 1 for the outermost states.
+template < class OWNER, class T, std::size_t N >
+constexpr unsigned smDepth( SmStateDecl< OWNER, T > const (&states)[ N ],
+                            SmStateId id )
+{
+    return id == SM_TOP_ID ? 0 : 1 + smDepth( states, states[ id ].parent );
+}
+
+/// Depth of the deepest of count states from first on, which MAX_DEPTH of
+/// the machine shall cover. Halves the range to keep the recursion shallow.
+template < class OWNER, class T, std::size_t N >
+constexpr unsigned smMaxDepth( SmStateDecl< OWNER, T > const (&states)[ N ],
+                               std::size_t first = 0,
+                               std::size_t count = N )
+{
+    return count == 0 ? 0 :
+           count == 1 ? smDepth( states, SmStateId( first ) ) :
+           smDeeper( smMaxDepth( states, first, count / 2 ),
+                     smMaxDepth( states, first + count / 2, count - count / 2 ) );
+}
+
+/// The ancestor levels above id.
+template < class OWNER, class T, std::size_t N >
+constexpr SmStateId smAncestor( SmStateDecl< OWNER, T > const (&states)[ N ],
+                                SmStateId id,
+                                unsigned  levels )
+{
+    return levels == 0 || id == SM_TOP_ID 
+           ? id 
+           : smAncestor( states, states[ id ].parent, levels - 1 );
+}
+
+/// True if ancestor is id or a superstate of id.
+template < class OWNER, class T, std::size_t N >
+constexpr bool smIsAncestor( SmStateDecl< OWNER, T > const (&states)[ N ],
+                             SmStateId ancestor,
+                             SmStateId id )
+{
+    return ancestor == SM_TOP_ID ||
+           ( smDepth( states, id ) >= smDepth( states, ancestor ) &&
+             smAncestor( states, id, smDepth( states, id ) - 
+                                     smDepth( states, ancestor ) ) == ancestor );
+}
+
+/// Least common ancestor of a and b at the same depth.
+template < class OWNER, class T, std::size_t N >
+constexpr SmStateId smLcaAligned( SmStateDecl< OWNER, T > const (&states)[ N ],
+                                  SmStateId a,
+                                  SmStateId b )
+{
+    return a == b ? a : smLcaAligned( states, states[ a ].parent, 
+                                              states[ b ].parent );
+}
+
+/// Least common ancestor of a and b, a state is its own ancestor.
+template < class OWNER, class T, std::size_t N >
+constexpr SmStateId smLca( SmStateDecl< OWNER, T > const (&states)[ N ],
+                           SmStateId a,
+                           SmStateId b )
+{
+    return smLcaAligned( 
+       states,
+       smAncestor( states, a, smDepth( states, a ) > smDepth( states, b ) 
+                              ? smDepth( states, a ) - smDepth( states, b ) 
+                              : 0 ),
+       smAncestor( states, b, smDepth( states, b ) > smDepth( states, a ) 
+                              ? smDepth( states, b ) - smDepth( states, a ) 
+                              : 0 ) );
+}
+
+//==============================================================================
+
+/**
+ * Fixed capacity sequence stored inline, used for the state paths of a
+ * transition so that dispatch never allocates.
+ */
+template < class E, unsigned N >
+class SmPath
+{
+public:
+    typedef E const* const_iterator;
+
+    /// Constructor.
+    SmPath() : size_( 0 ) {}
+
+    /// Append item. The capacity shall not be exceeded; a hierarchy found
+    /// by INQUIRE deeper than MAX_DEPTH aborts, also without asserts.
+    void push_back( E const& item )
+    {
+        if ( size_ == N )
+        {
+            overflow();
+        }
+        items_[ size_++ ] = item;
+    }
+
+    /// Replace content with the first count items of other, reversed.
+    template < unsigned M >
+    void assign_reverse( SmPath< E, M > const& other, unsigned count )
+    {
+        clear();
+        while ( count > 0 )
+        {
+            push_back( other[ --count ] );
+        }
+    }
+
+    /// Position of item, size() if not found.
+    unsigned find( E const& item ) const
+    {
+        unsigned pos = 0;
+        while ( pos < size_ && !( items_[ pos ] == item ) )
+        {
+            ++pos;
+        }
+        return pos;
+    }
+
+    void resize( unsigned size ) 
+    {
+        if ( size > N )
+        {
+            overflow();
+        }
+        size_ = size;
+    }
+
+    void clear() { size_ = 0; }
+
+    unsigned size() const { return size_; }
+
+    E&       operator[]( unsigned pos )       { return items_[ pos ]; }
+    E const& operator[]( unsigned pos ) const { return items_[ pos ]; }
+
+    const_iterator begin() const { return items_; }
+    const_iterator end()   const { return items_ + size_; }
+
+private:
+    static void overflow()
+    {
+        assert( !"SmPath overflow, increase MAX_DEPTH" );
+        std::abort();
+    }
+
+    E        items_[ N ];
+    unsigned size_;
+};
+
+//==============================================================================
+
+// Forward declarations, see SmFamily.h and SmOrthogonal.h.
+template < class OWNER, class T, unsigned MAX_DEPTH > class SmFamily;
+template < class OWNER, class T, unsigned MAX_DEPTH > class SmOrthogonal;
+
+/**
+ * A Hierarchical State Machine framework.
+ * MAX_DEPTH is the maximum number of nested states, top not included.
+ */
+template < class OWNER, class T = int, unsigned MAX_DEPTH = 16 >
 class StateMachine
 {
     typedef SmEvent< T >         UserEvent;
@@ -173,18 +1007,90 @@ public:
     /// 2 if user is in given state,
     /// 1 if in substate,
     /// 0 otherwise.
+    /// Declared states are checked by their depth first intervals, without
+    /// invoking any state.
     int isInState( UserState const& state );
 
     /// Current state accessor.
     UserState current() const;
 
+    /// A timeout of this machine, see arm().
+    typedef SmTimer< OWNER, T > Timer;
+
+    /// The history of a state of this machine, see remember().
+    typedef SmHistory< OWNER, T > History;
+
+    /// Keep the active configuration of this machine in image, see
+    /// restore(). The hierarchy shall be declared and declare the states
+    /// involved. Armed timers are kept by the ticks left in wheel, which
+    /// shall be given if any is armed. Returns false, with image not to be
+    /// restored, if the current state is not declared, a timer is armed
+    /// but no wheel given, or the histories or timers do not fit in image.
+    bool save( SmImage& image, SmTimerWheel const* wheel = 0 ) const;
+
+    /// Finds the timer of the owner that is bound to state with signal,
+    /// see restore().
+    typedef Timer* ( *TimerOf )( OWNER*, SmStateId, unsigned short );
+
+    /// Drop all cached transitions and memoized pitchers of this machine
+    /// definition, in all threads. Call when the state hierarchy has been 
+    /// changed at runtime.
+    static void invalidateTransitionCache();
+
+    /// Handler invocations of one state, by SmSignalKind.
+    struct StateMetrics
+    {
+        typename UserState::State state;
+        unsigned long             invocations[ SM_SIGNAL_KINDS ];
+    };
+
+    /// Counters of all machines of this definition, in all threads.
+    struct Metrics
+    {
+        unsigned long dispatches;
+
+        /// Events that no state handled.
+        unsigned long unhandled;
+
+        /// Dispatches by transition case, 'a' .. 'h'.
+        unsigned long cases[ 8 ];
+
+        /// The invoked states, in no particular order. Invocations of
+        /// states beyond SM_METRICS_STATES per thread are summed in an
+        /// entry whose state is 0.
+        std::vector< StateMetrics > states;
+    };
+
+    /// Snapshot of the counters. The counters are never reset; compare
+    /// two snapshots to measure an interval. Any thread.
+    static Metrics metrics();
+
+    /// Turn counting of handler invocations per state on or off, for all
+    /// machines of this definition. It is off by default since it costs
+    /// a few ns per invocation. The other counters are always on.
+    static void countInvocations( bool on );
+
 protected:
     /// Initialze and execute initial transistion.
     void open( OWNER*           owner,
                UserState const& initial,
                UserEvent const* e = 0 );
 
-    /// Dispatch event. Takes take ownership of event.
+    /// Put the machine in the configuration kept in image, instead of
+    /// open(): no state is invoked, ENTRY and INIT included, and the
+    /// states of owner are taken to be as they were when saved. The
+    /// histories shall be remembered already, and the armed timers are
+    /// armed again in wheel, found by timerOf. Returns false, with the
+    /// machine left as it was, if image is not of this hierarchy, an id
+    /// in it is not declared or not where it could have been saved from,
+    /// or a history or timer of it is not found.
+    bool restore( OWNER*             owner,
+                  SmImage const&     image,
+                  SmTimerWheel*      wheel   = 0,
+                  TimerOf            timerOf = 0 );
+
+    /// Dispatch event. Takes take ownership of event: a pooled event
+    /// is released once dispatched, see SmEventPool.
     bool dispatch( UserEvent* e );
    
     /// Call when there is a default initialization state.
@@ -193,6 +1099,37 @@ protected:
     /// Call when a transition shall occur.
     void transition( UserState const& s ) { target( s ); }
 
+    /// Call when a transition to the history of a state shall occur, see
+    /// remember(). Only the states from the least common ancestor down to
+    /// the state recorded are entered; a deep history is not initialized
+    /// again.
+    void transition( History const& history )
+    {
+        target( history.recorded() ? history.last_ : history.state_ );
+    }
+
+    /// Keep the history of state in history from now on: the substate,
+    /// or the innermost state, that is active as state is exited. Not for
+    /// the SmCompact layout.
+    void remember( History&         history,
+                   UserState const& state,
+                   SmHistoryKind    kind = SM_SHALLOW_HISTORY );
+
+    /// Arm timer to dispatch an event of given signal to this machine,
+    /// ticks from now in wheel, for as long as state is not exited. Arm
+    /// it on ENTRY of state, and the timer is cancelled on EXIT without
+    /// further ado. An armed timer is moved. Expiries are dispatched by
+    /// the thread advancing wheel, which shall be the one dispatching
+    /// to this machine. Not for the SmCompact layout.
+    void arm( Timer&                            timer,
+              SmTimerWheel&                     wheel,
+              UserState const&                  state,
+              uint64_t                          ticks,
+              typename UserEvent::Signal const& signal );
+
+    /// Disarm timer, if armed.
+    void cancel( Timer& timer ) { timer.disarm(); }
+
     /// To be returned when there is no parent state.
     UserState topState( UserEvent const* e = 0 ) 
     { 
@@ -235,22 +1172,381 @@ private:
     /// If init returns false, a self transition is invoked.
     void init( UserState const& state );
    
-    /// Trace down to state that possibly handles the given signal.
-    /// Releases the event.
-    bool findPitcher( UserEvent* e );
+    /// Trace down to state that possibly handles the given signal, from
+    /// given state. Releases the event.
+    bool findPitcher( UserEvent* e, UserState const& from );
+
+    /// Handler type of a state.
+    typedef typename UserState::State State;
+
+    /// The declared hierarchy, if any.
+    typedef SmHierarchy< OWNER, T > Hierarchy;
+
+    /// Parent of given state, looked up if declared or else INQUIREd.
+    UserState parentOf( UserState const& state );
+
+    /// Declared id of given state, the one it was given, SM_NO_ID if not
+    /// declared. A declared state shall have its id, which is asserted.
+    SmStateId idOf( UserState const& state ) const;
+
+    /// The declared state of given id.
+    UserState stateOf( SmStateId id ) const;
+
+    /// Per machine data, see SmCompact.
+    typedef SmStorage< OWNER, T > Storage;
+
+    /// The owner given to open(), or the machine itself if compact.
+    OWNER* owner() const { return ownerOf( storage_ ); }
+
+    OWNER* ownerOf( SmStorage< OWNER, T, false > const& storage ) const
+    {
+        return storage.owner_;
+    }
+
+    OWNER* ownerOf( SmStorage< OWNER, T, true > const& ) const
+    {
+        return static_cast< OWNER* >( const_cast< StateMachine* >( this ) );
+    }
+
+    /// Keep the owner given to open().
+    void bind( SmStorage< OWNER, T, false >& storage, OWNER* owner )
+    {
+        storage.owner_ = owner;
+    }
+
+    void bind( SmStorage< OWNER, T, true >&, OWNER* owner )
+    {
+        static_assert( Hierarchy::declared, "SmCompact needs a declared SmHierarchy" );
+        assert( owner == this->owner() && "SmCompact owner shall be the machine" );
+    }
+
+    /// The armed timers, 0 if the layout has none.
+    static Timer** timersOf( SmStorage< OWNER, T, false >& storage )
+    {
+        return &storage.timers_;
+    }
+
+    static Timer** timersOf( SmStorage< OWNER, T, true >& ) { return 0; }
+
+    /// The histories kept, 0 if the layout has none.
+    static History** historiesOf( SmStorage< OWNER, T, false >& storage )
+    {
+        return &storage.histories_;
+    }
+
+    static History** historiesOf( SmStorage< OWNER, T, true >& ) { return 0; }
+
+    /// True if image can be restored into this machine, see restore().
+    bool restorable( OWNER*         owner,
+                     SmImage const& image,
+                     SmTimerWheel*  wheel,
+                     TimerOf        timerOf );
+
+    /// True if id is declared and is ancestor, or one of its substates.
+    static bool declaredIn( SmStateId id, SmStateId ancestor );
+
+    /// Arm the timers kept in image again, see restore(). The compact
+    /// layout has none.
+    void rearm( SmStorage< OWNER, T, false >& storage,
+                SmImage const&                image,
+                SmTimerWheel*                 wheel,
+                TimerOf                       timerOf );
+
+    void rearm( SmStorage< OWNER, T, true >&,
+                SmImage const&,
+                SmTimerWheel*,
+                TimerOf ) {}
+
+    /// Cancel the timers bound to state, which has been exited, and record
+    /// the histories of state.
+    void exited( State state );
+
+    /// Record in history the state that is active in its state.
+    void record( History& history );
+
+    /// Dispatch e to owner, on expiry of a timer.
+    static bool deliver( OWNER* owner, UserEvent* e );
+
+    /// A state in given storage slot.
+    UserState load( UserState const& slot ) const { return slot; }
+    UserState load( SmStateId slot ) const
+    {
+        return slot == SM_TOP_ID
+               ? UserState( &OWNER::topState )
+               : UserState( owner(), Hierarchy::states[ slot ].state, slot );
+    }
+
+    /// Put a state in given storage slot.
+    void store( UserState& slot, UserState const& state ) { slot = state; }
+    void store( SmStateId& slot, UserState const& state );
+
+    /// Used to store state hierarchy in transition.
+    typedef SmPath< State, MAX_DEPTH + 1 > Path;
+
+    /// Declared ids of states in transition.
+    typedef SmPath< SmStateId, MAX_DEPTH + 1 > IdPath;
+
+    /// The EXIT and ENTRY sequence of an external transition, resolved
+    /// once for a (current, pitcher, target) triple.
+    struct TransitionPlan
+    {
+        TransitionPlan() : kind( 0 ), valid( false ), busy( false ) {}
+
+        State current;
+        State pitcher;
+        State target;
+        
+        /// Transition case, 'a' .. 'g'.
+        char  kind;
+        bool  valid;
+
+        /// Set while the plan is being executed.
+        bool  busy;
+
+        /// States to EXIT, innermost first.
+        Path  exits;
+
+        /// States to ENTER, outermost first.
+        Path  entries;
+    };
+
+    /// Direct mapped transition cache. There is one per machine definition
+    /// and thread, hence no locking.
+    struct TransitionCache
+    {
+        TransitionCache() : generation( 0 ) {}
+
+        unsigned       generation;
+        TransitionPlan plans[ SM_TRANSITION_CACHE_SIZE ];
+    };
+
+    /// The cache of the calling thread.
+    static TransitionCache& transitionCache();
+
+    /// Hash of a state handler.
+    static std::size_t hashState( State state );
+
+    /// Lookup (or resolve) the plan of the ongoing transition.
+    /// local: used instead of the cache slot if that one is busy.
+    TransitionPlan& transitionPlan( TransitionPlan& local );
+
+    /// Resolve the ongoing transition by INQUIRE of the states involved.
+    void resolveTransition( TransitionPlan& plan );
+
+    /// Resolve the ongoing transition in the declared hierarchy.
+    /// Returns false if any of the states involved is not declared.
+    bool resolveDeclared( TransitionPlan& plan );
+
+    /// Resolve the transition of pitcher p to target t, in current state c,
+    /// into the declared states to EXIT, innermost first, and to ENTER,
+    /// outermost first. Returns the transition case, 'a' .. 'g'.
+    static char resolveIds( SmStateId c, 
+                            SmStateId p, 
+                            SmStateId t,
+                            IdPath&   exits,
+                            IdPath&   entries );
+
+    /// Jump table options of this machine definition.
+    typedef SmJumpTable< OWNER, T > Jump;
+
+    /// The recorded outcome of a signal in a leaf state, see SmJumpTable.
+    struct JumpEntry
+    {
+        /// SM_NO_ID if not recorded, SM_TOP_ID if not handled.
+        SmStateId      pitcher;
+
+        /// SM_TOP_ID for an internal transition.
+        SmStateId      target;
+
+        /// Transition case, 'a' .. 'h'.
+        char           kind;
+
+        /// Set while the sequence is being executed.
+        bool           busy;
+
+        /// The states to EXIT, innermost first, and to ENTER, outermost
+        /// first.
+        unsigned short exitCount;
+        unsigned short entryCount;
+        SmStateId      exits[ MAX_DEPTH + 1 ];
+        SmStateId      entries[ MAX_DEPTH + 1 ];
+    };
+
+    /// The [leaf][signal] table of one machine definition and thread.
+    /// Of a fixed size, so that dispatch never allocates it. Plain data,
+    /// zeroed, so that the thread_local needs no guard; no generation
+    /// matches a zeroed table, see jumpEntry().
+    struct JumpTable
+    {
+        enum { SIZE = Jump::signals == 0 ? 1 :
+                      sizeof( Hierarchy::states ) / sizeof( Hierarchy::states[ 0 ] ) *
+                      Jump::signals };
+
+        unsigned  generation;
+        JumpEntry entries[ SIZE ];
+    };
+
+    /// The table of the calling thread.
+    static JumpTable& jumpTable();
+
+    /// Entry of the current state and the signal of e, 0 if there is no
+    /// jump table for them.
+    JumpEntry* jumpEntry( UserEvent const* e );
+
+    /// findPitcher(), starting in the state recorded in entry.
+    bool jumpPitcher( JumpEntry& entry, UserEvent* e );
+
+    /// EXIT and ENTER as recorded in entry, after recording the ongoing 
+    /// transition if it differs. Returns the transition case, or 0 having
+    /// done nothing if any of the states involved is not declared.
+    char jump( JumpEntry& entry );
+
+    /// Depth first numbering of the declared states, [ first, last ) of
+    /// a state being the numbers of it and its substates.
+    struct Intervals
+    {
+        Intervals();
+
+        SmStateId first[ sizeof( Hierarchy::states ) / 
+                         sizeof( Hierarchy::states[ 0 ] ) ];
+        SmStateId last[ sizeof( Hierarchy::states ) / 
+                        sizeof( Hierarchy::states[ 0 ] ) ];
+    };
+
+    /// Pitcher memo options of this machine definition.
+    typedef SmPitcherCache< OWNER, T > Pitchers;
+
+    /// The memoized pitcher of a signal in a current state.
+    struct PitcherSlot
+    {
+        PitcherSlot() : current( 0 ), pitcher( 0 ), id( SM_NO_ID ), 
+                        signal( 0 ), valid( false ) {}
+
+        State                      current;
+
+        /// 0 if no state handled the signal.
+        State                      pitcher;
+        SmStateId                  id;
+        typename UserEvent::Signal signal;
+        bool                       valid;
+    };
+
+    /// Direct mapped pitcher memo of one machine definition and thread.
+    struct PitcherCache
+    {
+        PitcherCache() : generation( 0 ) {}
+
+        unsigned    generation;
+        PitcherSlot slots[ SM_PITCHER_CACHE_SIZE ];
+    };
+
+    /// The memo of the calling thread.
+    static PitcherCache& pitcherCache();
+
+    /// findPitcher() from the current state, through the memo if enabled.
+    bool lookupPitcher( UserEvent* e );
+
+    /// The signals that each declared state or any of its superstates
+    /// handles, folded from the published ones. All if any of them does
+    /// not publish.
+    struct SignalMasks
+    {
+        SignalMasks();
+
+        /// Set if any state publishes.
+        bool         published;
+        SmSignalMask reach[ sizeof( Hierarchy::states ) / 
+                            sizeof( Hierarchy::states[ 0 ] ) ];
+    };
+
+    /// True if no state handles the signal of e in the current state, by
+    /// the published signals.
+    bool rejects( UserEvent const* e );
+
+    /// Carry out dispatch of given event.
+    /// Returns the transition case, 'a' .. 'h', or 0 if not handled.
+    char transit( UserEvent* e );
+
+    /// transit(), from finding the pitcher on. The target shall be top.
+    /// entry: see jumpEntry().
+    char transit( UserEvent* e, JumpEntry* entry );
+
+    /// State field of SmTraceRecord for given state.
+    uint16_t traceId( UserState const& state );
+
+    /// Invoke handler of state in owner, and count it.
+    UserState invoke( State state, UserEvent const* e );
+
+    /// Count an invocation, see countInvocations().
+    static void countInvocation( State state, UserEvent const* e );
+
+    /// Counts of the states of one thread, open addressed on the handler.
+    /// The slot past the end takes the states that do not fit.
+    struct MetricsSlot
+    {
+        MetricsSlot() : state( 0 ), used( false ) {}
+
+        State               state;
+        std::atomic< bool > used;
+        SmCounter           invocations[ SM_SIGNAL_KINDS ];
+    };
+
+    /// The counters of one thread, written by that thread only.
+    struct MetricsBlock
+    {
+        MetricsBlock() : next( 0 ) {}
+
+        /// Slot of given state, claimed if new.
+        MetricsSlot& slot( State state );
+
+        /// Add the counts of other.
+        void add( MetricsBlock const& other );
+
+        SmCounter     dispatches;
+        SmCounter     unhandled;
+        SmCounter     cases[ 8 ];
+        MetricsSlot   slots[ SM_METRICS_STATES + 1 ];
+        MetricsBlock* next;
+    };
+
+    /// All blocks of this machine definition. The counts of threads that
+    /// have exited are kept in retired.
+    struct MetricsRegistry
+    {
+        MetricsRegistry() : head( 0 ) {}
+
+        std::mutex    lock;
+        MetricsBlock* head;
+        MetricsBlock  retired;
+    };
+
+    /// Registers the block of a thread for its lifetime.
+    struct ThreadMetrics
+    {
+        ThreadMetrics();
+        ~ThreadMetrics();
+
+        MetricsBlock block;
+    };
+
+    static MetricsRegistry& metricsRegistry();
+
+    /// The counters of the calling thread.
+    static MetricsBlock& metricsBlock();
 
     /// Invoke exit on all states from current state down to
-    /// pitcher state.
-    void exitDownToPitcher();
+    /// pitcher state, and beyond as required by the plan.
+    void exitDownToPitcher( TransitionPlan const& plan );
    
-    /// Used to store state hierarchy in transition.
-    typedef std::deque< UserState > Path;
+    /// Invoke entry event on the states in the plan.
+    /// plan: all states between least common ancestor and target.
+    void retraceEntryPath( TransitionPlan const& plan );
+
+    /// Bumped by invalidateTransitionCache().
+    static std::atomic< unsigned > cacheGeneration_;
 
-    /// Invoke entry event in given path.
-    /// path: all states between pitcher and target..
-    /// path: the states in the path might be updated but
-    /// not the path itself.
-    void retraceEntryPath( Path& path );
+    /// Set by countInvocations().
+    static std::atomic< bool > countInvocations_;
 
     /// Helper events used by dispatch().
     static SmEvent< T > const inquireEvent_;
@@ -258,17 +1554,13 @@ private:
     static SmEvent< T > const entryEvent_;
     static SmEvent< T > const exitEvent_;
 
-    /// The current state.
-    UserState current_;
+    /// The current state, and the pitcher state, target state and owner
+    /// during a transition.
+    Storage storage_;
 
-    /// Pitcher state during a transition.
-    UserState pitcher_;
-    
-    /// Target state during a transition.
-    UserState target_;
-
-    /// The statemachine owner.
-    OWNER* owner_;
+    /// Run the machine for each of its members, or regions, in turn.
+    friend class SmFamily< OWNER, T, MAX_DEPTH >;
+    friend class SmOrthogonal< OWNER, T, MAX_DEPTH >;
 };
 
 //------------------------------------------------------------------------------
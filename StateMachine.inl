@@ -15,55 +15,282 @@
 namespace Base {
 //==============================================================================
 
-template< class OWNER, class T >
+template< class OWNER, class T, unsigned MAX_DEPTH >
 SmEvent< T >
-const StateMachine< OWNER, T >::inquireEvent_ = SmEvent< T >( INQUIRE );
+const StateMachine< OWNER, T, MAX_DEPTH >::inquireEvent_ = SmEvent< T >( INQUIRE );
 
-template< class OWNER, class T >
+template< class OWNER, class T, unsigned MAX_DEPTH >
 SmEvent< T >
-const StateMachine< OWNER, T >::initEvent_    = SmEvent< T >( INIT );
+const StateMachine< OWNER, T, MAX_DEPTH >::initEvent_    = SmEvent< T >( INIT );
 
-template< class OWNER, class T >
+template< class OWNER, class T, unsigned MAX_DEPTH >
 SmEvent< T >
-const StateMachine< OWNER, T >::entryEvent_   = SmEvent< T >( ENTRY );
+const StateMachine< OWNER, T, MAX_DEPTH >::entryEvent_   = SmEvent< T >( ENTRY );
 
-template< class OWNER, class T >
+template< class OWNER, class T, unsigned MAX_DEPTH >
 SmEvent< T >
-const StateMachine< OWNER, T >::exitEvent_    = SmEvent< T >( EXIT );
+const StateMachine< OWNER, T, MAX_DEPTH >::exitEvent_    = SmEvent< T >( EXIT );
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+std::atomic< unsigned > StateMachine< OWNER, T, MAX_DEPTH >::cacheGeneration_( 0 );
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+std::atomic< bool > StateMachine< OWNER, T, MAX_DEPTH >::countInvocations_( false );
 
 //------------------------------------------------------------------------------
 
-template< class OWNER, class T >
-StateMachine< OWNER, T >::~StateMachine()
+template< class OWNER, class T, unsigned MAX_DEPTH >
+StateMachine< OWNER, T, MAX_DEPTH >::~StateMachine()
 {
    SM_TRACE( "StateMachine::~StateMachine" );
-   // No op.
+
+   Timer** timers = timersOf( storage_ );
+   while ( timers && *timers )
+   {
+      ( *timers )->disarm();
+   }
+
+   History** histories = historiesOf( storage_ );
+   while ( histories && *histories )
+   {
+      ( *histories )->unbind();
+   }
 }
 
 //------------------------------------------------------------------------------
 
-template< class OWNER, class T >
+template< class OWNER, class T, unsigned MAX_DEPTH >
 void
-StateMachine< OWNER, T >::open( OWNER*                      owner,
+StateMachine< OWNER, T, MAX_DEPTH >::open( OWNER*                      owner,
                                 StatePtr< OWNER, T > const& initial,
                                 UserEvent const*            e )
 {
    SM_TRACE( "StateMachine< OWNER, T >::open" );
 
-   owner_   = owner;
-   pitcher_ = owner->topState();
-   current_ = owner->topState();
-   target_  = initial;
+   typename Storage::Scope scope( storage_ );
+
+   bind( storage_, owner );
+   pitcher( owner->topState() );
+   current( owner->topState() );
+   target( initial );
    
-   target()(&entryEvent_);
+   invoke( target(), &entryEvent_ );
    init( target() );
+
+#if SM_BINARY_TRACE
+   smTraceWrite( SM_TRACE_OPEN, this, SM_TRACE_NO_STATE, traceId( current() ),
+                 0, 0 );
+#endif /* SM_BINARY_TRACE */
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+bool
+StateMachine< OWNER, T, MAX_DEPTH >::restore( OWNER*             owner,
+                                              SmImage const&     image,
+                                              SmTimerWheel*      wheel,
+                                              TimerOf            timerOf )
+{
+   SM_TRACE( "StateMachine< OWNER, T >::restore" );
+
+   static_assert( Hierarchy::declared, "StateMachine::restore needs a declared SmHierarchy" );
+
+   if ( !restorable( owner, image, wheel, timerOf ) )
+   {
+      return false;
+   }
+
+   typename Storage::Scope scope( storage_ );
+
+   bind( storage_, owner );
+   pitcher( owner->topState() );
+   target( owner->topState() );
+   current( stateOf( image.current ) );
+
+   History** histories = historiesOf( storage_ );
+   for ( unsigned i = 0; i < image.histories; ++i )
+   {
+      SmImage::History const& kept    = image.history[ i ];
+      History*                history = *histories;
+
+      while ( idOf( history->state_ ) != kept.state )
+      {
+         history = history->next_;
+      }
+
+      if ( kept.last == SM_NO_ID )
+      {
+         history->clear();
+      }
+      else
+      {
+         history->last_ = stateOf( kept.last );
+      }
+   }
+
+   rearm( storage_, image, wheel, timerOf );
+
+#if SM_BINARY_TRACE
+   smTraceWrite( SM_TRACE_OPEN, this, SM_TRACE_NO_STATE, traceId( current() ),
+                 0, 0 );
+#endif /* SM_BINARY_TRACE */
+   return true;
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+bool
+StateMachine< OWNER, T, MAX_DEPTH >::restorable( OWNER*         owner,
+                                                 SmImage const& image,
+                                                 SmTimerWheel*  wheel,
+                                                 TimerOf        timerOf )
+{
+   if ( image.fingerprint != smFingerprint< OWNER, T >() ||
+        !declaredIn( image.current, image.current ) ||
+        image.histories > SM_IMAGE_HISTORIES ||
+        image.timers    > SM_IMAGE_TIMERS )
+   {
+      return false;
+   }
+
+   // A history records one of the substates of its state, if any.
+   History** histories = historiesOf( storage_ );
+   for ( unsigned i = 0; i < image.histories; ++i )
+   {
+      SmImage::History const& kept    = image.history[ i ];
+      History*                history = histories ? *histories : 0;
+
+      while ( history && idOf( history->state_ ) != kept.state )
+      {
+         history = history->next_;
+      }
+
+      if ( !history ||
+           !declaredIn( kept.state, kept.state ) ||
+           ( kept.last != SM_NO_ID &&
+             ( kept.last == kept.state || !declaredIn( kept.last, kept.state ) ) ) )
+      {
+         return false;
+      }
+   }
+
+   // A timer is bound to the current state or one of its superstates,
+   // which are the ones not exited.
+   for ( unsigned i = 0; i < image.timers; ++i )
+   {
+      SmImage::Timer const& kept = image.timer[ i ];
+
+      if ( !timersOf( storage_ ) || !wheel || !timerOf ||
+           !declaredIn( image.current, kept.state ) ||
+           !timerOf( owner, kept.state, kept.signal ) )
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+bool
+StateMachine< OWNER, T, MAX_DEPTH >::declaredIn( SmStateId id, SmStateId ancestor )
+{
+   enum { SIZE = sizeof( Hierarchy::states ) / sizeof( Hierarchy::states[ 0 ] ) };
+
+   if ( id >= SIZE )
+   {
+      return false;
+   }
+
+   // Parents precede their children, so this comes to an end.
+   while ( id != ancestor )
+   {
+      if ( id == SM_TOP_ID )
+      {
+         return false;
+      }
+      id = Hierarchy::states[ id ].parent;
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+void
+StateMachine< OWNER, T, MAX_DEPTH >::rearm( SmStorage< OWNER, T, false >& storage,
+                                            SmImage const&                image,
+                                            SmTimerWheel*                 wheel,
+                                            TimerOf                       timerOf )
+{
+   for ( unsigned i = 0; i < image.timers; ++i )
+   {
+      SmImage::Timer const& kept = image.timer[ i ];
+
+      arm( *timerOf( owner(), kept.state, kept.signal ), *wheel,
+           stateOf( kept.state ), kept.ticks, kept.signal );
+   }
 }
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+bool
+StateMachine< OWNER, T, MAX_DEPTH >::save( SmImage&            image,
+                                           SmTimerWheel const* wheel ) const
+{
+   SM_TRACE( "StateMachine< OWNER, T >::save" );
+
+   static_assert( Hierarchy::declared, "StateMachine::save needs a declared SmHierarchy" );
+
+   Storage& storage = const_cast< Storage& >( storage_ );
+
+   image.fingerprint = smFingerprint< OWNER, T >();
+   image.current     = idOf( current() );
+   image.histories   = 0;
+   image.timers      = 0;
+   if ( image.current == SM_NO_ID )
+   {
+      return false;
+   }
+
+   History** histories = historiesOf( storage );
+   for ( History* history = histories ? *histories : 0;
+         history;
+         history = history->next_ )
+   {
+      if ( image.histories == SM_IMAGE_HISTORIES )
+      {
+         return false;
+      }
+
+      SmImage::History& kept = image.history[ image.histories++ ];
+      kept.state = idOf( history->state_ );
+      kept.last  = history->recorded() ? idOf( history->last_ ) : SmStateId( SM_NO_ID );
+   }
+
+   Timer** timers = timersOf( storage );
+   for ( Timer* timer = timers ? *timers : 0; timer; timer = timer->next_ )
+   {
+      if ( !wheel || image.timers == SM_IMAGE_TIMERS )
+      {
+         return false;
+      }
 
+      SmImage::Timer& kept = image.timer[ image.timers++ ];
+      kept.state  = idOf( timer->state_ );
+      kept.signal = timer->event_.signal();
+      kept.ticks  = timer->deadline() - wheel->now();
+   }
+   return true;
+}
 //------------------------------------------------------------------------------
 
-template< class OWNER, class T >
+template< class OWNER, class T, unsigned MAX_DEPTH >
 int
-StateMachine< OWNER, T >::isInState( StatePtr< OWNER, T > const& state )
+StateMachine< OWNER, T, MAX_DEPTH >::isInState( StatePtr< OWNER, T > const& state )
 {
    SM_TRACE( "StateMachine< OWNER, T >::isInState" );
 
@@ -72,17 +299,27 @@ StateMachine< OWNER, T >::isInState( StatePtr< OWNER, T > const& state )
       return 2;
    }
 
+   // Declared states are looked up in the hierarchy.
+   SmStateId currentId = idOf( current() );
+   SmStateId stateId   = idOf( state );
+   if ( currentId != SM_NO_ID && stateId != SM_NO_ID )
+   {
+      static Intervals const intervals;
+      return intervals.first[ stateId ] <  intervals.first[ currentId ] &&
+             intervals.first[ currentId ] < intervals.last[ stateId ] ? 1 : 0;
+   }
+
    // and all states down to (not including) top.
 
-   StatePtr< OWNER, T > next( current()( &inquireEvent_ ) );
+   StatePtr< OWNER, T > next( parentOf( current() ) );
 
-   while ( next != owner_->topState() )
+   while ( next != owner()->topState() )
    {
       if ( next == state )
       {
          return 1;
       }
-      next = next( &inquireEvent_ );
+      next = parentOf( next );
    }
 
    return 0;
@@ -90,284 +327,1322 @@ StateMachine< OWNER, T >::isInState( StatePtr< OWNER, T > const& state )
 
 //------------------------------------------------------------------------------
 
-template< class OWNER, class T >
+template< class OWNER, class T, unsigned MAX_DEPTH >
 StatePtr< OWNER, T >
-StateMachine< OWNER, T >::current() const
+StateMachine< OWNER, T, MAX_DEPTH >::current() const
 {
    SM_TRACE( "StateMachine< OWNER, T >::current" );
-   return current_;
+   return load( storage_.current() );
 }
 
 //------------------------------------------------------------------------------
 
-template< class OWNER, class T >
+template< class OWNER, class T, unsigned MAX_DEPTH >
 void
-StateMachine< OWNER, T >::current( StatePtr< OWNER, T > const& current )
+StateMachine< OWNER, T, MAX_DEPTH >::current( StatePtr< OWNER, T > const& current )
 {
    SM_TRACE( "StateMachine< OWNER, T >::current( State current )" );
-   current_ = current;
+   store( storage_.current(), current );
 }
 
 //------------------------------------------------------------------------------
 
-template< class OWNER, class T >
+template< class OWNER, class T, unsigned MAX_DEPTH >
 StatePtr< OWNER, T >
-StateMachine< OWNER, T >::pitcher() const
+StateMachine< OWNER, T, MAX_DEPTH >::pitcher() const
 {
    SM_TRACE( "StateMachine< OWNER, T >::pitcher" );
-   return pitcher_;
+   return load( storage_.pitcher() );
 }
 
 //------------------------------------------------------------------------------
 
-template< class OWNER, class T >
+template< class OWNER, class T, unsigned MAX_DEPTH >
 void
-StateMachine< OWNER, T >::pitcher( StatePtr< OWNER, T > const& pitcher )
+StateMachine< OWNER, T, MAX_DEPTH >::pitcher( StatePtr< OWNER, T > const& pitcher )
 {
    SM_TRACE( "StateMachine< OWNER, T >::pitcher( State pitcher )" );
-   pitcher_ = pitcher;
+   store( storage_.pitcher(), pitcher );
 }
 
 //------------------------------------------------------------------------------
 
-template< class OWNER, class T >
+template< class OWNER, class T, unsigned MAX_DEPTH >
 void
-StateMachine< OWNER, T >::target( StatePtr< OWNER, T > const& state )
+StateMachine< OWNER, T, MAX_DEPTH >::target( StatePtr< OWNER, T > const& state )
 {
    SM_TRACE( "StateMachine< OWNER, T >::target( State state )" );
-   target_ = state;
+   store( storage_.target(), state );
 }
 
 //------------------------------------------------------------------------------
 
-template< class OWNER, class T >
+template< class OWNER, class T, unsigned MAX_DEPTH >
 StatePtr< OWNER, T >
-StateMachine< OWNER, T >::target() const
+StateMachine< OWNER, T, MAX_DEPTH >::target() const
 {
    SM_TRACE( "StateMachine< OWNER, T >::target" );
-   return target_;
+   return load( storage_.target() );
 }
 
 //------------------------------------------------------------------------------
 
-template< class OWNER, class T >
+template< class OWNER, class T, unsigned MAX_DEPTH >
 bool
-StateMachine< OWNER, T >::dispatch( UserEvent* e )
+StateMachine< OWNER, T, MAX_DEPTH >::dispatch( UserEvent* e )
 {
    SM_TRACE( "StateMachine< OWNER, T >::dispatch" );
 
    assert( e && "Bad event to StateMachine::dispatch" );
 
-   using namespace std;
+   // An event that is not pooled may be deleted by transit().
+   bool      pooled = e->pooled();
+
+#if SM_BINARY_TRACE
+   uint16_t  state  = traceId( current() );
+   uint16_t  signal = static_cast< uint16_t >( e->signal() );
+   char      kind   = transit( e );
+   smTraceWrite( SM_TRACE_DISPATCH, this, state, traceId( current() ),
+                 signal, static_cast< uint8_t >( kind ) );
+#else
+   char      kind   = transit( e );
+#endif /* SM_BINARY_TRACE */
+
+   if ( pooled )
+   {
+      e->release();
+   }
+   return kind != 0;
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+char
+StateMachine< OWNER, T, MAX_DEPTH >::transit( UserEvent* e )
+{
+#if !defined ( SM_NO_METRICS )
+   MetricsBlock& metrics = metricsBlock();
+   metrics.dispatches.increment();
+#endif /* SM_NO_METRICS */
+
+   typename Storage::Scope scope( storage_ );
 
    // Used to elaborate internal transition.
-   target( owner_->topState() );
+   target( owner()->topState() );
+
+   if ( rejects( e ) )
+   {
+      SM_TRACE( "StateMachine signal not published" );
+#if !defined ( SM_NO_METRICS )
+      metrics.unhandled.increment();
+#endif /* SM_NO_METRICS */
+      pitcher( owner()->topState() );
+      return 0;
+   }
+
+   return transit( e, jumpEntry( e ) );
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+char
+StateMachine< OWNER, T, MAX_DEPTH >::transit( UserEvent* e, JumpEntry* entry )
+{
+#if !defined ( SM_NO_METRICS )
+   MetricsBlock& metrics = metricsBlock();
+#endif /* SM_NO_METRICS */
 
-   if ( !findPitcher( e ) )
+   if ( !( entry ? jumpPitcher( *entry, e ) : lookupPitcher( e ) ) )
    {
       // UserEvent is not handled.
       SM_TRACE( "StateMachine no pitcher" );
-      return false;
+#if !defined ( SM_NO_METRICS )
+      metrics.unhandled.increment();
+#endif /* SM_NO_METRICS */
+      if ( entry )
+      {
+         entry->pitcher = SM_TOP_ID;
+      }
+      return 0;
    }
 
    // ( h) Internal transition.
    // Side-effect: Call to findPitcher() above, which possibly,
    // sets a new target. If target is unchanged it is considered as an 
    // internal transition so step out. 
-   if ( target() == owner_->topState() )
+   if ( target() == owner()->topState() )
    {
        SM_TRACE( "StateMachine handled case (h)" );
-       return true;
+#if !defined ( SM_NO_METRICS )
+       metrics.cases[ 'h' - 'a' ].increment();
+#endif /* SM_NO_METRICS */
+       if ( entry && ( entry->pitcher = idOf( pitcher() ) ) != SM_NO_ID )
+       {
+          entry->target = SM_TOP_ID;
+          entry->kind   = 'h';
+       }
+       return 'h';
    }
 
-   exitDownToPitcher();
-
-   // (a) Handle transition to self.
-   if ( pitcher() == target() )
-   {
-      SM_TRACE( "StateMachine handled case (a)" );
-      pitcher()( &exitEvent_ );      
-      target()( &entryEvent_ );
-      init( target() );
-      return true;
-   }   
-
-   // (b) Handle pitcher == targets' parent.
-   StatePtr< OWNER, T > targetParent  = target()( &inquireEvent_ );
-   if ( pitcher() == targetParent )
-   {
-      SM_TRACE( "StateMachine handled case (b)" );
-      target()( &entryEvent_ );
-      init( target() );
-      return true;
-   }
-   
-   // (c) Handle pitcher's parent == targets' parent.
-   StatePtr< OWNER, T > pitcherParent = pitcher()( &inquireEvent_ );
-   if ( pitcherParent == targetParent )
+   char kind = entry ? jump( *entry ) : 0;
+   if ( kind )
    {
-      SM_TRACE( "StateMachine handled case (c)" );
-      pitcher()( &exitEvent_ );      
-      target()( &entryEvent_ );
+      SM_TRACE( "StateMachine jumped case (" << kind << ")" );
+#if !defined ( SM_NO_METRICS )
+      metrics.cases[ kind - 'a' ].increment();
+#endif /* SM_NO_METRICS */
       init( target() );
-      return true;
+      return kind;
    }
 
-   // (d) Handle pitcher's parent == target.
-   if ( pitcherParent == target() )
-   {
-      SM_TRACE( "StateMachine handled case (d)" );
-      pitcher()( &exitEvent_ );      
-      init( target() );
-      return true;
-   }
+   // Cases (a) - (g) are resolved once per (current, pitcher, target).
+   TransitionPlan  local;
+   TransitionPlan& plan = transitionPlan( local );
+   SM_TRACE( "StateMachine handled case (" << plan.kind << ")" );
+#if !defined ( SM_NO_METRICS )
+   metrics.cases[ plan.kind - 'a' ].increment();
+#endif /* SM_NO_METRICS */
 
-   // The target state hierarchy needs to be recorded. 
-   Path  trace;
-   trace.push_front( target() );
-   trace.push_front( targetParent );
+   plan.busy = true;
+   exitDownToPitcher( plan );
+   retraceEntryPath( plan );
+   kind = plan.kind;
+   plan.busy = false;
 
-   // (e) Handle pitcher == target's parent parent ... hierarchy.
-   StatePtr< OWNER, T > next( targetParent( &inquireEvent_ ) );
-   while ( next != owner_->topState() )
+   init( target() );
+   return kind;
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+void
+StateMachine< OWNER, T, MAX_DEPTH >::invalidateTransitionCache()
+{
+   SM_TRACE( "StateMachine< OWNER, T >::invalidateTransitionCache" );
+   cacheGeneration_.fetch_add( 1, std::memory_order_release );
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+typename StateMachine< OWNER, T, MAX_DEPTH >::Metrics
+StateMachine< OWNER, T, MAX_DEPTH >::metrics()
+{
+   SM_TRACE( "StateMachine< OWNER, T >::metrics" );
+
+   Metrics result;
+   result.dispatches = 0;
+   result.unhandled  = 0;
+   std::fill( result.cases, result.cases + 8, 0 );
+
+#if !defined ( SM_NO_METRICS )
+   // Sum in a block of our own, which merges the states of all threads.
+   MetricsBlock total;
    {
-      if ( next == pitcher() )
+      MetricsRegistry& registry = metricsRegistry();
+      std::lock_guard< std::mutex > guard( registry.lock );
+
+      total.add( registry.retired );
+      for ( MetricsBlock* block = registry.head; block; block = block->next )
       {
-         SM_TRACE( "StateMachine handled case (e)" );
-         retraceEntryPath( trace );
-         init( target() );
-         return true;
+         total.add( *block );
       }
-      trace.push_front( next );
-      next = next( &inquireEvent_ );
    }
-   trace.push_front( owner_->topState() );
-
-   // The remaining cases impose EXIT of pitcher.
-   pitcher()( &exitEvent_ );
 
-   // (f) Handle pitcher's parent == target's parent parent ... hierarchy.
-   typename Path::iterator pos;
-   if ( ( pos = find( trace.begin(),
-                      trace.end(),
-                      pitcherParent ) ) != trace.end() )
+   result.dispatches = total.dispatches.get();
+   result.unhandled  = total.unhandled.get();
+   for ( int i = 0; i < 8; ++i )
    {
-      // Found Least Base Ancestor @ pos. 
-      // Erase it and its ancestors because ENTRY on these is not correct.
-      SM_TRACE( "StateMachine handled case (f)" );
-      trace.erase( trace.begin(), ++pos );
-      retraceEntryPath( trace );
-      init( target() );
-      return true;
+      result.cases[ i ] = total.cases[ i ].get();
    }
 
-   // (g) Handle pitcher's parent parent ... hierarchy for each target.
-   bool search(true);
-   next = pitcherParent;
-   while ( search )
+   for ( int i = 0; i <= SM_METRICS_STATES; ++i )
    {
-      if ( ( pos = find( trace.begin(),
-                         trace.end(),
-                         next ) ) != trace.end() )
-      {
-         // Found Least Base Ancestor @ pos.
-         // Erase it and its ancestors because ENTRY on these
-         // is not correct.
-         SM_TRACE( "StateMachine handled case (g)" );
-         trace.erase( trace.begin(), ++pos );
-         retraceEntryPath( trace );
-         init( target() );
-         return true;
-      }
-      if ( next != owner_->topState() )
+      MetricsSlot const& slot = total.slots[ i ];
+
+      StateMetrics state;
+      state.state = slot.state;
+
+      unsigned long sum = 0;
+      for ( int kind = 0; kind < SM_SIGNAL_KINDS; ++kind )
       {
-         next( &exitEvent_ );
-         next = next( &inquireEvent_ );
+         state.invocations[ kind ] = slot.invocations[ kind ].get();
+         sum += state.invocations[ kind ];
       }
-      else
+
+      if ( sum > 0 )
       {
-         search = false;
+         result.states.push_back( state );
       }
    }
+#endif /* SM_NO_METRICS */
 
-   assert( false && "Impossible StateMachine transition case" );
-   return false;
+   return result;
 }
 
 //------------------------------------------------------------------------------
 
-template< class OWNER, class T >
-bool
-StateMachine< OWNER, T >::findPitcher( UserEvent* e )
+template< class OWNER, class T, unsigned MAX_DEPTH >
+void
+StateMachine< OWNER, T, MAX_DEPTH >::countInvocations( bool on )
 {
-   SM_TRACE( "StateMachine< OWNER, T >::findPitcher" );
+   SM_TRACE( "StateMachine< OWNER, T >::countInvocations" );
+   countInvocations_.store( on, std::memory_order_relaxed );
+}
 
-   pitcher( current() );
+//------------------------------------------------------------------------------
 
-   StatePtr< OWNER, T > next;
+template< class OWNER, class T, unsigned MAX_DEPTH >
+typename StateMachine< OWNER, T, MAX_DEPTH >::MetricsRegistry&
+StateMachine< OWNER, T, MAX_DEPTH >::metricsRegistry()
+{
+   static MetricsRegistry registry;
+   return registry;
+}
+
+//------------------------------------------------------------------------------
 
-   while ( ( next = pitcher()( e ) ) != owner_->handled() && 
-           pitcher() != owner_->topState() )
+template< class OWNER, class T, unsigned MAX_DEPTH >
+inline
+typename StateMachine< OWNER, T, MAX_DEPTH >::MetricsBlock&
+StateMachine< OWNER, T, MAX_DEPTH >::metricsBlock()
+{
+   // A plain pointer needs no initialization check on every access, 
+   // unlike the registered block itself.
+   static thread_local MetricsBlock* block = 0;
+   if ( !block )
    {
-      pitcher( next );
+      static thread_local ThreadMetrics metrics;
+      block = &metrics.block;
    }
+   return *block;
+}
+
+//------------------------------------------------------------------------------
 
-   return ( pitcher() != owner_->topState() );
+template< class OWNER, class T, unsigned MAX_DEPTH >
+StateMachine< OWNER, T, MAX_DEPTH >::ThreadMetrics::ThreadMetrics()
+{
+   MetricsRegistry& registry = metricsRegistry();
+   std::lock_guard< std::mutex > guard( registry.lock );
+
+   block.next    = registry.head;
+   registry.head = &block;
 }
 
 //------------------------------------------------------------------------------
 
-template< class OWNER, class T >
-void
-StateMachine< OWNER, T >::exitDownToPitcher()
+template< class OWNER, class T, unsigned MAX_DEPTH >
+StateMachine< OWNER, T, MAX_DEPTH >::ThreadMetrics::~ThreadMetrics()
 {
-   SM_TRACE( "StateMachine< OWNER, T >::exitDownToPitcher" );
-   assert( pitcher() != owner_->topState() && "exitDownToPitcher" );
+   MetricsRegistry& registry = metricsRegistry();
+   std::lock_guard< std::mutex > guard( registry.lock );
 
-   StatePtr< OWNER, T > next( current() );
+   // Keep the counts of this thread.
+   registry.retired.add( block );
 
-   while ( next != pitcher() )
+   MetricsBlock** link = &registry.head;
+   while ( *link != &block )
    {
-      assert( next );
+      link = &( *link )->next;
+   }
+   *link = block.next;
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+inline
+typename StateMachine< OWNER, T, MAX_DEPTH >::MetricsSlot&
+StateMachine< OWNER, T, MAX_DEPTH >::MetricsBlock::slot( State state )
+{
+   enum { MASK = SM_METRICS_STATES - 1 };
 
-      StatePtr< OWNER, T > tmp = next( &exitEvent_ );
+   // The code address alone tells states apart well enough.
+   std::size_t word;
+   std::memcpy( &word, &state, sizeof( word ) );
+   std::size_t i = ( ( word >> 4 ) ^ ( word >> 11 ) ) & MASK;
+   for ( int n = 0; n < SM_METRICS_STATES; ++n, i = ( i + 1 ) & MASK )
+   {
+      MetricsSlot& slot = slots[ i ];
 
-      if ( tmp == owner_->handled() )
+      // Free slots hold state 0, which is never looked up.
+      if ( slot.state == state )
       {
-         // EXIT handled, elicit parent.
-         next = next( &inquireEvent_ );
+         return slot;
       }
-      else
+
+      // Only the owning thread claims slots, readers look at used first.
+      if ( !slot.used.load( std::memory_order_relaxed ) )
+      {
+         slot.state = state;
+         slot.used.store( true, std::memory_order_release );
+         return slot;
+      }
+   }
+   return slots[ SM_METRICS_STATES ];
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+void
+StateMachine< OWNER, T, MAX_DEPTH >::MetricsBlock::add( MetricsBlock const& other )
+{
+   dispatches.increment( other.dispatches.get() );
+   unhandled.increment( other.unhandled.get() );
+   for ( int i = 0; i < 8; ++i )
+   {
+      cases[ i ].increment( other.cases[ i ].get() );
+   }
+
+   for ( int i = 0; i <= SM_METRICS_STATES; ++i )
+   {
+      MetricsSlot const& from = other.slots[ i ];
+
+      MetricsSlot* to = &slots[ SM_METRICS_STATES ];
+      if ( i < SM_METRICS_STATES )
+      {
+         if ( !from.used.load( std::memory_order_acquire ) )
+         {
+            continue;
+         }
+         to = &slot( from.state );
+      }
+
+      for ( int kind = 0; kind < SM_SIGNAL_KINDS; ++kind )
       {
-         // EXIT not handled (tmp = parent).
-         next = tmp;
+         to->invocations[ kind ].increment( from.invocations[ kind ].get() );
       }
    }
 }
 
 //------------------------------------------------------------------------------
 
-template< class OWNER, class T >
+template< class OWNER, class T, unsigned MAX_DEPTH >
+typename StateMachine< OWNER, T, MAX_DEPTH >::TransitionCache&
+StateMachine< OWNER, T, MAX_DEPTH >::transitionCache()
+{
+   static thread_local TransitionCache cache;
+   return cache;
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+std::size_t
+StateMachine< OWNER, T, MAX_DEPTH >::hashState( State state )
+{
+   enum { WORDS = ( sizeof( State ) + sizeof( std::size_t ) - 1 ) / 
+                  sizeof( std::size_t ) };
+
+   std::size_t words[ WORDS ] = { 0 };
+   std::memcpy( words, &state, sizeof( State ) );
+
+   std::size_t hash = 0;
+   for ( int i = 0; i < WORDS; ++i )
+   {
+      hash = ( hash ^ words[ i ] ) * 0x9E3779B1u;
+      hash ^= hash >> 15;
+   }
+   return hash;
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+typename StateMachine< OWNER, T, MAX_DEPTH >::TransitionPlan&
+StateMachine< OWNER, T, MAX_DEPTH >::transitionPlan( TransitionPlan& local )
+{
+   SM_TRACE( "StateMachine< OWNER, T >::transitionPlan" );
+
+   State current = this->current();
+   State pitcher = this->pitcher();
+   State target  = this->target();
+
+   TransitionCache& cache = transitionCache();
+
+   unsigned generation = cacheGeneration_.load( std::memory_order_acquire );
+   if ( cache.generation != generation )
+   {
+      for ( int i = 0; i < SM_TRANSITION_CACHE_SIZE; ++i )
+      {
+         cache.plans[ i ].valid = false;
+      }
+      cache.generation = generation;
+   }
+
+   std::size_t slot = ( hashState( current ) ^
+                        hashState( pitcher ) * 3 ^
+                        hashState( target )  * 5 ) & 
+                      ( SM_TRANSITION_CACHE_SIZE - 1 );
+
+   TransitionPlan& plan = cache.plans[ slot ].busy ? local
+                                                   : cache.plans[ slot ];
+#if !defined ( SM_NO_TRANSITION_CACHE )
+   if ( plan.valid            &&
+        plan.current == current &&
+        plan.pitcher == pitcher &&
+        plan.target  == target )
+   {
+      return plan;
+   }
+#endif /* SM_NO_TRANSITION_CACHE */
+
+   plan.current = current;
+   plan.pitcher = pitcher;
+   plan.target  = target;
+   resolveTransition( plan );
+   plan.valid   = true;
+
+   return plan;
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+void
+StateMachine< OWNER, T, MAX_DEPTH >::resolveTransition( TransitionPlan& plan )
+{
+   SM_TRACE( "StateMachine< OWNER, T >::resolveTransition" );
+   assert( pitcher() != owner()->topState() && "resolveTransition" );
+
+   if ( resolveDeclared( plan ) )
+   {
+      return;
+   }
+
+   plan.exits.clear();
+   plan.entries.clear();
+
+   // All states from current down to (not including) pitcher.
+   StatePtr< OWNER, T > next( current() );
+   while ( next != pitcher() )
+   {
+      assert( next );
+      plan.exits.push_back( next );
+      next = parentOf( next );
+   }
+
+   // (a) Handle transition to self.
+   if ( pitcher() == target() )
+   {
+      plan.kind = 'a';
+      plan.exits.push_back( pitcher() );
+      plan.entries.push_back( target() );
+      return;
+   }   
+
+   // (b) Handle pitcher == targets' parent.
+   StatePtr< OWNER, T > targetParent  = parentOf( target() );
+   if ( pitcher() == targetParent )
+   {
+      plan.kind = 'b';
+      plan.entries.push_back( target() );
+      return;
+   }
+   
+   // (c) Handle pitcher's parent == targets' parent.
+   StatePtr< OWNER, T > pitcherParent = parentOf( pitcher() );
+   if ( pitcherParent == targetParent )
+   {
+      plan.kind = 'c';
+      plan.exits.push_back( pitcher() );
+      plan.entries.push_back( target() );
+      return;
+   }
+
+   // (d) Handle pitcher's parent == target.
+   if ( pitcherParent == target() )
+   {
+      plan.kind = 'd';
+      plan.exits.push_back( pitcher() );
+      return;
+   }
+
+   // The target state hierarchy needs to be recorded, innermost first. 
+   Path  trace;
+   trace.push_back( target() );
+   trace.push_back( targetParent );
+
+   // (e) Handle pitcher == target's parent parent ... hierarchy.
+   next = parentOf( targetParent );
+   while ( next != owner()->topState() )
+   {
+      if ( next == pitcher() )
+      {
+         plan.kind = 'e';
+         plan.entries.assign_reverse( trace, trace.size() );
+         return;
+      }
+      trace.push_back( next );
+      next = parentOf( next );
+   }
+   trace.push_back( owner()->topState() );
+
+   // The remaining cases impose EXIT of pitcher.
+   plan.exits.push_back( pitcher() );
+
+   // (f) Handle pitcher's parent == target's parent parent ... hierarchy.
+   unsigned pos;
+   if ( ( pos = trace.find( pitcherParent ) ) != trace.size() )
+   {
+      // Found Least Base Ancestor @ pos. 
+      // Skip it and its ancestors because ENTRY on these is not correct.
+      plan.kind = 'f';
+      plan.entries.assign_reverse( trace, pos );
+      return;
+   }
+
+   // (g) Handle pitcher's parent parent ... hierarchy for each target.
+   next = pitcherParent;
+   while ( ( pos = trace.find( next ) ) == trace.size() )
+   {
+      assert( next != owner()->topState() && 
+              "Impossible StateMachine transition case" );
+      plan.exits.push_back( next );
+      next = parentOf( next );
+   }
+
+   // Found Least Base Ancestor @ pos.
+   // Skip it and its ancestors because ENTRY on these
+   // is not correct.
+   plan.kind = 'g';
+   plan.entries.assign_reverse( trace, pos );
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+bool
+StateMachine< OWNER, T, MAX_DEPTH >::findPitcher( UserEvent*                  e,
+                                             StatePtr< OWNER, T > const& from )
+{
+   SM_TRACE( "StateMachine< OWNER, T >::findPitcher" );
+
+   // Kept local, the handlers do not look at it.
+   StatePtr< OWNER, T > state( from );
+   StatePtr< OWNER, T > next;
+
+   while ( ( next = invoke( state, e ) ) != owner()->handled() && 
+           state != owner()->topState() )
+   {
+      state = next;
+   }
+
+   pitcher( state );
+   return ( state != owner()->topState() );
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+bool
+StateMachine< OWNER, T, MAX_DEPTH >::resolveDeclared( TransitionPlan& plan )
+{
+   SM_TRACE( "StateMachine< OWNER, T >::resolveDeclared" );
+
+   if ( !Hierarchy::declared )
+   {
+      return false;
+   }
+
+   SmStateId c = idOf( current() );
+   SmStateId p = idOf( pitcher() );
+   SmStateId t = idOf( target() );
+
+   if ( c == SM_NO_ID || p == SM_NO_ID || t == SM_NO_ID )
+   {
+      return false;
+   }
+
+   IdPath exits;
+   IdPath entries;
+   plan.kind = resolveIds( c, p, t, exits, entries );
+
+   plan.exits.resize( exits.size() );
+   for ( unsigned i = 0; i < exits.size(); ++i )
+   {
+      plan.exits[ i ] = Hierarchy::states[ exits[ i ] ].state;
+   }
+
+   plan.entries.resize( entries.size() );
+   for ( unsigned i = 0; i < entries.size(); ++i )
+   {
+      plan.entries[ i ] = Hierarchy::states[ entries[ i ] ].state;
+   }
+   return true;
+}
+
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+char
+StateMachine< OWNER, T, MAX_DEPTH >::resolveIds( SmStateId c,
+                                                 SmStateId p,
+                                                 SmStateId t,
+                                                 IdPath&   exits,
+                                                 IdPath&   entries )
+{
+   SM_TRACE( "StateMachine< OWNER, T >::resolveIds" );
+
+   static_assert( smMaxDepth( Hierarchy::states ) <= MAX_DEPTH,
+                  "SmHierarchy deeper than MAX_DEPTH" );
+
+   SmStateDecl< OWNER, T > const* states = Hierarchy::states;
+
+   exits.clear();
+   entries.clear();
+
+   // All states from current down to (not including) pitcher.
+   SmStateId s;
+   for ( s = c; s != p; s = states[ s ].parent )
+   {
+      assert( s != SM_TOP_ID && "Pitcher is not a superstate of current" );
+      exits.push_back( s );
+   }
+
+   // (a) Handle transition to self.
+   if ( p == t )
+   {
+      exits.push_back( p );
+      entries.push_back( t );
+      return 'a';
+   }
+
+   // Exit pitcher and its superstates below the least common ancestor,
+   // and enter the states from there down to target.
+   SmStateId lca = smLca( Hierarchy::states, p, t );
+   if ( lca != p )
+   {
+      for ( s = p; s != lca; s = states[ s ].parent )
+      {
+         exits.push_back( s );
+      }
+   }
+
+   entries.resize( smDepth( Hierarchy::states, t ) - 
+                   smDepth( Hierarchy::states, lca ) );
+   s = t;
+   for ( unsigned i = entries.size(); i-- > 0; s = states[ s ].parent )
+   {
+      entries[ i ] = s;
+   }
+
+   SmStateId tp = states[ t ].parent;
+   SmStateId pp = states[ p ].parent;
+   return tp  == p  ? 'b' :
+          pp  == tp ? 'c' :
+          pp  == t  ? 'd' :
+          lca == p  ? 'e' :
+          lca == pp ? 'f' : 'g';
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+StateMachine< OWNER, T, MAX_DEPTH >::Intervals::Intervals()
+{
+   enum { SIZE = sizeof( Hierarchy::states ) / sizeof( Hierarchy::states[ 0 ] ) };
+
+   // Every parent precedes its children, so the sizes of the subtrees are
+   // summed backwards and the numbers handed out forwards.
+   SmStateId size[ SIZE ];
+   SmStateId id;
+
+   for ( id = 0; id < SIZE; ++id )
+   {
+      size[ id ] = 1;
+   }
+   for ( id = SIZE; id-- > 0; )
+   {
+      SmStateId parent = Hierarchy::states[ id ].parent;
+      if ( parent != SM_TOP_ID )
+      {
+         size[ parent ] += size[ id ];
+      }
+   }
+
+   // While numbering, last is the next free number below a state.
+   SmStateId top = 0;
+   for ( id = 0; id < SIZE; ++id )
+   {
+      SmStateId  parent = Hierarchy::states[ id ].parent;
+      SmStateId& next   = parent != SM_TOP_ID ? last[ parent ] : top;
+
+      first[ id ] = next;
+      next       += size[ id ];
+      last[ id ]  = first[ id ] + 1;
+   }
+   for ( id = 0; id < SIZE; ++id )
+   {
+      last[ id ] = first[ id ] + size[ id ];
+   }
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+typename StateMachine< OWNER, T, MAX_DEPTH >::PitcherCache&
+StateMachine< OWNER, T, MAX_DEPTH >::pitcherCache()
+{
+   static thread_local PitcherCache cache;
+   return cache;
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+bool
+StateMachine< OWNER, T, MAX_DEPTH >::lookupPitcher( UserEvent* e )
+{
+   SM_TRACE( "StateMachine< OWNER, T >::lookupPitcher" );
+
+   if ( !Pitchers::enabled )
+   {
+      return findPitcher( e, current() );
+   }
+
+   PitcherCache& cache = pitcherCache();
+
+   unsigned generation = cacheGeneration_.load( std::memory_order_acquire );
+   if ( cache.generation != generation )
+   {
+      for ( int i = 0; i < SM_PITCHER_CACHE_SIZE; ++i )
+      {
+         cache.slots[ i ].valid = false;
+      }
+      cache.generation = generation;
+   }
+
+   State        current = this->current();
+   PitcherSlot& slot    = cache.slots[ ( hashState( current ) ^
+                                         e->signal() * 0x9E3779B1u ) &
+                                       ( SM_PITCHER_CACHE_SIZE - 1 ) ];
+   bool         found;
+
+   if ( slot.valid && slot.current == current && slot.signal == e->signal() )
+   {
+      if ( slot.pitcher == 0 )
+      {
+         pitcher( owner()->topState() );
+         return false;
+      }
+
+      StatePtr< OWNER, T > memo;
+      memo.init( owner(), slot.pitcher, slot.id );
+      pitcher( memo );
+
+      StatePtr< OWNER, T > next( invoke( memo, e ) );
+      if ( next == owner()->handled() )
+      {
+         return true;
+      }
+
+      // Declined this time, walk on from its parent.
+      found = findPitcher( e, next );
+   }
+   else
+   {
+      found = findPitcher( e, this->current() );
+   }
+
+   slot.current = current;
+   slot.signal  = e->signal();
+   slot.pitcher = found ? State( pitcher() ) : 0;
+   slot.id      = found ? pitcher().id() : SmStateId( SM_NO_ID );
+   slot.valid   = true;
+
+   return found;
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+StateMachine< OWNER, T, MAX_DEPTH >::SignalMasks::SignalMasks()
+   : published( false )
+{
+   enum { SIZE = sizeof( Hierarchy::states ) / sizeof( Hierarchy::states[ 0 ] ) };
+
+   // Every parent precedes its children.
+   for ( SmStateId id = 0; id < SIZE; ++id )
+   {
+      SmSignalMask signals = Hierarchy::states[ id ].signals;
+      SmStateId    parent  = Hierarchy::states[ id ].parent;
+
+      published = published || signals != 0;
+      reach[ id ] = ( signals != 0 ? signals : ~SmSignalMask( 0 ) ) |
+                    ( parent != SM_TOP_ID ? reach[ parent ] : 0 );
+   }
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+bool
+StateMachine< OWNER, T, MAX_DEPTH >::rejects( UserEvent const* e )
+{
+   if ( !Hierarchy::declared || e->signal() >= SM_SIGNAL_MASK_BITS )
+   {
+      return false;
+   }
+
+   static SignalMasks const masks;
+   if ( !masks.published )
+   {
+      return false;
+   }
+
+   SmStateId id = idOf( current() );
+   return id != SM_NO_ID && 
+          ( masks.reach[ id ] & ( SmSignalMask( 1 ) << e->signal() ) ) == 0;
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+typename StateMachine< OWNER, T, MAX_DEPTH >::JumpTable&
+StateMachine< OWNER, T, MAX_DEPTH >::jumpTable()
+{
+   static thread_local JumpTable table;
+   return table;
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+typename StateMachine< OWNER, T, MAX_DEPTH >::JumpEntry*
+StateMachine< OWNER, T, MAX_DEPTH >::jumpEntry( UserEvent const* e )
+{
+   static_assert( Jump::signals == 0 || Hierarchy::declared,
+                  "SmJumpTable needs a declared SmHierarchy" );
+
+   if ( Jump::signals == 0 || e->signal() >= Jump::signals )
+   {
+      return 0;
+   }
+
+   SmStateId leaf = idOf( current() );
+   if ( leaf == SM_NO_ID )
+   {
+      return 0;
+   }
+
+   JumpTable& table = jumpTable();
+
+   // Entries are reset in place, a busy one is still being executed. One
+   // more than the cache generation, so that a zeroed table is reset.
+   unsigned generation = cacheGeneration_.load( std::memory_order_acquire ) + 1;
+   if ( table.generation != generation )
+   {
+      for ( std::size_t i = 0; i < JumpTable::SIZE; ++i )
+      {
+         table.entries[ i ].pitcher = SM_NO_ID;
+      }
+      table.generation = generation;
+   }
+
+   JumpEntry& entry = table.entries[ leaf * Jump::signals + e->signal() ];
+   return entry.busy ? 0 : &entry;
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+bool
+StateMachine< OWNER, T, MAX_DEPTH >::jumpPitcher( JumpEntry& entry, UserEvent* e )
+{
+   SM_TRACE( "StateMachine< OWNER, T >::jumpPitcher" );
+
+   if ( entry.pitcher == SM_NO_ID )
+   {
+      return findPitcher( e, current() );
+   }
+
+   pitcher( stateOf( entry.pitcher ) );
+   if ( entry.pitcher == SM_TOP_ID )
+   {
+      return false;
+   }
+
+   StatePtr< OWNER, T > next( invoke( pitcher(), e ) );
+   if ( next == owner()->handled() )
+   {
+      return true;
+   }
+
+   // Declined this time, walk on from its parent.
+   entry.pitcher = SM_NO_ID;
+   return findPitcher( e, next );
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+char
+StateMachine< OWNER, T, MAX_DEPTH >::jump( JumpEntry& entry )
+{
+   SM_TRACE( "StateMachine< OWNER, T >::jump" );
+
+   SmStateId p = idOf( pitcher() );
+   SmStateId t = idOf( target() );
+
+   if ( entry.pitcher != p || entry.target != t )
+   {
+      SmStateId c = idOf( current() );
+      if ( c == SM_NO_ID || p == SM_NO_ID || t == SM_NO_ID )
+      {
+         entry.pitcher = SM_NO_ID;
+         return 0;
+      }
+
+      IdPath exits;
+      IdPath entries;
+      entry.kind       = resolveIds( c, p, t, exits, entries );
+      entry.pitcher    = p;
+      entry.target     = t;
+      entry.exitCount  = static_cast< unsigned short >( exits.size() );
+      entry.entryCount = static_cast< unsigned short >( entries.size() );
+      std::copy( exits.begin(), exits.end(), entry.exits );
+      std::copy( entries.begin(), entries.end(), entry.entries );
+   }
+
+   char kind = entry.kind;
+   entry.busy = true;
+
+   for ( unsigned i = 0; i < entry.exitCount; ++i )
+   {
+      State state = Hierarchy::states[ entry.exits[ i ] ].state;
+      invoke( state, &exitEvent_ );
+      exited( state );
+   }
+
+   for ( unsigned i = 0; i < entry.entryCount; ++i )
+   {
+      invoke( Hierarchy::states[ entry.entries[ i ] ].state, &entryEvent_ );
+   }
+
+   entry.busy = false;
+   return kind;
+}
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+StatePtr< OWNER, T >
+StateMachine< OWNER, T, MAX_DEPTH >::parentOf( StatePtr< OWNER, T > const& state )
+{
+   SM_TRACE( "StateMachine< OWNER, T >::parentOf" );
+
+   SmStateId id = idOf( state );
+   if ( id != SM_NO_ID )
+   {
+      return stateOf( Hierarchy::states[ id ].parent );
+   }
+
+   return invoke( state, &inquireEvent_ );
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+uint16_t
+StateMachine< OWNER, T, MAX_DEPTH >::traceId( StatePtr< OWNER, T > const& state )
+{
+   SmStateId id = idOf( state );
+   if ( id != SM_NO_ID && id < 0x8000 )
+   {
+      return id;
+   }
+
+   std::size_t hash = hashState( state );
+   return SM_TRACE_HASHED( hash );
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+SmStateId
+StateMachine< OWNER, T, MAX_DEPTH >::idOf( StatePtr< OWNER, T > const& state ) const
+{
+   if ( !Hierarchy::declared )
+   {
+      return SM_NO_ID;
+   }
+
+   if ( state.id() != SM_NO_ID )
+   {
+      return state.id();
+   }
+
+#if !defined ( NDEBUG )
+   // The id of a declared state shall be given to StatePtr::init(), see
+   // SmHierarchy; it is not searched for on every dispatch.
+   enum { SIZE = sizeof( Hierarchy::states ) / sizeof( Hierarchy::states[ 0 ] ) };
+   for ( SmStateId id = 0; id < SIZE; ++id )
+   {
+      assert( Hierarchy::states[ id ].state != State( state ) &&
+              "StateMachine declared state without its id" );
+   }
+#endif /* NDEBUG */
+   return SM_NO_ID;
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+inline
+StatePtr< OWNER, T >
+StateMachine< OWNER, T, MAX_DEPTH >::stateOf( SmStateId id ) const
+{
+   if ( id == SM_TOP_ID )
+   {
+      return owner()->topState();
+   }
+
+   return StatePtr< OWNER, T >( owner(), Hierarchy::states[ id ].state, id );
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+inline
+void
+StateMachine< OWNER, T, MAX_DEPTH >::store( SmStateId&                  slot,
+                                            StatePtr< OWNER, T > const& state )
+{
+   if ( state.id() != SM_NO_ID )
+   {
+      slot = state.id();
+      return;
+   }
+
+   if ( State( state ) == State( owner()->topState() ) )
+   {
+      slot = SM_TOP_ID;
+      return;
+   }
+
+   slot = idOf( state );
+   assert( slot != SM_NO_ID && "SmCompact state shall be declared" );
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+inline
+StatePtr< OWNER, T >
+StateMachine< OWNER, T, MAX_DEPTH >::invoke( State state, UserEvent const* e )
+{
+#if !defined ( SM_NO_METRICS )
+   if ( countInvocations_.load( std::memory_order_relaxed ) )
+   {
+      countInvocation( state, e );
+   }
+#endif /* SM_NO_METRICS */
+
+   return ( owner()->*state )( e );
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+void
+StateMachine< OWNER, T, MAX_DEPTH >::countInvocation( State state, UserEvent const* e )
+{
+   typedef typename UserEvent::Signal Signal;
+
+   Signal       signal = e->signal();
+   SmSignalKind kind   = signal <= EXIT              ? SmSignalKind( signal ) :
+                         signal == Signal( INQUIRE ) ? SM_KIND_INQUIRE        :
+                                                       SM_KIND_USER;
+
+   metricsBlock().slot( state ).invocations[ kind ].increment();
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+void
+StateMachine< OWNER, T, MAX_DEPTH >::arm( Timer&                            timer,
+                                          SmTimerWheel&                     wheel,
+                                          StatePtr< OWNER, T > const&       state,
+                                          uint64_t                          ticks,
+                                          typename UserEvent::Signal const& signal )
+{
+   SM_TRACE( "StateMachine< OWNER, T >::arm" );
+
+   static_assert( !SmCompact< OWNER, T >::enabled,
+                  "SmCompact machines have no timers" );
+
+   Timer** timers = timersOf( storage_ );
+
+   timer.disarm();
+   timer.owner_   = owner();
+   timer.deliver_ = &deliver;
+   timer.state_   = state;
+   timer.event_.signal( signal );
+
+   timer.head_ = timers;
+   timer.prev_ = 0;
+   timer.next_ = *timers;
+   if ( *timers )
+   {
+      ( *timers )->prev_ = &timer;
+   }
+   *timers = &timer;
+
+   wheel.arm( timer, ticks );
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+void
+StateMachine< OWNER, T, MAX_DEPTH >::remember( History&                    history,
+                                               StatePtr< OWNER, T > const& state,
+                                               SmHistoryKind               kind )
+{
+   SM_TRACE( "StateMachine< OWNER, T >::remember" );
+
+   static_assert( !SmCompact< OWNER, T >::enabled,
+                  "SmCompact machines have no histories" );
+
+   History** histories = historiesOf( storage_ );
+
+   history.unbind();
+   history.state_ = state;
+   history.kind_  = kind;
+   history.clear();
+
+   history.head_ = histories;
+   history.prev_ = 0;
+   history.next_ = *histories;
+   if ( *histories )
+   {
+      ( *histories )->prev_ = &history;
+   }
+   *histories = &history;
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+inline
+void
+StateMachine< OWNER, T, MAX_DEPTH >::exited( State state )
+{
+   Timer** timers = timersOf( storage_ );
+   if ( !timers )
+   {
+      return;
+   }
+
+   Timer* timer = *timers;
+   while ( timer )
+   {
+      Timer* next = timer->next_;
+      if ( State( timer->state_ ) == state )
+      {
+         SM_TRACE( "StateMachine timer cancelled on exit" );
+         timer->disarm();
+      }
+      timer = next;
+   }
+
+   for ( History* history = *historiesOf( storage_ );
+         history;
+         history = history->next_ )
+   {
+      if ( State( history->state_ ) == state )
+      {
+         record( *history );
+      }
+   }
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+void
+StateMachine< OWNER, T, MAX_DEPTH >::record( History& history )
+{
+   SM_TRACE( "StateMachine< OWNER, T >::record" );
+
+   // The current state is the one left until the target is entered.
+   StatePtr< OWNER, T > last( current() );
+   if ( last == history.state_ )
+   {
+      return;
+   }
+
+   if ( history.kind_ == SM_SHALLOW_HISTORY )
+   {
+      StatePtr< OWNER, T > parent( parentOf( last ) );
+      while ( parent != history.state_ )
+      {
+         assert( parent != owner()->topState() &&
+                 "StateMachine history of a state not exited" );
+         last   = parent;
+         parent = parentOf( parent );
+      }
+   }
+
+   history.last_ = last;
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+bool
+StateMachine< OWNER, T, MAX_DEPTH >::deliver( OWNER* owner, UserEvent* e )
+{
+   return static_cast< StateMachine* >( owner )->dispatch( e );
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
+void
+StateMachine< OWNER, T, MAX_DEPTH >::exitDownToPitcher( TransitionPlan const& plan )
+{
+   SM_TRACE( "StateMachine< OWNER, T >::exitDownToPitcher" );
+
+   typename Path::const_iterator iter;
+   typename Path::const_iterator end( plan.exits.end() );
+
+   for ( iter = plan.exits.begin(); iter != end; ++iter )
+   {
+      invoke( *iter, &exitEvent_ );
+      exited( *iter );
+   }
+}
+
+//------------------------------------------------------------------------------
+
+template< class OWNER, class T, unsigned MAX_DEPTH >
 void
-StateMachine< OWNER, T >::retraceEntryPath( Path& trace )
+StateMachine< OWNER, T, MAX_DEPTH >::retraceEntryPath( TransitionPlan const& plan )
 {
    SM_TRACE( "StateMachine< OWNER, T >::retraceEntryPath" );
 
    typename Path::const_iterator iter;
-   typename Path::const_iterator end( trace.end() );
+   typename Path::const_iterator end( plan.entries.end() );
 
-   for ( iter = trace.begin(); iter != end; ++iter )
+   for ( iter = plan.entries.begin(); iter != end; ++iter )
    {
-       StatePtr< OWNER, T > sw = *iter;
-       sw( &entryEvent_ );
+      invoke( *iter, &entryEvent_ );
    }
 }
 
 //------------------------------------------------------------------------------
 
-template< class OWNER, class T >
+template< class OWNER, class T, unsigned MAX_DEPTH >
 void
-StateMachine< OWNER, T >::init( StatePtr< OWNER, T > const& state )
+StateMachine< OWNER, T, MAX_DEPTH >::init( StatePtr< OWNER, T > const& state )
 {
    SM_TRACE( "StateMachine< OWNER, T >::init" );
 
@@ -375,11 +1650,11 @@ StateMachine< OWNER, T >::init( StatePtr< OWNER, T > const& state )
 
    StatePtr< OWNER, T > next( state );
 
-   while ( next( &initEvent_ ) == owner_->handled() )
+   while ( invoke( next, &initEvent_ ) == owner()->handled() )
    {
       // INIT was handled so current has been modified (by initEvent_ call).
       next = current();
-      next( &entryEvent_ );
+      invoke( next, &entryEvent_ );
    }
 }
 
@@ -1,15 +1,16 @@
 //=============================================- -*- C -*- ===================
 //
-// File Name     StateMachine.h
+// File Name     StateMachineC.h
 // Author        Tommy Carlsson (topcatse)
 //
 // This file contains the interfaces of StateMachine and SmEvent.
 //==============================================================================
-#if !defined ( BASE_STATE_MACHINE_H_ )
-#define BASE_STATE_MACHINE_H_
+#if !defined ( BASE_STATE_MACHINE_C_H_ )
+#define BASE_STATE_MACHINE_C_H_
 //==============================================================================
 
 #include "Deque.h"
+#include "SmTrace.h"
 
 //==============================================================================
 
@@ -31,6 +32,12 @@
 #   define SM_TRACE( X ) printf("%s\r\n", X);
 #endif /* SM_TRACE */
 
+// SM_BINARY_TRACE, see SmTrace.h, records dispatch without formatting.
+
+/// Define this for targets without malloc. States and StateMachines are
+/// then created in an SmArena only.
+//#define SM_NO_MALLOC
+
 //==============================================================================
 
 typedef unsigned short Signal;
@@ -44,16 +51,44 @@ typedef enum { SM_USER_START = 3 } StartSignal;
  
 typedef struct State* (*StateFcn)( OWNER, Signal );
 
+/// Set of signals, SM_SIGNAL( s ) or'ed.
+typedef uint64_t SmSignalMask;
+
+/// Signals that fit in an SmSignalMask.
+#define SM_SIGNAL_MASK_BITS 64
+
+#define SM_SIGNAL( s ) ( (SmSignalMask)1 << (s) )
+
 struct State
 { 
 	StateFcn stateFcn_;
     OWNER    owner_; // Cached, not owned
+
+    /// Published signals, see State_handles(). 0 if not published.
+    SmSignalMask signals_;
+
+    /// Signals that the state or any of its superstates handles, folded
+    /// at the first dispatch in the state. 0 until then.
+    SmSignalMask reach_;
+
+    /// Bits of the state and its superstates, see StateMachine_isInState(),
+    /// folded the first time the state is current. 0 until then.
+    uint64_t     ancestors_;
+
+    /// The numbering of the machine that bit_ and ancestors_ were given
+    /// by, see StateMachine_t::numbering_. 0 if never numbered.
+    uint32_t     numbering_;
+
+    /// Bit of the state in ancestors_ of its substates, 0 if not numbered.
+    uint8_t      bit_;
 };
 
 typedef struct State* State;
 
+#if !defined ( SM_NO_MALLOC )
 /// Constructor
 State State_ctor( OWNER owner, StateFcn stateFcn );
+#endif /* SM_NO_MALLOC */
 
 /// Initializer. Object takes ownership of load.
 void State_init( State self, OWNER owner, StateFcn stateFcn );
@@ -61,7 +96,11 @@ void State_init( State self, OWNER owner, StateFcn stateFcn );
 /// Conversion operator to StateFcn.
 StateFcn State_stateFcn( State self );
 
-/// Equality operator.
+/// Identity, which is what the engine compares. Each state of a machine
+/// shall be one State object, which handlers return as parent.
+bool State_isSame( State self, State const rhs );
+
+/// Equality operator, of handler and owner.
 bool State_isEqual( State self, State const rhs );
 
 /// Inequality operator.
@@ -70,6 +109,14 @@ bool State_isNotEqual( State self, State const rhs );
 /// Invoke transition in owner.
 State State_invoke( State self, Signal e );
 
+/// Publish the user signals that the state handles, 0 for none. The state
+/// shall then return its parent for all other user signals. A signal that
+/// neither the current state nor any of its superstates handles is then
+/// rejected by dispatch without invoking any state, unless one of them
+/// does not publish. Signals from SM_SIGNAL_MASK_BITS and up are never
+/// rejected. Shall be called before the machine is opened.
+void State_handles( State self, SmSignalMask signals );
+
 //==============================================================================
 
 /**
@@ -88,6 +135,16 @@ struct StateMachine_t
 
     /// The state machine owner.
     OWNER owner_;
+
+    /// Number of states given a bit, see State::bit_. Zeroed when created
+    /// by StateMachine_ctor() or StateMachine_create(), kept when opened
+    /// again since the states keep their bits.
+    uint8_t numbered_;
+
+    /// Tells the bits given by this machine from those of a machine that
+    /// its states belonged to before, which are given anew. A new one is
+    /// taken when created, from a count shared by all machines.
+    uint32_t numbering_;
 };
 
 typedef struct StateMachine_t* StateMachine;
@@ -96,24 +153,45 @@ typedef struct StateMachine_t* StateMachine;
 /// is entered or leaves a state. INQUIRE is reserved for internal use.
 enum StandardSignals { SM_DUMMY = -2, SM_INQUIRE = -1, SM_INIT, SM_ENTRY, SM_EXIT };
 
+#if !defined ( SM_NO_MALLOC )
 StateMachine StateMachine_ctor();
 void StateMachine_dtor(StateMachine self);
+#endif /* SM_NO_MALLOC */
 
 /// Initialize and execute initial transition.
 void StateMachine_open(StateMachine self,
 					   OWNER        owner,
 					   State const  initial);
 
+/// Put the machine in state current without invoking any state, ENTRY and
+/// INIT included, e.g. when restored from a snapshot instead of opened.
+/// The states of owner are taken to be as they were when saved.
+void StateMachine_restore(StateMachine self,
+                          OWNER        owner,
+                          State const  current);
+
+/// Index of the current state in states, a table of count states of the
+/// machine in an order of the user's choice, to be given back to
+/// StateMachine_restore() as states[ index ]. count if not in states.
+uint16_t StateMachine_save(StateMachine self,
+                           State const* states,
+                           uint16_t     count);
+
 /// Check if user is in given state.
 /// 2 if user is in given state,
 /// 1 if in sub state,
 /// 0 otherwise.
+/// The states of a machine are numbered as they become current, and the
+/// check is then a bit test, unless the machine has more than 62 states.
+/// A state belongs to one machine at a time, which may be created again
+/// over the same states.
 int StateMachine_isInState(StateMachine self, State const state);
 
 /// Current state accessor.
 State StateMachine_current(StateMachine self);
 
-/// Dispatch event.
+/// Dispatch event. A transition whose target is more than DEQUE_MAX_NODES
+/// states deep aborts.
 bool StateMachine_dispatch(StateMachine self, Signal e);
 
 /// Call when there is a default initialization state.
@@ -129,5 +207,52 @@ State StateMachine_topState(OWNER owner, Signal e);
 State StateMachine_handled(OWNER owner, Signal e);
 
 //==============================================================================
-#endif /* BASE_STATE_MACHINE_H_ */
+
+/**
+ * Caller provided memory that a machine and its states are created in, one
+ * after the other, instead of being malloc:ed one by one. Objects are not
+ * freed one by one, the memory is released as a whole by its provider.
+ */
+typedef struct
+{
+    unsigned char* next;
+    unsigned char* end;
+} SmArena;
+
+/// Aligned for any object of an arena. A State holds 64 bit masks, which
+/// some targets align beyond a pointer. An arena hands out whole numbers
+/// of it.
+typedef union
+{
+    void*    pointer;
+    uint64_t mask;
+    double   real;
+} SmArenaAlign;
+
+/// size bytes rounded up to whole SmArenaAlign.
+#define SM_ARENA_ROUND( size ) \
+    ( ( (size) + sizeof( SmArenaAlign ) - 1 ) / sizeof( SmArenaAlign ) * \
+      sizeof( SmArenaAlign ) )
+
+/// Bytes of an arena for one machine with given number of states.
+#define SM_ARENA_SIZE( states ) \
+    ( SM_ARENA_ROUND( sizeof( struct StateMachine_t ) ) + \
+      (states) * SM_ARENA_ROUND( sizeof( struct State ) ) )
+
+/// Define a static pool, suitably aligned, for SmArena_init().
+#define SM_ARENA_POOL( name, states ) \
+    static SmArenaAlign name[ SM_ARENA_SIZE( states ) / sizeof( SmArenaAlign ) ]
+
+/// Initialize arena to allocate from given memory, which shall be aligned
+/// as an SmArenaAlign, e.g. an SM_ARENA_POOL or memory from malloc().
+void SmArena_init( SmArena* self, void* memory, unsigned long size );
+
+/// Create a state in arena. Returns 0 if arena is full.
+State State_create( SmArena* arena, OWNER owner, StateFcn stateFcn );
+
+/// Create a state machine in arena. Returns 0 if arena is full.
+StateMachine StateMachine_create( SmArena* arena );
+
+//==============================================================================
+#endif /* BASE_STATE_MACHINE_C_H_ */
 //==============================================================================
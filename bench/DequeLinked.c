@@ -0,0 +1,112 @@
+/*
+* DequeLinked.c
+*
+* Copyright (c) 2010 Paul Osborne <osbpau@gmail.com>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*
+* The static linked deque that Deque.c used to be, kept for SmDequeBench.
+*/
+#include <stddef.h>
+#include "DequeLinked.h"
+
+void
+linked_deque_init(LinkedDeque d, int8_t(*compare_func)(const void*, const void*)) {
+	d->compare_func = compare_func;
+	d->head = NULL;
+	d->tail = NULL;
+	d->number_items = 0;
+
+	int i;
+	for (i = 0; i < LINKED_DEQUE_MAX_NODES; i++) {
+		d->nodes[i].value  = NULL;
+		d->nodes[i].next   = NULL;
+		d->nodes[i].prev   = NULL;
+		d->nodes[i].in_use = false;
+	}
+}
+
+static struct linked_deque_node_t *
+linked_deque_alloc_node(LinkedDeque d) {
+	struct linked_deque_node_t * node;
+	int i = 0;
+	/* find the first unused node */
+	while ((node = &d->nodes[i++])->in_use)
+		;
+	node->in_use = true;
+	return node;
+}
+
+int
+linked_deque_appendleft(LinkedDeque d, void* item) {
+	struct linked_deque_node_t *newNode = linked_deque_alloc_node(d);
+	newNode->next = d->tail;
+	newNode->prev = NULL;
+	newNode->value = item;
+
+	if (d->tail != NULL) {
+		d->tail->prev = newNode;
+	}
+	if (d->head == NULL) {
+		d->head = d->tail;
+	}
+	d->tail = newNode;
+	d->number_items++;
+	return 0;
+}
+
+void*
+linked_deque_popleft(LinkedDeque d) {
+	struct linked_deque_node_t *prevTail;
+	void* value;
+	if (d->tail == NULL) {
+		return NULL;
+	}
+	prevTail = d->tail;
+	d->tail = prevTail->next;
+	if (d->tail != NULL) {
+		d->tail->prev = NULL;
+	}
+	d->number_items--;
+	value = prevTail->value;
+	prevTail->in_use = false;
+	return value;
+}
+
+void
+linked_deque_popnleft(LinkedDeque d, uint32_t count) {
+	while (count) {
+		linked_deque_popleft(d);
+		count--;
+	}
+}
+
+uint32_t
+linked_deque_contains(LinkedDeque d, void* item) {
+	uint32_t pos = 1;
+	struct linked_deque_node_t *tmp = d->tail;
+	while (tmp != NULL) {
+		if ((d->compare_func)(tmp->value, item) == 0) {
+			return pos;
+		}
+		tmp = tmp->next;
+		pos++;
+	}
+	return 0;
+}
@@ -0,0 +1,58 @@
+/*
+* DequeLinked.h
+*
+* Copyright (c) 2010 Paul Osborne <osbpau@gmail.com>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*
+* The static linked deque that Deque.c used to be, kept for SmDequeBench. Only
+* the operations of StateMachine_dispatch are included.
+*/
+
+#ifndef DEQUE_LINKED_H
+#define DEQUE_LINKED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LINKED_DEQUE_MAX_NODES (16)
+
+struct linked_deque_node_t {
+	void* value;
+	struct linked_deque_node_t *next;
+	struct linked_deque_node_t *prev;
+	bool in_use;
+};
+
+struct linked_deque_t {
+	struct linked_deque_node_t *head;
+	struct linked_deque_node_t *tail;
+	uint32_t number_items;
+	int8_t(*compare_func)(const void *, const void *);
+	struct linked_deque_node_t nodes[LINKED_DEQUE_MAX_NODES];
+};
+
+typedef struct linked_deque_t *LinkedDeque;
+
+void     linked_deque_init(LinkedDeque d, int8_t(*compare_func)(const void*, const void*));
+int      linked_deque_appendleft(LinkedDeque d, void* item);
+void     linked_deque_popnleft(LinkedDeque d, uint32_t count);
+void*    linked_deque_popleft(LinkedDeque d);
+uint32_t linked_deque_contains(LinkedDeque d, void* item);
+#endif
@@ -0,0 +1,135 @@
+//=============================================- -*- C -*- ===================
+//
+// File Name     SmDequeBench.c
+// Author        Tommy Carlsson (topcatse)
+//
+// Benchmark of the ring buffer Deque against the linked one it replaced,
+// DequeLinked.c. Each round does what StateMachine_dispatch does with the
+// path of cases (e) - (g): init, appendleft depth states, contains, popnleft
+// and popleft of the rest.
+//
+// Build and run:
+//   gcc -std=c99 -O2 -DNDEBUG -I.. SmDequeBench.c DequeLinked.c ../Deque.c -o SmDequeBench
+//   ./SmDequeBench [rounds]
+//
+// One line per deque and depth: deque=<ring|linked> depth=<n> ns=<per round>
+//==============================================================================
+
+#if !defined ( _POSIX_C_SOURCE )
+#   define _POSIX_C_SOURCE 200112L
+#endif /* _POSIX_C_SOURCE */
+
+#include "Deque.h"
+#include "DequeLinked.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+enum { RUNS = 5, MAX_DEPTH = 12 };
+
+static int   states[ MAX_DEPTH ];
+static void* volatile sink;
+
+//------------------------------------------------------------------------------
+
+static int8_t compare( const void* a, const void* b )
+{
+   return a == b ? 0 : 1;
+}
+
+//------------------------------------------------------------------------------
+
+static double now( void )
+{
+   struct timespec t;
+   clock_gettime( CLOCK_MONOTONIC, &t );
+   return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+
+static void ring( unsigned long rounds, unsigned depth )
+{
+   struct deque_t d;
+   void*          state;
+   unsigned       i;
+
+   while ( rounds-- > 0 )
+   {
+      deque_init( &d, compare );
+      for ( i = 0; i < depth; ++i )
+      {
+         deque_appendleft( &d, &states[ i ] );
+      }
+      deque_popnleft( &d, deque_contains( &d, &states[ depth / 2 ] ) );
+      while ( ( state = deque_popleft( &d ) ) )
+      {
+         sink = state;
+      }
+   }
+}
+
+//------------------------------------------------------------------------------
+
+static void linked( unsigned long rounds, unsigned depth )
+{
+   struct linked_deque_t d;
+   void*                 state;
+   unsigned              i;
+
+   while ( rounds-- > 0 )
+   {
+      linked_deque_init( &d, compare );
+      for ( i = 0; i < depth; ++i )
+      {
+         linked_deque_appendleft( &d, &states[ i ] );
+      }
+      linked_deque_popnleft( &d, linked_deque_contains( &d, &states[ depth / 2 ] ) );
+      while ( ( state = linked_deque_popleft( &d ) ) )
+      {
+         sink = state;
+      }
+   }
+}
+
+//------------------------------------------------------------------------------
+
+static void measure( char const* name,
+                     void (*run)( unsigned long, unsigned ),
+                     unsigned long rounds,
+                     unsigned depth )
+{
+   double best = 0;
+   int    i;
+
+   run( rounds / 10, depth );
+   for ( i = 0; i < RUNS; ++i )
+   {
+      double start   = now();
+      run( rounds, depth );
+      double elapsed = ( now() - start ) / rounds;
+      if ( i == 0 || elapsed < best )
+      {
+         best = elapsed;
+      }
+   }
+
+   printf( "deque=%s depth=%u ns=%.2f\n", name, depth, best );
+}
+
+//==============================================================================
+
+int main( int argc, char* argv[] )
+{
+   unsigned long rounds = argc > 1 ? strtoul( argv[ 1 ], 0, 10 ) : 2000000;
+   unsigned      depth;
+
+   for ( depth = 2; depth <= MAX_DEPTH; depth += 2 )
+   {
+      measure( "ring",   ring,   rounds, depth );
+      measure( "linked", linked, rounds, depth );
+   }
+   return 0;
+}
+
+//==============================================================================
@@ -0,0 +1,731 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmDispatchBench.cpp
+// Author        Tommy Carlsson (topcatse)
+//
+// Dispatch benchmark of the C and C++ engines, one run per transition case
+// of dispatch (see SmDispatchBench.h). Engines:
+//   cpp       Base::StateMachine, hierarchy found by INQUIRE
+//   cpp_decl  Base::StateMachine, hierarchy declared in SmHierarchy
+//   cpp_jump  cpp_decl, with an SmJumpTable
+//   cpp_mask  cpp_decl, with the handled signals published
+//   cpp_pitch cpp, with an SmPitcherCache
+//   cpp_compact cpp_decl, with the SmCompact layout
+//   c         StateMachine_dispatch of StateMachine.c
+//   c_mask    c, with the handled signals published by State_handles()
+//
+// Build and run, from this directory:
+//   gcc -std=c99 -O2 -DNDEBUG -I.. -c ../StateMachine.c ../Deque.c SmDispatchBenchC.c
+//   g++ -std=c++11 -O2 -DNDEBUG -I.. SmDispatchBench.cpp StateMachine.o Deque.o SmDispatchBenchC.o -o SmDispatchBench
+//   ./SmDispatchBench [dispatches]
+//
+// Before timing, every engine is checked against cpp, case by case: the
+// dispatches handled, the actions run and the states ended in. A mismatch
+// is reported as engine=<e> case=<c> mismatch ..., and nothing is timed.
+//
+// One line per engine and case:
+//   engine=<e> case=<c> ns=<ns per dispatch> instructions=<per dispatch>
+//   allocs=<per dispatch>
+// instructions is na where perf events are not available.
+//==============================================================================
+
+#include "SmDispatchBench.h"
+#include "StateMachine.h"
+
+// ANSI/STL
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined ( __linux__ )
+#   include <linux/perf_event.h>
+#   include <sys/ioctl.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#endif /* __linux__ */
+
+//==============================================================================
+// Allocation counting. Replacing malloc counts the C engine as well as
+// operator new, which calls malloc.
+
+#if defined ( __GLIBC__ )
+
+extern "C" {
+
+void* __libc_malloc( std::size_t size );
+void* __libc_calloc( std::size_t count, std::size_t size );
+void* __libc_realloc( void* ptr, std::size_t size );
+void  __libc_free( void* ptr );
+
+static unsigned long allocations = 0;
+
+void* malloc( std::size_t size )
+{
+    ++allocations;
+    return __libc_malloc( size );
+}
+
+void* calloc( std::size_t count, std::size_t size )
+{
+    ++allocations;
+    return __libc_calloc( count, size );
+}
+
+void* realloc( void* ptr, std::size_t size )
+{
+    ++allocations;
+    return __libc_realloc( ptr, size );
+}
+
+void free( void* ptr )
+{
+    __libc_free( ptr );
+}
+
+} // extern "C"
+
+#   define SM_BENCH_ALLOCS 1
+#else
+static unsigned long allocations = 0;
+#   define SM_BENCH_ALLOCS 0
+#endif /* __GLIBC__ */
+
+//==============================================================================
+
+namespace {
+
+/// Counts user space instructions retired by the calling thread.
+class InstructionCounter
+{
+public:
+    InstructionCounter() : fd_( -1 )
+    {
+#if defined ( __linux__ )
+        perf_event_attr attr;
+        std::memset( &attr, 0, sizeof( attr ) );
+        attr.type           = PERF_TYPE_HARDWARE;
+        attr.size           = sizeof( attr );
+        attr.config         = PERF_COUNT_HW_INSTRUCTIONS;
+        attr.disabled       = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        fd_ = int( syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 ) );
+#endif /* __linux__ */
+    }
+
+    ~InstructionCounter()
+    {
+#if defined ( __linux__ )
+        if ( fd_ >= 0 )
+        {
+            close( fd_ );
+        }
+#endif /* __linux__ */
+    }
+
+    bool available() const { return fd_ >= 0; }
+
+    void start()
+    {
+#if defined ( __linux__ )
+        if ( fd_ >= 0 )
+        {
+            ioctl( fd_, PERF_EVENT_IOC_RESET, 0 );
+            ioctl( fd_, PERF_EVENT_IOC_ENABLE, 0 );
+        }
+#endif /* __linux__ */
+    }
+
+    unsigned long long stop()
+    {
+        unsigned long long count = 0;
+#if defined ( __linux__ )
+        if ( fd_ >= 0 )
+        {
+            ioctl( fd_, PERF_EVENT_IOC_DISABLE, 0 );
+            if ( read( fd_, &count, sizeof( count ) ) != sizeof( count ) )
+            {
+                count = 0;
+            }
+        }
+#endif /* __linux__ */
+        return count;
+    }
+
+private:
+    int fd_;
+};
+
+//------------------------------------------------------------------------------
+
+typedef Base::SmEvent<> E;
+
+/**
+ * The C++ engine machine, see SmDispatchBench.h. SELF is the OWNER, so
+ * that the same machine can be run with and without declared hierarchy.
+ */
+template < class SELF >
+class Bench : public Base::StateMachine< SELF >
+{
+    typedef Base::StateMachine< SELF > Machine;
+
+public:
+    typedef Base::StatePtr< SELF > S;
+
+    enum Ids { S0, S1, S11, S111, S1111, S12, S121, S2, S21, S211 };
+
+    enum Signals
+    {
+        SIG_A = SM_BENCH_SIGNAL( SM_BENCH_A ),
+        SIG_B = SM_BENCH_SIGNAL( SM_BENCH_B ),
+        SIG_C = SM_BENCH_SIGNAL( SM_BENCH_C ),
+        SIG_D = SM_BENCH_SIGNAL( SM_BENCH_D ),
+        SIG_E = SM_BENCH_SIGNAL( SM_BENCH_E ),
+        SIG_F = SM_BENCH_SIGNAL( SM_BENCH_F ),
+        SIG_G = SM_BENCH_SIGNAL( SM_BENCH_G ),
+        SIG_H = SM_BENCH_SIGNAL( SM_BENCH_H )
+    };
+
+    explicit Bench( SmBenchCase c ) : actions_( 0 )
+    {
+        SELF* self = static_cast< SELF* >( this );
+        s0_.init( self, &Bench::s0, S0 );
+        s1_.init( self, &Bench::s1, S1 );
+        s11_.init( self, &Bench::s11, S11 );
+        s111_.init( self, &Bench::s111, S111 );
+        s1111_.init( self, &Bench::s1111, S1111 );
+        s12_.init( self, &Bench::s12, S12 );
+        s121_.init( self, &Bench::s121, S121 );
+        s2_.init( self, &Bench::s2, S2 );
+        s21_.init( self, &Bench::s21, S21 );
+        s211_.init( self, &Bench::s211, S211 );
+        this->open( self, c == SM_BENCH_C ? s11_ : s111_ );
+    }
+
+    void run( SmBenchCase c, unsigned long count )
+    {
+        E e( SM_BENCH_SIGNAL( c ) );
+        while ( count-- > 0 )
+        {
+            this->dispatch( &e );
+        }
+    }
+
+    /// As run(), but returns how many of the dispatches were handled.
+    unsigned long check( SmBenchCase c, unsigned long count )
+    {
+        E             e( SM_BENCH_SIGNAL( c ) );
+        unsigned long handled = 0;
+        while ( count-- > 0 )
+        {
+            handled += this->dispatch( &e ) ? 1 : 0;
+        }
+        return handled;
+    }
+
+    unsigned long actions() const { return actions_; }
+
+    /// The states that the machine is in, bit n for state n of Ids.
+    unsigned states()
+    {
+        S* const states[] = { &s0_, &s1_, &s11_, &s111_, &s1111_,
+                              &s12_, &s121_, &s2_, &s21_, &s211_ };
+        unsigned bits = 0;
+        for ( unsigned i = 0; i < sizeof( states ) / sizeof( states[ 0 ] ); ++i )
+        {
+            if ( this->isInState( *states[ i ] ) )
+            {
+                bits |= 1u << i;
+            }
+        }
+        return bits;
+    }
+
+    S topState( E const* e = 0 ) { return Machine::topState( e ); }
+    S handled( E const* e = 0 )  { return Machine::handled( e ); }
+
+    S s0( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case Machine::ENTRY:
+        case Machine::EXIT:
+            ++actions_;
+            return handled();
+        }
+        return topState();
+    }
+
+    S s1( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case Machine::ENTRY:
+        case Machine::EXIT:
+            ++actions_;
+            return handled();
+        case SIG_E:
+            this->transition( s1111_ );
+            return handled();
+        }
+        return s0_;
+    }
+
+    S s11( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case Machine::ENTRY:
+        case Machine::EXIT:
+            ++actions_;
+            return handled();
+        case SIG_C:
+            this->transition( s12_ );
+            return handled();
+        case SIG_F:
+            this->transition( s121_ );
+            return handled();
+        }
+        return s1_;
+    }
+
+    S s111( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case Machine::INIT:
+            this->initializer( s1111_ );
+            return handled();
+        case Machine::ENTRY:
+        case Machine::EXIT:
+            ++actions_;
+            return handled();
+        case SIG_B:
+            this->transition( s1111_ );
+            return handled();
+        }
+        return s11_;
+    }
+
+    S s1111( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case Machine::ENTRY:
+        case Machine::EXIT:
+            ++actions_;
+            return handled();
+        case SIG_A:
+            this->transition( s1111_ );
+            return handled();
+        case SIG_D:
+            this->transition( s111_ );
+            return handled();
+        case SIG_G:
+            this->transition( s211_ );
+            return handled();
+        case SIG_H:
+            ++actions_;
+            return handled();
+        }
+        return s111_;
+    }
+
+    S s12( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case Machine::ENTRY:
+        case Machine::EXIT:
+            ++actions_;
+            return handled();
+        case SIG_C:
+            this->transition( s11_ );
+            return handled();
+        case SIG_F:
+            this->transition( s111_ );
+            return handled();
+        }
+        return s1_;
+    }
+
+    S s121( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case Machine::ENTRY:
+        case Machine::EXIT:
+            ++actions_;
+            return handled();
+        }
+        return s12_;
+    }
+
+    S s2( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case Machine::ENTRY:
+        case Machine::EXIT:
+            ++actions_;
+            return handled();
+        }
+        return s0_;
+    }
+
+    S s21( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case Machine::ENTRY:
+        case Machine::EXIT:
+            ++actions_;
+            return handled();
+        }
+        return s2_;
+    }
+
+    S s211( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case Machine::ENTRY:
+        case Machine::EXIT:
+            ++actions_;
+            return handled();
+        case SIG_G:
+            this->transition( s1111_ );
+            return handled();
+        }
+        return s21_;
+    }
+
+private:
+    S s0_, s1_, s11_, s111_, s1111_, s12_, s121_, s2_, s21_, s211_;
+    unsigned long actions_;
+};
+
+/// Hierarchy found by INQUIRE.
+class CppBench : public Bench< CppBench >
+{
+public:
+    explicit CppBench( SmBenchCase c ) : Bench< CppBench >( c ) {}
+};
+
+/// Hierarchy found by INQUIRE, pitchers memoized.
+class PitchBench : public Bench< PitchBench >
+{
+public:
+    explicit PitchBench( SmBenchCase c ) : Bench< PitchBench >( c ) {}
+};
+
+/// Hierarchy declared below.
+class DeclBench : public Bench< DeclBench >
+{
+public:
+    explicit DeclBench( SmBenchCase c ) : Bench< DeclBench >( c ) {}
+};
+
+/// Hierarchy declared and jump table enabled below.
+class JumpBench : public Bench< JumpBench >
+{
+public:
+    explicit JumpBench( SmBenchCase c ) : Bench< JumpBench >( c ) {}
+};
+
+class CompactBench;
+
+} // namespace
+
+/// The layout is decided by the time the machine class is defined.
+namespace Base {
+
+template <>
+struct SmCompact< CompactBench >
+{
+    SM_STATIC_CONSTANT( bool, enabled = true );
+};
+
+} // namespace Base
+
+namespace {
+
+/// Hierarchy declared below, compact layout.
+class CompactBench : public Bench< CompactBench >
+{
+public:
+    explicit CompactBench( SmBenchCase c ) : Bench< CompactBench >( c ) {}
+};
+
+/// Hierarchy and handled signals declared below.
+class MaskBench : public Bench< MaskBench >
+{
+public:
+    explicit MaskBench( SmBenchCase c ) : Bench< MaskBench >( c ) {}
+};
+
+/// The hierarchy of Bench< SELF >, with the handled signals if MASKED.
+template < class SELF, bool MASKED = false >
+struct BenchHierarchy
+{
+    typedef Bench< SELF > B;
+
+    /// signals if MASKED, else unpublished.
+    static constexpr Base::SmSignalMask mask( Base::SmSignalMask signals )
+    {
+        return MASKED ? signals : 0;
+    }
+
+    SM_STATIC_CONSTANT( bool, declared = true );
+    static constexpr Base::SmStateDecl< SELF > states[] =
+    {
+        { &B::s0,    Base::SM_TOP_ID, mask( Base::smSignals() ) },
+        { &B::s1,    B::S0,    mask( Base::smSignals( B::SIG_E ) ) },
+        { &B::s11,   B::S1,    mask( Base::smSignals( B::SIG_C, B::SIG_F ) ) },
+        { &B::s111,  B::S11,   mask( Base::smSignals( B::SIG_B ) ) },
+        { &B::s1111, B::S111,  mask( Base::smSignals( B::SIG_A, B::SIG_D,
+                                                      B::SIG_G, B::SIG_H ) ) },
+        { &B::s12,   B::S1,    mask( Base::smSignals( B::SIG_C, B::SIG_F ) ) },
+        { &B::s121,  B::S12,   mask( Base::smSignals() ) },
+        { &B::s2,    B::S0,    mask( Base::smSignals() ) },
+        { &B::s21,   B::S2,    mask( Base::smSignals() ) },
+        { &B::s211,  B::S21,   mask( Base::smSignals( B::SIG_G ) ) }
+    };
+};
+
+template < class SELF, bool MASKED >
+constexpr Base::SmStateDecl< SELF > BenchHierarchy< SELF, MASKED >::states[];
+
+} // namespace
+
+//------------------------------------------------------------------------------
+
+namespace Base {
+
+template <>
+struct SmHierarchy< DeclBench > : BenchHierarchy< DeclBench > {};
+
+template <>
+struct SmHierarchy< JumpBench > : BenchHierarchy< JumpBench > {};
+
+template <>
+struct SmHierarchy< CompactBench > : BenchHierarchy< CompactBench > {};
+
+template <>
+struct SmHierarchy< MaskBench > : BenchHierarchy< MaskBench, true > {};
+
+template <>
+struct SmPitcherCache< PitchBench >
+{
+    SM_STATIC_CONSTANT( bool, enabled = true );
+};
+
+template <>
+struct SmJumpTable< JumpBench >
+{
+    SM_STATIC_CONSTANT( unsigned, signals = SM_BENCH_SIGNAL( SM_BENCH_CASES ) );
+};
+
+} // namespace Base
+
+//==============================================================================
+
+namespace {
+
+/// C engine behind the same interface as the C++ ones.
+class CBench
+{
+public:
+    explicit CBench( SmBenchCase c, int masked = 0 )
+        : machine_( SmBenchC_open( c, masked ) )
+    {}
+    ~CBench() { SmBenchC_close( machine_ ); }
+
+    void run( SmBenchCase c, unsigned long count )
+    {
+        SmBenchC_run( machine_, c, count );
+    }
+
+    unsigned long check( SmBenchCase c, unsigned long count )
+    {
+        return SmBenchC_check( machine_, c, count );
+    }
+
+    unsigned long actions() const { return SmBenchC_actions( machine_ ); }
+    unsigned states() { return SmBenchC_states( machine_ ); }
+
+private:
+    CBench( CBench const& );
+    CBench& operator=( CBench const& );
+
+    void* machine_;
+};
+
+/// C engine, with the handled signals published.
+class CMaskBench : public CBench
+{
+public:
+    explicit CMaskBench( SmBenchCase c ) : CBench( c, 1 ) {}
+};
+
+//------------------------------------------------------------------------------
+
+/// What dispatching a case to a fresh machine comes to.
+struct Outcome
+{
+    unsigned long handled;
+    unsigned long actions;
+    unsigned      states;
+};
+
+/// Dispatch count signals of case c to a fresh MACHINE.
+template < class MACHINE >
+Outcome
+outcome( SmBenchCase c, unsigned long count )
+{
+    MACHINE machine( c );
+    Outcome result;
+    result.handled = machine.check( c, count );
+    result.actions = machine.actions();
+    result.states  = machine.states();
+    return result;
+}
+
+/// Compare case c of MACHINE with that of cpp. Returns false, reporting
+/// the difference, if they differ.
+template < class MACHINE >
+bool
+check( char const* engine, SmBenchCase c )
+{
+    static char const* const names[ SM_BENCH_CASES ] =
+        { "a", "b", "c", "d", "e", "f", "g", "h", "none" };
+
+    // Odd, so that the cases that go back and forth end up away.
+    unsigned long const count = 101;
+
+    Outcome expected = outcome< CppBench >( c, count );
+    Outcome actual   = outcome< MACHINE >( c, count );
+    if ( actual.handled == expected.handled &&
+         actual.actions == expected.actions &&
+         actual.states  == expected.states )
+    {
+        return true;
+    }
+
+    std::printf( "engine=%s case=%s mismatch handled=%lu/%lu actions=%lu/%lu"
+                 " states=%#x/%#x\n", engine, names[ c ],
+                 actual.handled, expected.handled,
+                 actual.actions, expected.actions,
+                 actual.states, expected.states );
+    return false;
+}
+
+//------------------------------------------------------------------------------
+
+/// Best of a few runs of count dispatches.
+template < class MACHINE >
+void
+measure( char const*         engine,
+         SmBenchCase         c,
+         unsigned long       count,
+         InstructionCounter& instructions )
+{
+    static char const* const names[ SM_BENCH_CASES ] =
+        { "a", "b", "c", "d", "e", "f", "g", "h", "none" };
+
+    MACHINE machine( c );
+
+    // Warm up, caches included.
+    machine.run( c, count / 10 + 1 );
+
+    double             best  = 1e300;
+    unsigned long long insns = ~0ULL;
+    unsigned long      allocs = 0;
+
+    for ( int i = 0; i < 5; ++i )
+    {
+        unsigned long before = allocations;
+
+        instructions.start();
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+
+        machine.run( c, count );
+
+        std::chrono::duration< double, std::nano > elapsed =
+            std::chrono::steady_clock::now() - start;
+        insns = std::min( insns, instructions.stop() );
+
+        allocs = std::max( allocs, allocations - before );
+        best   = std::min( best, elapsed.count() );
+    }
+
+    std::printf( "engine=%s case=%s ns=%.2f", engine, names[ c ],
+                 best / count );
+    if ( instructions.available() )
+    {
+        std::printf( " instructions=%.1f", double( insns ) / count );
+    }
+    else
+    {
+        std::printf( " instructions=na" );
+    }
+    if ( SM_BENCH_ALLOCS )
+    {
+        std::printf( " allocs=%.3f\n", double( allocs ) / count );
+    }
+    else
+    {
+        std::printf( " allocs=na\n" );
+    }
+    std::fflush( stdout );
+}
+
+} // namespace
+
+//==============================================================================
+
+int
+main( int argc, char* argv[] )
+{
+    unsigned long count = argc > 1 ? std::strtoul( argv[ 1 ], 0, 10 ) : 1000000;
+    if ( count == 0 )
+    {
+        count = 1;
+    }
+
+    bool same = true;
+    for ( int c = 0; c < SM_BENCH_CASES; ++c )
+    {
+        SmBenchCase bc = SmBenchCase( c );
+        same = check< DeclBench >( "cpp_decl", bc ) && same;
+        same = check< JumpBench >( "cpp_jump", bc ) && same;
+        same = check< MaskBench >( "cpp_mask", bc ) && same;
+        same = check< PitchBench >( "cpp_pitch", bc ) && same;
+        same = check< CompactBench >( "cpp_compact", bc ) && same;
+        same = check< CBench >( "c", bc ) && same;
+        same = check< CMaskBench >( "c_mask", bc ) && same;
+    }
+    if ( !same )
+    {
+        return 1;
+    }
+
+    InstructionCounter instructions;
+
+    for ( int c = 0; c < SM_BENCH_CASES; ++c )
+    {
+        SmBenchCase bc = SmBenchCase( c );
+        measure< CppBench >( "cpp", bc, count, instructions );
+        measure< DeclBench >( "cpp_decl", bc, count, instructions );
+        measure< JumpBench >( "cpp_jump", bc, count, instructions );
+        measure< MaskBench >( "cpp_mask", bc, count, instructions );
+        measure< PitchBench >( "cpp_pitch", bc, count, instructions );
+        measure< CompactBench >( "cpp_compact", bc, count, instructions );
+        measure< CBench >( "c", bc, count, instructions );
+        measure< CMaskBench >( "c_mask", bc, count, instructions );
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+//=============================================- -*- C -*- ===================
+//
+// File Name     SmDispatchBench.h
+// Author        Tommy Carlsson (topcatse)
+//
+// This file contains the interface between the dispatch benchmark driver
+// and its C engine machine.
+//==============================================================================
+#if !defined ( BASE_SM_DISPATCH_BENCH_H_ )
+#define BASE_SM_DISPATCH_BENCH_H_
+//==============================================================================
+
+#if defined ( __cplusplus )
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * The benchmarked dispatch cases, named after the transition cases of
+ * dispatch. Both engines run the same machine:
+ *
+ *   s0 --+-- s1 --+-- s11 ---- s111 ---- s1111
+ *        |        +-- s12 ---- s121
+ *        +-- s2 ---- s21 ---- s211
+ *
+ * (a) s1111 -> s1111, handled in s1111
+ * (b) s1111 -> s1111, handled in s111
+ * (c) s11 -> s12 and back
+ * (d) s1111 -> s111, which initializes to s1111
+ * (e) s1111 -> s1111, handled in s1
+ * (f) s11 -> s121 and s12 -> s111, from s1111
+ * (g) s1111 -> s211 and back
+ * (h) internal transition in s1111
+ * SM_BENCH_NONE is a signal that no state handles.
+ */
+typedef enum
+{
+    SM_BENCH_A,
+    SM_BENCH_B,
+    SM_BENCH_C,
+    SM_BENCH_D,
+    SM_BENCH_E,
+    SM_BENCH_F,
+    SM_BENCH_G,
+    SM_BENCH_H,
+    SM_BENCH_NONE,
+    SM_BENCH_CASES
+} SmBenchCase;
+
+/// The signal of a case, numbered from the engines' USER_START.
+#define SM_BENCH_SIGNAL( c ) ( 3 + (c) )
+
+/// Create a C engine machine, in the start state of case c. If masked,
+/// its states publish the signals they handle (see State_handles()).
+void* SmBenchC_open( SmBenchCase c, int masked );
+
+/// Dispatch the signal of case c count times.
+void SmBenchC_run( void* machine, SmBenchCase c, unsigned long count );
+
+/// As SmBenchC_run(), but returns how many of the dispatches were handled,
+/// for checking the engines against each other.
+unsigned long SmBenchC_check( void* machine, SmBenchCase c, unsigned long count );
+
+/// ENTRY and EXIT actions, and internal transitions (h), run so far.
+unsigned long SmBenchC_actions( void* machine );
+
+/// The states that the machine is in, bit n for state n of s0, s1, s11,
+/// s111, s1111, s12, s121, s2, s21, s211.
+unsigned SmBenchC_states( void* machine );
+
+/// Destroy a machine created by SmBenchC_open().
+void SmBenchC_close( void* machine );
+
+#if defined ( __cplusplus )
+}
+#endif /* __cplusplus */
+
+//==============================================================================
+#endif /* BASE_SM_DISPATCH_BENCH_H_ */
+//==============================================================================
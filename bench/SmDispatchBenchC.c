@@ -0,0 +1,385 @@
+//=============================================- -*- C -*- ===================
+//
+// File Name     SmDispatchBenchC.c
+// Author        Tommy Carlsson
+//
+// This file contains the C engine machine of the dispatch benchmark, see
+// SmDispatchBench.h.
+//
+//==============================================================================
+
+#include "SmDispatchBench.h"
+#include "StateMachineC.h"
+#include <stdlib.h>
+
+#define HANDLED() StateMachine_handled(t, SM_DUMMY)
+
+typedef struct
+{
+   State s0;
+   State s1;
+   State s11;
+   State s111;
+   State s1111;
+   State s12;
+   State s121;
+   State s2;
+   State s21;
+   State s211;
+   StateMachine sm;
+   unsigned long actions;
+} Bench;
+
+typedef enum
+{
+   SIG_A = SM_BENCH_SIGNAL( SM_BENCH_A ),
+   SIG_B = SM_BENCH_SIGNAL( SM_BENCH_B ),
+   SIG_C = SM_BENCH_SIGNAL( SM_BENCH_C ),
+   SIG_D = SM_BENCH_SIGNAL( SM_BENCH_D ),
+   SIG_E = SM_BENCH_SIGNAL( SM_BENCH_E ),
+   SIG_F = SM_BENCH_SIGNAL( SM_BENCH_F ),
+   SIG_G = SM_BENCH_SIGNAL( SM_BENCH_G ),
+   SIG_H = SM_BENCH_SIGNAL( SM_BENCH_H )
+} BenchSignals;
+
+//------------------------------------------------------------------------------
+
+static State Bench_s0(OWNER owner, Signal e)
+{
+   Bench* t = owner;
+
+   switch (e)
+   {
+      case SM_ENTRY:
+      case SM_EXIT:
+         ++t->actions;
+         return HANDLED();
+      default:
+         break;
+   }
+
+   return StateMachine_topState(t, SM_DUMMY);
+}
+
+//------------------------------------------------------------------------------
+
+static State Bench_s1(OWNER owner, Signal e)
+{
+   Bench* t = owner;
+
+   switch (e)
+   {
+      case SM_ENTRY:
+      case SM_EXIT:
+         ++t->actions;
+         return HANDLED();
+      case SIG_E:
+         StateMachine_transition(t->sm, t->s1111);
+         return HANDLED();
+      default:
+         break;
+   }
+
+   return t->s0;
+}
+
+//------------------------------------------------------------------------------
+
+static State Bench_s11(OWNER owner, Signal e)
+{
+   Bench* t = owner;
+
+   switch (e)
+   {
+      case SM_ENTRY:
+      case SM_EXIT:
+         ++t->actions;
+         return HANDLED();
+      case SIG_C:
+         StateMachine_transition(t->sm, t->s12);
+         return HANDLED();
+      case SIG_F:
+         StateMachine_transition(t->sm, t->s121);
+         return HANDLED();
+      default:
+         break;
+   }
+
+   return t->s1;
+}
+
+//------------------------------------------------------------------------------
+
+static State Bench_s111(OWNER owner, Signal e)
+{
+   Bench* t = owner;
+
+   switch (e)
+   {
+      case SM_INIT:
+         StateMachine_initializer(t->sm, t->s1111);
+         return HANDLED();
+      case SM_ENTRY:
+      case SM_EXIT:
+         ++t->actions;
+         return HANDLED();
+      case SIG_B:
+         StateMachine_transition(t->sm, t->s1111);
+         return HANDLED();
+      default:
+         break;
+   }
+
+   return t->s11;
+}
+
+//------------------------------------------------------------------------------
+
+static State Bench_s1111(OWNER owner, Signal e)
+{
+   Bench* t = owner;
+
+   switch (e)
+   {
+      case SM_ENTRY:
+      case SM_EXIT:
+         ++t->actions;
+         return HANDLED();
+      case SIG_A:
+         StateMachine_transition(t->sm, t->s1111);
+         return HANDLED();
+      case SIG_D:
+         StateMachine_transition(t->sm, t->s111);
+         return HANDLED();
+      case SIG_G:
+         StateMachine_transition(t->sm, t->s211);
+         return HANDLED();
+      case SIG_H:
+         ++t->actions;
+         return HANDLED();
+      default:
+         break;
+   }
+
+   return t->s111;
+}
+
+//------------------------------------------------------------------------------
+
+static State Bench_s12(OWNER owner, Signal e)
+{
+   Bench* t = owner;
+
+   switch (e)
+   {
+      case SM_ENTRY:
+      case SM_EXIT:
+         ++t->actions;
+         return HANDLED();
+      case SIG_C:
+         StateMachine_transition(t->sm, t->s11);
+         return HANDLED();
+      case SIG_F:
+         StateMachine_transition(t->sm, t->s111);
+         return HANDLED();
+      default:
+         break;
+   }
+
+   return t->s1;
+}
+
+//------------------------------------------------------------------------------
+
+static State Bench_s121(OWNER owner, Signal e)
+{
+   Bench* t = owner;
+
+   switch (e)
+   {
+      case SM_ENTRY:
+      case SM_EXIT:
+         ++t->actions;
+         return HANDLED();
+      default:
+         break;
+   }
+
+   return t->s12;
+}
+
+//------------------------------------------------------------------------------
+
+static State Bench_s2(OWNER owner, Signal e)
+{
+   Bench* t = owner;
+
+   switch (e)
+   {
+      case SM_ENTRY:
+      case SM_EXIT:
+         ++t->actions;
+         return HANDLED();
+      default:
+         break;
+   }
+
+   return t->s0;
+}
+
+//------------------------------------------------------------------------------
+
+static State Bench_s21(OWNER owner, Signal e)
+{
+   Bench* t = owner;
+
+   switch (e)
+   {
+      case SM_ENTRY:
+      case SM_EXIT:
+         ++t->actions;
+         return HANDLED();
+      default:
+         break;
+   }
+
+   return t->s2;
+}
+
+//------------------------------------------------------------------------------
+
+static State Bench_s211(OWNER owner, Signal e)
+{
+   Bench* t = owner;
+
+   switch (e)
+   {
+      case SM_ENTRY:
+      case SM_EXIT:
+         ++t->actions;
+         return HANDLED();
+      case SIG_G:
+         StateMachine_transition(t->sm, t->s1111);
+         return HANDLED();
+      default:
+         break;
+   }
+
+   return t->s21;
+}
+
+//==============================================================================
+
+void* SmBenchC_open( SmBenchCase c, int masked )
+{
+   Bench* t = malloc( sizeof( Bench ) );
+
+   t->s0    = State_ctor( t, Bench_s0 );
+   t->s1    = State_ctor( t, Bench_s1 );
+   t->s11   = State_ctor( t, Bench_s11 );
+   t->s111  = State_ctor( t, Bench_s111 );
+   t->s1111 = State_ctor( t, Bench_s1111 );
+   t->s12   = State_ctor( t, Bench_s12 );
+   t->s121  = State_ctor( t, Bench_s121 );
+   t->s2    = State_ctor( t, Bench_s2 );
+   t->s21   = State_ctor( t, Bench_s21 );
+   t->s211  = State_ctor( t, Bench_s211 );
+   t->sm    = StateMachine_ctor();
+   t->actions = 0;
+
+   if ( masked )
+   {
+      State_handles( t->s0,    0 );
+      State_handles( t->s1,    SM_SIGNAL( SIG_E ) );
+      State_handles( t->s11,   SM_SIGNAL( SIG_C ) | SM_SIGNAL( SIG_F ) );
+      State_handles( t->s111,  SM_SIGNAL( SIG_B ) );
+      State_handles( t->s1111, SM_SIGNAL( SIG_A ) | SM_SIGNAL( SIG_D ) |
+                               SM_SIGNAL( SIG_G ) | SM_SIGNAL( SIG_H ) );
+      State_handles( t->s12,   SM_SIGNAL( SIG_C ) | SM_SIGNAL( SIG_F ) );
+      State_handles( t->s121,  0 );
+      State_handles( t->s2,    0 );
+      State_handles( t->s21,   0 );
+      State_handles( t->s211,  SM_SIGNAL( SIG_G ) );
+   }
+
+   StateMachine_open( t->sm, t, c == SM_BENCH_C ? t->s11 : t->s111 );
+   return t;
+}
+
+//------------------------------------------------------------------------------
+
+void SmBenchC_run( void* machine, SmBenchCase c, unsigned long count )
+{
+   Bench* t = machine;
+   Signal e = SM_BENCH_SIGNAL( c );
+
+   while ( count-- > 0 )
+   {
+      StateMachine_dispatch( t->sm, e );
+   }
+}
+
+//------------------------------------------------------------------------------
+
+unsigned long SmBenchC_check( void* machine, SmBenchCase c, unsigned long count )
+{
+   Bench*        t       = machine;
+   Signal        e       = SM_BENCH_SIGNAL( c );
+   unsigned long handled = 0;
+
+   while ( count-- > 0 )
+   {
+      handled += StateMachine_dispatch( t->sm, e ) ? 1 : 0;
+   }
+   return handled;
+}
+
+//------------------------------------------------------------------------------
+
+unsigned long SmBenchC_actions( void* machine )
+{
+   Bench* t = machine;
+   return t->actions;
+}
+
+//------------------------------------------------------------------------------
+
+unsigned SmBenchC_states( void* machine )
+{
+   Bench* t = machine;
+   State  states[] = { t->s0, t->s1, t->s11, t->s111, t->s1111,
+                       t->s12, t->s121, t->s2, t->s21, t->s211 };
+   unsigned bits = 0;
+   unsigned i;
+
+   for ( i = 0; i < sizeof( states ) / sizeof( states[ 0 ] ); ++i )
+   {
+      if ( StateMachine_isInState( t->sm, states[ i ] ) )
+      {
+         bits |= 1u << i;
+      }
+   }
+   return bits;
+}
+
+//------------------------------------------------------------------------------
+
+void SmBenchC_close( void* machine )
+{
+   Bench* t = machine;
+
+   StateMachine_dtor( t->sm );
+   free( t->s0 );
+   free( t->s1 );
+   free( t->s11 );
+   free( t->s111 );
+   free( t->s1111 );
+   free( t->s12 );
+   free( t->s121 );
+   free( t->s2 );
+   free( t->s21 );
+   free( t->s211 );
+   free( t );
+}
+
+//==============================================================================
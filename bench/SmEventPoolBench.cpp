@@ -0,0 +1,204 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmEventPoolBench.cpp
+// Author        Tommy Carlsson (topcatse)
+//
+// Benchmark of SmEventPool against events and payloads taken from the
+// heap. A producer thread makes order events and posts them to an active
+// object that a consumer thread pumps; the consumer frees or releases
+// them. Heap allocations are counted once the first round has warmed up.
+//
+// Build and run:
+//   g++ -std=c++17 -O2 -DNDEBUG -I.. -pthread SmEventPoolBench.cpp -o SmEventPoolBench
+//   ./SmEventPoolBench [events]
+//
+// One line per way to make events: events=<heap|pool> ns_per_event=<n>
+// allocations=<in steady state> total=<checksum>
+//==============================================================================
+
+#include "SmActiveObject.h"
+#include "SmEventPool.h"
+
+// ANSI/STL
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+//==============================================================================
+
+namespace {
+
+std::atomic< unsigned long > allocations( 0 );
+
+} // namespace
+
+void* operator new( std::size_t size )
+{
+    allocations.fetch_add( 1, std::memory_order_relaxed );
+    if ( void* p = std::malloc( size ? size : 1 ) )
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete( void* p ) noexcept
+{
+    std::free( p );
+}
+
+void operator delete( void* p, std::size_t ) noexcept
+{
+    std::free( p );
+}
+
+//==============================================================================
+
+namespace {
+
+enum { RUNS = 5, CAPACITY = 256 };
+
+/// First signal after the standard ones.
+enum { ORDER = 3 };
+
+struct Order
+{
+    Order( unsigned i, unsigned q, double p ) : id( i ), quantity( q ), price( p ) {}
+
+    unsigned id;
+    unsigned quantity;
+    double   price;
+};
+
+typedef Base::SmEvent< Order >     OrderEvent;
+typedef Base::SmEventPool< Order > Pool;
+
+//------------------------------------------------------------------------------
+
+/// Sums the orders; frees them unless pooled.
+class Book : public Base::SmActiveObject< Book, Order, CAPACITY >
+{
+    typedef Base::StatePtr< Book, Order > S;
+
+public:
+    explicit Book( bool pooled ) : pooled_( pooled ), total_( 0 )
+    {
+        open( this, S( &Book::accepting ) );
+    }
+
+    double total() const { return total_; }
+
+private:
+    S accepting( OrderEvent const* e )
+    {
+        if ( e->signal() == ORDER )
+        {
+            total_ += e->get()->quantity * e->get()->price;
+            if ( !pooled_ )
+            {
+                delete e->get();
+                delete e;
+            }
+            return handled();
+        }
+        return topState();
+    }
+
+    bool   pooled_;
+    double total_;
+};
+
+//------------------------------------------------------------------------------
+
+typedef std::chrono::steady_clock Clock;
+
+OrderEvent* makeHeap( unsigned i )
+{
+    return new OrderEvent( ORDER, new Order( i, 1 + i % 10, 0.5 ) );
+}
+
+OrderEvent* makePool( unsigned i )
+{
+    return Pool::make( ORDER, i, 1 + i % 10, 0.5 );
+}
+
+//------------------------------------------------------------------------------
+
+double run( OrderEvent* (*make)( unsigned ),
+            bool           pooled,
+            unsigned long  events,
+            double&        total )
+{
+    Book book( pooled );
+
+    Clock::time_point start = Clock::now();
+    std::thread producer( [ & ]
+    {
+        for ( unsigned long i = 0; i < events; ++i )
+        {
+            book.post( make( static_cast< unsigned >( i ) ) );
+        }
+    } );
+
+    for ( unsigned long done = 0; done < events; )
+    {
+        std::size_t count = book.pump();
+        if ( count == 0 )
+        {
+            std::this_thread::yield();
+        }
+        done += count;
+    }
+    producer.join();
+    double elapsed = std::chrono::duration< double, std::nano >( Clock::now() - start ).count();
+
+    total = book.total();
+    return elapsed;
+}
+
+//------------------------------------------------------------------------------
+
+void measure( char const*    name,
+              OrderEvent*    (*make)( unsigned ),
+              bool           pooled,
+              unsigned long  events )
+{
+    double        total = 0;
+    double        best  = 0;
+    unsigned long steady = 0;
+
+    for ( int i = 0; i < RUNS; ++i )
+    {
+        unsigned long before  = allocations.load();
+        double        elapsed = run( make, pooled, events, total ) / events;
+        if ( i == RUNS - 1 )
+        {
+            // Less the thread and the machine of the run.
+            steady = allocations.load() - before;
+        }
+        if ( i == 0 || elapsed < best )
+        {
+            best = elapsed;
+        }
+    }
+
+    std::printf( "events=%s ns_per_event=%.2f allocations=%lu total=%.1f\n",
+                 name, best, steady, total );
+}
+
+} // namespace
+
+//==============================================================================
+
+int main( int argc, char* argv[] )
+{
+    unsigned long events = argc > 1 ? std::strtoul( argv[ 1 ], 0, 10 ) : 1000000;
+
+    measure( "heap", makeHeap, false, events );
+    measure( "pool", makePool, true,  events );
+    return 0;
+}
+
+//==============================================================================
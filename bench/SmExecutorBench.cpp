@@ -0,0 +1,228 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmExecutorBench.cpp
+// Author        Tommy Carlsson (topcatse)
+//
+// Scaling benchmark of SmExecutor. A few thousand active objects forward
+// events to each other; the run is repeated with 1, 2, 4, ... workers.
+//
+// Build and run:
+//   g++ -std=c++17 -O2 -DNDEBUG -I.. -pthread SmExecutorBench.cpp -o SmExecutorBench
+//   ./SmExecutorBench [machines] [hops] [max workers]
+//
+// One line per run: workers=<n> events=<n> seconds=<s> events_per_sec=<n>
+// speedup=<x>, relative to 1 worker. Workers beyond the number of cores
+// only share them, so read speedup only up to that.
+//==============================================================================
+
+#include "SmActiveObject.h"
+
+// ANSI/STL
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+//==============================================================================
+
+namespace {
+
+/// First signal after the standard ones.
+enum { HOP = 3 };
+
+class Node;
+
+/// Pre-allocated events, one per token in flight.
+struct Token : public Base::SmEvent<>
+{
+    Token() : Base::SmEvent<>( HOP ), hops( 0 ), seed( 0 ) {}
+
+    unsigned hops;
+    unsigned seed;
+};
+
+std::vector< Node* >     nodes;
+std::atomic< unsigned >  alive( 0 );
+std::atomic< unsigned >  dispatched( 0 );
+
+//------------------------------------------------------------------------------
+
+/**
+ * Toggles between two states on every event, does some busy work and
+ * forwards the token to a pseudo random node.
+ */
+class Node : public Base::SmActiveObject< Node, int, 64 >
+{
+    typedef Base::StatePtr< Node >       S;
+    typedef Base::SmEvent<>              E;
+    typedef Base::StateMachine< Node >   Machine;
+
+public:
+    Node() : inside_( false ), work_( 0 )
+    {
+        even_.init( this, &Node::even );
+        odd_.init( this, &Node::odd );
+        open( this, even_ );
+    }
+
+    unsigned work() const { return work_; }
+
+private:
+    S even( E const* e )
+    {
+        if ( e->signal() == HOP )
+        {
+            hop( e );
+            transition( odd_ );
+            return handled();
+        }
+        return topState();
+    }
+
+    S odd( E const* e )
+    {
+        if ( e->signal() == HOP )
+        {
+            hop( e );
+            transition( even_ );
+            return handled();
+        }
+        return topState();
+    }
+
+    void hop( E const* e )
+    {
+        // Never dispatched on two threads at once.
+        if ( inside_.exchange( true, std::memory_order_relaxed ) )
+        {
+            std::fprintf( stderr, "concurrent dispatch\n" );
+            std::abort();
+        }
+
+        Token* token = const_cast< Token* >( static_cast< Token const* >( e ) );
+
+        unsigned x = token->seed;
+        for ( unsigned i = 0; i < 200; ++i )
+        {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+        }
+        work_ += x;
+        token->seed = x;
+        dispatched.fetch_add( 1, std::memory_order_relaxed );
+
+        inside_.store( false, std::memory_order_relaxed );
+
+        if ( --token->hops )
+        {
+            nodes[ x % nodes.size() ]->post( token, Base::SM_SPIN );
+        }
+        else
+        {
+            alive.fetch_sub( 1, std::memory_order_release );
+        }
+    }
+
+    S even_, odd_;
+    std::atomic< bool > inside_;
+    unsigned            work_;
+};
+
+//------------------------------------------------------------------------------
+
+double
+measure( unsigned workers, unsigned hops, std::vector< Token >& tokens )
+{
+    dispatched.store( 0 );
+    alive.store( unsigned( tokens.size() ) );
+
+    Base::SmExecutor executor( workers );
+    for ( std::size_t i = 0; i < nodes.size(); ++i )
+    {
+        nodes[ i ]->attach( &executor );
+    }
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    for ( std::size_t i = 0; i < tokens.size(); ++i )
+    {
+        tokens[ i ].hops = hops;
+        tokens[ i ].seed = unsigned( i ) + 1;
+        nodes[ i % nodes.size() ]->post( &tokens[ i ], Base::SM_SPIN );
+    }
+
+    while ( alive.load( std::memory_order_acquire ) )
+    {
+        std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+    }
+
+    std::chrono::duration< double > elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    executor.stop();
+    return elapsed.count();
+}
+
+} // namespace
+
+//==============================================================================
+
+int
+main( int argc, char* argv[] )
+{
+    unsigned machines = argc > 1 ? std::atoi( argv[ 1 ] ) : 10000;
+    unsigned hops     = argc > 2 ? std::atoi( argv[ 2 ] ) : 200;
+    unsigned most     = argc > 3 ? std::atoi( argv[ 3 ] )
+                                 : std::thread::hardware_concurrency();
+    if ( most == 0 )
+    {
+        most = 1;
+    }
+
+    for ( unsigned i = 0; i < machines; ++i )
+    {
+        nodes.push_back( new Node );
+    }
+
+    // Enough tokens to keep every worker busy, few enough to never fill
+    // a node's queue.
+    std::vector< Token > tokens( machines * 4 < 4096 * 8 ? machines * 4
+                                                         : 4096 * 8 );
+
+    double base = 0;
+    for ( unsigned workers = 1; ; workers *= 2 )
+    {
+        if ( workers > most )
+        {
+            workers = most;
+        }
+
+        double   seconds = measure( workers, hops, tokens );
+        unsigned events  = dispatched.load();
+        double   rate    = events / seconds;
+        if ( base == 0 )
+        {
+            base = rate;
+        }
+
+        std::printf( "workers=%u events=%u seconds=%.4f events_per_sec=%.0f "
+                     "speedup=%.2f\n",
+                     workers, events, seconds, rate, rate / base );
+        std::fflush( stdout );
+
+        if ( workers == most )
+        {
+            break;
+        }
+    }
+
+    unsigned long sum = 0;
+    for ( std::size_t i = 0; i < nodes.size(); ++i )
+    {
+        sum += nodes[ i ]->work();
+        delete nodes[ i ];
+    }
+    return sum == 0;
+}
@@ -0,0 +1,342 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmFamilyBench.cpp
+// Author        Tommy Carlsson (topcatse)
+//
+// Benchmark of SmFamily::broadcast() against dispatching the same event to
+// as many single machines, one at a time. A TICK is delivered to all
+// sessions: idle ones count down and start, running ones finish in two
+// ticks, and parked ones, one in four, do not take TICK at all.
+//
+// Build and run:
+//   g++ -std=c++17 -O2 -DNDEBUG -I.. SmFamilyBench.cpp -o SmFamilyBench
+//   ./SmFamilyBench [machines] [ticks]
+//
+// One line per engine: engine=<single|family> machines=<n>
+// ns_per_machine=<per machine and tick> handled=<checksum>
+//==============================================================================
+
+#include "SmFamily.h"
+
+// ANSI/STL
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+
+namespace {
+
+enum { RUNS = 5 };
+
+/// First signal after the standard ones.
+enum { TICK = 3 };
+
+/// Declared state ids, in the order of SessionHierarchy.
+enum { ROOT, IDLE, RUNNING, STARTING, FINISHING, PARKED };
+
+class Single;
+class Family;
+
+} // namespace
+
+/// The layout is decided by the time the machine classes are defined.
+namespace Base {
+
+template <>
+struct SmCompact< Single >
+{
+    SM_STATIC_CONSTANT( bool, enabled = true );
+};
+
+template <>
+struct SmCompact< Family >
+{
+    SM_STATIC_CONSTANT( bool, enabled = true );
+};
+
+} // namespace Base
+
+namespace {
+
+/// Number of ticks a session idles, by session.
+unsigned idleTicks( std::size_t session )
+{
+    return 1 + session % 7;
+}
+
+//------------------------------------------------------------------------------
+
+/**
+ * The states of a session, for one session or for a family of them. A
+ * session is found by self().
+ */
+template < class SELF, class MACHINE >
+class Session : public MACHINE
+{
+public:
+    typedef Base::StatePtr< SELF > S;
+    typedef Base::SmEvent<>        E;
+
+    S root( E const* e )
+    {
+        return this->topState();
+    }
+
+    S idle( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case MACHINE::ENTRY:
+            self().timer() = idleTicks( self().index() );
+            return this->handled();
+        case TICK:
+            if ( --self().timer() == 0 )
+            {
+                this->transition( S( &SELF::starting, STARTING ) );
+            }
+            return this->handled();
+        }
+        return S( &SELF::root, ROOT );
+    }
+
+    S running( E const* e )
+    {
+        return S( &SELF::root, ROOT );
+    }
+
+    S starting( E const* e )
+    {
+        if ( e->signal() == TICK )
+        {
+            this->transition( S( &SELF::finishing, FINISHING ) );
+            return this->handled();
+        }
+        return S( &SELF::running, RUNNING );
+    }
+
+    S finishing( E const* e )
+    {
+        if ( e->signal() == TICK )
+        {
+            ++self().done();
+            this->transition( S( &SELF::idle, IDLE ) );
+            return this->handled();
+        }
+        return S( &SELF::running, RUNNING );
+    }
+
+    S parked( E const* e )
+    {
+        return S( &SELF::root, ROOT );
+    }
+
+    /// The initial state of given session.
+    static S initial( std::size_t session )
+    {
+        return session % 4 == 3 ? S( &SELF::parked, PARKED )
+                                : S( &SELF::idle, IDLE );
+    }
+
+private:
+    SELF& self() { return static_cast< SELF& >( *this ); }
+};
+
+/// The hierarchy of Session< SELF, ... >, with the handled signals.
+template < class SELF >
+struct SessionHierarchy
+{
+    SM_STATIC_CONSTANT( bool, declared = true );
+    static constexpr Base::SmStateDecl< SELF > states[] =
+    {
+        { &SELF::root,      Base::SM_TOP_ID, Base::smSignals() },
+        { &SELF::idle,      ROOT,            Base::smSignals( TICK ) },
+        { &SELF::running,   ROOT,            Base::smSignals() },
+        { &SELF::starting,  RUNNING,         Base::smSignals( TICK ) },
+        { &SELF::finishing, RUNNING,         Base::smSignals( TICK ) },
+        { &SELF::parked,    ROOT,            Base::smSignals() }
+    };
+};
+
+template < class SELF >
+constexpr Base::SmStateDecl< SELF > SessionHierarchy< SELF >::states[];
+
+//------------------------------------------------------------------------------
+
+/// One session per machine.
+class Single : public Session< Single, Base::StateMachine< Single > >
+{
+public:
+    explicit Single( std::size_t index );
+
+    bool tick( E* e ) { return dispatch( e ); }
+
+    std::size_t index() const { return index_; }
+    unsigned&   timer()       { return timer_; }
+    unsigned&   done()        { return done_; }
+
+    static unsigned done_;
+
+private:
+    std::size_t index_;
+    unsigned    timer_;
+};
+
+unsigned Single::done_ = 0;
+
+/// All sessions in one family, their data in arrays by member.
+class Family : public Session< Family, Base::SmFamily< Family > >
+{
+public:
+    explicit Family( std::size_t sessions );
+
+    std::size_t index() const { return member(); }
+    unsigned&   timer()       { return timers_[ member() ]; }
+    unsigned&   done()        { return done_; }
+
+private:
+    std::vector< unsigned > timers_;
+    unsigned                done_;
+};
+
+} // namespace
+
+namespace Base {
+
+template <>
+struct SmHierarchy< Single > : SessionHierarchy< Single > {};
+
+template <>
+struct SmHierarchy< Family > : SessionHierarchy< Family > {};
+
+template <>
+struct SmJumpTable< Single >
+{
+    SM_STATIC_CONSTANT( unsigned, signals = TICK + 1 );
+};
+
+template <>
+struct SmJumpTable< Family >
+{
+    SM_STATIC_CONSTANT( unsigned, signals = TICK + 1 );
+};
+
+template <>
+struct SmPureTransitions< Family >
+{
+    SM_STATIC_CONSTANT( bool, declared = true );
+    static constexpr SmPureTransition transitions[] =
+    {
+        { STARTING, TICK, FINISHING }
+    };
+};
+
+constexpr SmPureTransition SmPureTransitions< Family >::transitions[];
+
+} // namespace Base
+
+//==============================================================================
+
+namespace {
+
+/// Defined once the hierarchies are declared.
+Single::Single( std::size_t index ) : index_( index ), timer_( 0 )
+{
+    open( this, initial( index ) );
+}
+
+//------------------------------------------------------------------------------
+
+Family::Family( std::size_t sessions ) : done_( 0 )
+{
+    timers_.resize( sessions );
+    for ( std::size_t i = 0; i < sessions; ++i )
+    {
+        add( initial( i ) );
+    }
+}
+
+//------------------------------------------------------------------------------
+
+typedef std::chrono::steady_clock Clock;
+
+//------------------------------------------------------------------------------
+
+double runSingle( std::size_t machines, unsigned ticks, std::size_t& handled )
+{
+    std::vector< std::unique_ptr< Single > > sessions;
+    for ( std::size_t i = 0; i < machines; ++i )
+    {
+        sessions.emplace_back( new Single( i ) );
+    }
+
+    Base::SmEvent<> tick( TICK );
+    handled = 0;
+
+    Clock::time_point start = Clock::now();
+    for ( unsigned t = 0; t < ticks; ++t )
+    {
+        for ( std::size_t i = 0; i < machines; ++i )
+        {
+            handled += sessions[ i ]->tick( &tick );
+        }
+    }
+    return std::chrono::duration< double, std::nano >( Clock::now() - start ).count();
+}
+
+//------------------------------------------------------------------------------
+
+double runFamily( std::size_t machines, unsigned ticks, std::size_t& handled )
+{
+    Family          family( machines );
+    Base::SmEvent<> tick( TICK );
+    handled = 0;
+
+    Clock::time_point start = Clock::now();
+    for ( unsigned t = 0; t < ticks; ++t )
+    {
+        handled += family.broadcast( &tick );
+    }
+    return std::chrono::duration< double, std::nano >( Clock::now() - start ).count();
+}
+
+//------------------------------------------------------------------------------
+
+void measure( char const* engine,
+              double (*run)( std::size_t, unsigned, std::size_t& ),
+              std::size_t machines,
+              unsigned    ticks )
+{
+    std::size_t handled = 0;
+    double      best    = 0;
+
+    for ( int i = 0; i < RUNS; ++i )
+    {
+        double elapsed = run( machines, ticks, handled ) / ( machines * ticks );
+        if ( i == 0 || elapsed < best )
+        {
+            best = elapsed;
+        }
+    }
+
+    std::printf( "engine=%s machines=%zu ns_per_machine=%.2f handled=%zu\n",
+                 engine, machines, best, handled );
+}
+
+} // namespace
+
+//==============================================================================
+
+int main( int argc, char* argv[] )
+{
+    std::size_t machines = argc > 1 ? std::strtoul( argv[ 1 ], 0, 10 ) : 100000;
+    unsigned    ticks    = argc > 2 ? std::strtoul( argv[ 2 ], 0, 10 ) : 20;
+
+    measure( "single", runSingle, machines, ticks );
+    measure( "family", runFamily, machines, ticks );
+    return 0;
+}
+
+//==============================================================================
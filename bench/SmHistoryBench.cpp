@@ -0,0 +1,262 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmHistoryBench.cpp
+// Author        Tommy Carlsson (topcatse)
+//
+// Benchmark of a deep SmHistory against resuming by hand. A player is
+// paused and resumed in the middle of a game four levels deep; by hand,
+// each state records itself on ENTRY and each composite state's INIT goes
+// to the substate recorded, so resuming walks INIT down all levels. With
+// a deep history the leaf is entered directly.
+//
+// Build and run:
+//   g++ -std=c++17 -O2 -DNDEBUG -I.. SmHistoryBench.cpp -o SmHistoryBench
+//   ./SmHistoryBench [cycles]
+//
+// One line per way to resume: resume=<init|history> ns_per_cycle=<toggle,
+// pause and resume> leaf=<checksum>
+//==============================================================================
+
+#include "StateMachine.h"
+
+// ANSI/STL
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+//==============================================================================
+
+namespace {
+
+enum { RUNS = 5, LEVELS = 4 };
+
+/// Signals after the standard ones.
+enum { TOGGLE = 3, PAUSE, RESUME };
+
+/// Declared state ids: x< L > is X + 2 * L and y< L > is Y + 2 * L.
+enum { ROOT, IDLE, ACTIVE, X, Y };
+
+/**
+ * x< L > holds x< L + 1 > and y< L + 1 >, by default the former, and the
+ * y< L > are leaves. TOGGLE moves between the innermost two.
+ */
+template < bool HISTORY >
+class Player : public Base::StateMachine< Player< HISTORY > >
+{
+public:
+    typedef Base::StatePtr< Player > S;
+    typedef Base::SmEvent<>          E;
+    typedef Base::StateMachine< Player > Machine;
+
+    Player();
+
+    bool send( E* e ) { return this->dispatch( e ); }
+
+    /// Declared id of the current state.
+    Base::SmStateId leaf() const { return this->current().id(); }
+
+    S root( E const* e ) { return this->topState(); }
+
+    S idle( E const* e )
+    {
+        if ( e->signal() == RESUME )
+        {
+            if ( HISTORY )
+            {
+                this->transition( game_ );
+            }
+            else
+            {
+                this->transition( S( &Player::active, ACTIVE ) );
+            }
+            return this->handled();
+        }
+        return S( &Player::root, ROOT );
+    }
+
+    S active( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case Machine::INIT:
+            this->initializer( child< 0 >() );
+            return this->handled();
+        case PAUSE:
+            this->transition( S( &Player::idle, IDLE ) );
+            return this->handled();
+        }
+        return S( &Player::root, ROOT );
+    }
+
+    template < unsigned L >
+    S x( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case Machine::ENTRY:
+            choice_[ L ] = false;
+            return this->handled();
+        case Machine::INIT:
+            if ( L + 1 < LEVELS )
+            {
+                this->initializer( child< L + 1 < LEVELS ? L + 1 : L >() );
+                return this->handled();
+            }
+            break;
+        case TOGGLE:
+            if ( L + 1 == LEVELS )
+            {
+                this->transition( S( &Player::y< L >, Y + 2 * L ) );
+                return this->handled();
+            }
+            break;
+        }
+        return parent< L >();
+    }
+
+    template < unsigned L >
+    S y( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case Machine::ENTRY:
+            choice_[ L ] = true;
+            return this->handled();
+        case TOGGLE:
+            this->transition( S( &Player::x< L >, X + 2 * L ) );
+            return this->handled();
+        }
+        return parent< L >();
+    }
+
+private:
+    /// The substate of level L to enter: by hand the one recorded, else
+    /// the default.
+    template < unsigned L >
+    S child() const
+    {
+        return !HISTORY && choice_[ L ] ? S( &Player::y< L >, Y + 2 * L )
+                                        : S( &Player::x< L >, X + 2 * L );
+    }
+
+    template < unsigned L >
+    static S parent()
+    {
+        return L == 0 ? S( &Player::active, ACTIVE )
+                      : S( &Player::x< L == 0 ? 0 : L - 1 >, X + 2 * ( L - 1 ) );
+    }
+
+    bool                                   choice_[ LEVELS ];
+    typename Machine::History              game_;
+};
+
+/// The hierarchy of Player< HISTORY >.
+template < bool HISTORY >
+struct PlayerHierarchy
+{
+    typedef Player< HISTORY > P;
+
+    SM_STATIC_CONSTANT( bool, declared = true );
+    static constexpr Base::SmStateDecl< P > states[] =
+    {
+        { &P::root,                 Base::SM_TOP_ID },
+        { &P::idle,                 ROOT },
+        { &P::active,               ROOT },
+        { &P::template x< 0 >,      ACTIVE },
+        { &P::template y< 0 >,      ACTIVE },
+        { &P::template x< 1 >,      X },
+        { &P::template y< 1 >,      X },
+        { &P::template x< 2 >,      X + 2 },
+        { &P::template y< 2 >,      X + 2 },
+        { &P::template x< 3 >,      X + 4 },
+        { &P::template y< 3 >,      X + 4 }
+    };
+};
+
+template < bool HISTORY >
+constexpr Base::SmStateDecl< Player< HISTORY > > PlayerHierarchy< HISTORY >::states[];
+
+} // namespace
+
+namespace Base {
+
+template < bool HISTORY >
+struct SmHierarchy< Player< HISTORY > > : PlayerHierarchy< HISTORY > {};
+
+} // namespace Base
+
+//==============================================================================
+
+namespace {
+
+/// Defined once the hierarchy is declared.
+template < bool HISTORY >
+Player< HISTORY >::Player()
+{
+    for ( unsigned l = 0; l < LEVELS; ++l )
+    {
+        choice_[ l ] = false;
+    }
+    this->remember( game_, S( &Player::active, ACTIVE ), Base::SM_DEEP_HISTORY );
+    this->open( this, S( &Player::active, ACTIVE ) );
+}
+
+//------------------------------------------------------------------------------
+
+typedef std::chrono::steady_clock Clock;
+
+template < bool HISTORY >
+double run( unsigned long cycles, unsigned long& leaves )
+{
+    Player< HISTORY > player;
+    Base::SmEvent<>   toggle( TOGGLE );
+    Base::SmEvent<>   pause( PAUSE );
+    Base::SmEvent<>   resume( RESUME );
+    leaves = 0;
+
+    Clock::time_point start = Clock::now();
+    for ( unsigned long i = 0; i < cycles; ++i )
+    {
+        player.send( &toggle );
+        player.send( &pause );
+        player.send( &resume );
+        leaves += player.leaf();
+    }
+    return std::chrono::duration< double, std::nano >( Clock::now() - start ).count();
+}
+
+//------------------------------------------------------------------------------
+
+void measure( char const* name,
+              double (*run)( unsigned long, unsigned long& ),
+              unsigned long cycles )
+{
+    unsigned long leaves = 0;
+    double        best   = 0;
+
+    for ( int i = 0; i < RUNS; ++i )
+    {
+        double elapsed = run( cycles, leaves ) / cycles;
+        if ( i == 0 || elapsed < best )
+        {
+            best = elapsed;
+        }
+    }
+
+    std::printf( "resume=%s ns_per_cycle=%.2f leaf=%lu\n", name, best, leaves );
+}
+
+} // namespace
+
+//==============================================================================
+
+int main( int argc, char* argv[] )
+{
+    unsigned long cycles = argc > 1 ? std::strtoul( argv[ 1 ], 0, 10 ) : 1000000;
+
+    measure( "init",    run< false >, cycles );
+    measure( "history", run< true >,  cycles );
+    return 0;
+}
+
+//==============================================================================
@@ -0,0 +1,352 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmOrthogonalBench.cpp
+// Author        Tommy Carlsson (topcatse)
+//
+// Benchmark of SmOrthogonal against as many separate machines, one per
+// concern, that each event is dispatched to. Each concern toggles between
+// two states on every DATA event and does some work, on data of its own.
+// The regions are also dispatched to in parallel on an SmExecutor, which
+// pays off once the work per region outweighs the hand-over to workers.
+//
+// Build and run:
+//   g++ -std=c++17 -O2 -DNDEBUG -I.. -pthread SmOrthogonalBench.cpp -o SmOrthogonalBench
+//   ./SmOrthogonalBench [events] [work]
+//
+// One line per engine: engine=<machines|regions|parallel> work=<n>
+// ns_per_event=<n> handled=<checksum>
+//==============================================================================
+
+#include "SmOrthogonal.h"
+
+// ANSI/STL
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+
+namespace {
+
+enum { RUNS = 5, CONCERNS = 3 };
+
+/// First signal after the standard ones.
+enum { DATA = 3 };
+
+/// Declared state ids of a concern, and of region r of Link from r * 3 on.
+enum { ROOT, ON, OFF, STATES };
+
+template < unsigned I > class Concern;
+class Link;
+
+} // namespace
+
+/// The layouts are decided by the time the machine classes are defined.
+namespace Base {
+
+template < unsigned I >
+struct SmCompact< Concern< I > >
+{
+    SM_STATIC_CONSTANT( bool, enabled = true );
+};
+
+template <>
+struct SmCompact< Link >
+{
+    SM_STATIC_CONSTANT( bool, enabled = true );
+};
+
+template <>
+struct SmRegions< Link >
+{
+    SM_STATIC_CONSTANT( unsigned, regions = CONCERNS );
+    SM_STATIC_CONSTANT( bool, independent = true );
+};
+
+} // namespace Base
+
+namespace {
+
+unsigned work = 0;
+
+/// Work on the data of a concern.
+void busy( unsigned& data )
+{
+    for ( unsigned i = 0; i < work; ++i )
+    {
+        data = data * 1664525u + 1013904223u;
+    }
+}
+
+/// The data of a concern, a cache line each.
+struct alignas( 64 ) Data
+{
+    Data() : value( 0 ), toggles( 0 ) {}
+
+    unsigned value;
+    unsigned toggles;
+};
+
+//------------------------------------------------------------------------------
+
+/// A concern as a machine of its own.
+template < unsigned I >
+class Concern : public Base::StateMachine< Concern< I > >
+{
+public:
+    typedef Base::StatePtr< Concern > S;
+    typedef Base::SmEvent<>           E;
+
+    Concern();
+
+    S root( E const* e ) { return this->topState(); }
+
+    S on( E const* e )
+    {
+        if ( e->signal() == DATA )
+        {
+            busy( data.value );
+            ++data.toggles;
+            this->transition( S( &Concern::off, OFF ) );
+            return this->handled();
+        }
+        return S( &Concern::root, ROOT );
+    }
+
+    S off( E const* e )
+    {
+        if ( e->signal() == DATA )
+        {
+            busy( data.value );
+            this->transition( S( &Concern::on, ON ) );
+            return this->handled();
+        }
+        return S( &Concern::root, ROOT );
+    }
+
+    bool data_( E* e ) { return this->dispatch( e ); }
+
+    Data data;
+};
+
+/// All concerns as regions of one machine, region r in states r * 3 on.
+class Link : public Base::SmOrthogonal< Link >
+{
+public:
+    typedef Base::StatePtr< Link > S;
+    typedef Base::SmEvent<>        E;
+
+    Link();
+
+    template < unsigned R >
+    S root( E const* e ) { return topState(); }
+
+    template < unsigned R >
+    S on( E const* e )
+    {
+        if ( e->signal() == DATA )
+        {
+            busy( data[ R ].value );
+            ++data[ R ].toggles;
+            transition( S( &Link::off< R >, R * STATES + OFF ) );
+            return handled();
+        }
+        return S( &Link::root< R >, R * STATES + ROOT );
+    }
+
+    template < unsigned R >
+    S off( E const* e )
+    {
+        if ( e->signal() == DATA )
+        {
+            busy( data[ R ].value );
+            transition( S( &Link::on< R >, R * STATES + ON ) );
+            return handled();
+        }
+        return S( &Link::root< R >, R * STATES + ROOT );
+    }
+
+    Data data[ CONCERNS ];
+};
+
+} // namespace
+
+namespace Base {
+
+template < unsigned I >
+struct SmHierarchy< Concern< I > >
+{
+    SM_STATIC_CONSTANT( bool, declared = true );
+    static constexpr SmStateDecl< Concern< I > > states[] =
+    {
+        { &Concern< I >::root, SM_TOP_ID, smSignals() },
+        { &Concern< I >::on,   ROOT,      smSignals( DATA ) },
+        { &Concern< I >::off,  ROOT,      smSignals( DATA ) }
+    };
+};
+
+template < unsigned I >
+constexpr SmStateDecl< Concern< I > > SmHierarchy< Concern< I > >::states[];
+
+template <>
+struct SmHierarchy< Link >
+{
+    SM_STATIC_CONSTANT( bool, declared = true );
+    static constexpr SmStateDecl< Link > states[] =
+    {
+        { &Link::root< 0 >, SM_TOP_ID,         smSignals() },
+        { &Link::on< 0 >,   ROOT,              smSignals( DATA ) },
+        { &Link::off< 0 >,  ROOT,              smSignals( DATA ) },
+        { &Link::root< 1 >, SM_TOP_ID,         smSignals() },
+        { &Link::on< 1 >,   STATES + ROOT,     smSignals( DATA ) },
+        { &Link::off< 1 >,  STATES + ROOT,     smSignals( DATA ) },
+        { &Link::root< 2 >, SM_TOP_ID,         smSignals() },
+        { &Link::on< 2 >,   2 * STATES + ROOT, smSignals( DATA ) },
+        { &Link::off< 2 >,  2 * STATES + ROOT, smSignals( DATA ) }
+    };
+};
+
+constexpr SmStateDecl< Link > SmHierarchy< Link >::states[];
+
+} // namespace Base
+
+//==============================================================================
+
+namespace {
+
+/// Defined once the hierarchies are declared.
+template < unsigned I >
+Concern< I >::Concern()
+{
+    this->open( this, S( &Concern::on, ON ) );
+}
+
+//------------------------------------------------------------------------------
+
+Link::Link()
+{
+    S const initials[ CONCERNS ] =
+    {
+        S( &Link::on< 0 >, ON ),
+        S( &Link::on< 1 >, STATES + ON ),
+        S( &Link::on< 2 >, 2 * STATES + ON )
+    };
+    open( initials );
+}
+
+//------------------------------------------------------------------------------
+
+typedef std::chrono::steady_clock Clock;
+
+//------------------------------------------------------------------------------
+
+double runMachines( unsigned long events, unsigned long& handled )
+{
+    Concern< 0 >    connection;
+    Concern< 1 >    auth;
+    Concern< 2 >    flow;
+    Base::SmEvent<> data( DATA );
+    handled = 0;
+
+    Clock::time_point start = Clock::now();
+    for ( unsigned long i = 0; i < events; ++i )
+    {
+        handled += connection.data_( &data );
+        handled += auth.data_( &data );
+        handled += flow.data_( &data );
+    }
+    double elapsed = std::chrono::duration< double, std::nano >( Clock::now() - start ).count();
+
+    handled += connection.data.toggles + auth.data.toggles + flow.data.toggles;
+    return elapsed;
+}
+
+//------------------------------------------------------------------------------
+
+/// Kept until the executor is destroyed, see SmOrthogonal.
+std::vector< std::unique_ptr< Link > > links;
+
+double runLink( unsigned long events, unsigned long& handled, Base::SmExecutor* executor )
+{
+    links.emplace_back( new Link );
+
+    Link&           link = *links.back();
+    Base::SmEvent<> data( DATA );
+    handled = 0;
+
+    link.runOn( executor );
+
+    Clock::time_point start = Clock::now();
+    for ( unsigned long i = 0; i < events; ++i )
+    {
+        // Each region handles it, as each machine does.
+        handled += CONCERNS * link.dispatch( &data );
+    }
+    double elapsed = std::chrono::duration< double, std::nano >( Clock::now() - start ).count();
+
+    for ( unsigned r = 0; r < CONCERNS; ++r )
+    {
+        handled += link.data[ r ].toggles;
+    }
+    return elapsed;
+}
+
+//------------------------------------------------------------------------------
+
+Base::SmExecutor* executor = 0;
+
+double runRegions( unsigned long events, unsigned long& handled )
+{
+    return runLink( events, handled, 0 );
+}
+
+double runParallel( unsigned long events, unsigned long& handled )
+{
+    return runLink( events, handled, executor );
+}
+
+//------------------------------------------------------------------------------
+
+void measure( char const* engine,
+              double (*run)( unsigned long, unsigned long& ),
+              unsigned long events )
+{
+    unsigned long handled = 0;
+    double        best    = 0;
+
+    for ( int i = 0; i < RUNS; ++i )
+    {
+        double elapsed = run( events, handled ) / events;
+        if ( i == 0 || elapsed < best )
+        {
+            best = elapsed;
+        }
+    }
+
+    std::printf( "engine=%s work=%u ns_per_event=%.2f handled=%lu\n",
+                 engine, work, best, handled );
+}
+
+} // namespace
+
+//==============================================================================
+
+int main( int argc, char* argv[] )
+{
+    unsigned long events = argc > 1 ? std::strtoul( argv[ 1 ], 0, 10 ) : 200000;
+    work                 = argc > 2 ? std::strtoul( argv[ 2 ], 0, 10 ) : 1000;
+
+    measure( "machines", runMachines, events );
+    measure( "regions",  runRegions,  events );
+
+    executor = new Base::SmExecutor( CONCERNS - 1 );
+    measure( "parallel", runParallel, events );
+    delete executor;
+
+    links.clear();
+    return 0;
+}
+
+//==============================================================================
@@ -0,0 +1,473 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmReplayBench.cpp
+// Author        Tommy Carlsson (topcatse)
+//
+// Benchmark of recording and replaying events (see SmRecord.h). Sessions
+// (see SmReplayBench.h) are given a stream of events, with and without
+// an SmRecorder, and the recording is then replayed to fresh sessions of
+// each engine by SmReplay_run(), from a mapped file. Engines:
+//   cpp       Base::StateMachine, hierarchy declared in SmHierarchy
+//   cpp_jump  cpp, with an SmJumpTable
+//   c         StateMachine_dispatch of StateMachine.c
+// It is then replayed to cpp by SmShardedReplay, on 1, 2, 4 ... shards up
+// to one per core. The thread that reads the recording runs besides the
+// shards, so the widest has one thread more than there are cores.
+//
+// Build and run, from this directory:
+//   gcc -std=c99 -O2 -DNDEBUG -I.. -c ../StateMachine.c ../Deque.c ../SmRecord.c ../SmTrace.c SmReplayBenchC.c
+//   g++ -std=c++17 -O2 -DNDEBUG -I.. -pthread SmReplayBench.cpp StateMachine.o Deque.o SmRecord.o SmTrace.o SmReplayBenchC.o -o SmReplayBench
+//   ./SmReplayBench [sessions] [events] [file]
+//
+// One line per way to dispatch live: record=<off|on> ns_per_event=<n>
+// One line per engine replayed to: engine=<e> events_per_s=<n>
+// p50=<ns> p99=<ns> p999=<ns> max=<ns> handled=<n> mismatched=<n>
+// One line per number of shards: shards=<n> events_per_s=<n> p99=<ns>
+// mismatched=<n> spread=<events of the largest shard / the mean>
+// One line per state of the widest: state=<s> sessions=<n>
+//==============================================================================
+
+#include "SmReplayBench.h"
+#include "SmRecord.h"
+#include "SmShardedReplay.h"
+#include "SmSnapshot.h"
+#include "StateMachine.h"
+
+// ANSI/STL
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+//==============================================================================
+
+namespace {
+
+enum { RUNS = 5 };
+
+typedef SmReplayPacket Packet;
+
+/// A session of the C++ engine, with an SmJumpTable if JUMP.
+template < bool JUMP >
+class Session : public Base::StateMachine< Session< JUMP >, Packet >
+{
+public:
+    typedef Base::StatePtr< Session, Packet > S;
+    typedef Base::SmEvent< Packet >           E;
+    typedef Base::StateMachine< Session, Packet > Machine;
+
+    Session() : bytes_( 0 ) {}
+
+    void start() { Machine::open( this, S( &Session::idle, SM_REPLAY_IDLE ) ); }
+
+    bool send( E* e ) { return this->dispatch( e ); }
+
+    Base::SmStateId state() const { return this->current().id(); }
+
+    S root( E const* e ) { return this->topState(); }
+
+    S idle( E const* e )
+    {
+        if ( e->signal() == SM_REPLAY_CONNECT )
+        {
+            this->transition( S( &Session::authenticating, SM_REPLAY_AUTHENTICATING ) );
+            return this->handled();
+        }
+        return S( &Session::root, SM_REPLAY_ROOT );
+    }
+
+    S connected( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case Machine::ENTRY:
+            bytes_ = 0;
+            return this->handled();
+        case SM_REPLAY_CLOSE:
+            this->transition( S( &Session::idle, SM_REPLAY_IDLE ) );
+            return this->handled();
+        }
+        return S( &Session::root, SM_REPLAY_ROOT );
+    }
+
+    S authenticating( E const* e )
+    {
+        if ( e->signal() == SM_REPLAY_AUTHED )
+        {
+            this->transition( S( &Session::open, SM_REPLAY_OPEN ) );
+            return this->handled();
+        }
+        return S( &Session::connected, SM_REPLAY_CONNECTED );
+    }
+
+    S open( E const* e )
+    {
+        if ( e->signal() == SM_REPLAY_DATA && e->get() )
+        {
+            bytes_ += e->get()->bytes;
+            if ( bytes_ > SM_REPLAY_QUOTA )
+            {
+                this->transition( S( &Session::idle, SM_REPLAY_IDLE ) );
+            }
+            return this->handled();
+        }
+        return S( &Session::connected, SM_REPLAY_CONNECTED );
+    }
+
+private:
+    uint32_t bytes_;
+};
+
+/// The hierarchy of Session< JUMP >.
+template < bool JUMP >
+struct SessionHierarchy
+{
+    typedef Session< JUMP > P;
+
+    SM_STATIC_CONSTANT( bool, declared = true );
+    static constexpr Base::SmStateDecl< P, Packet > states[] =
+    {
+        { &P::root,           Base::SM_TOP_ID },
+        { &P::idle,           SM_REPLAY_ROOT },
+        { &P::connected,      SM_REPLAY_ROOT },
+        { &P::authenticating, SM_REPLAY_CONNECTED },
+        { &P::open,           SM_REPLAY_CONNECTED }
+    };
+};
+
+template < bool JUMP >
+constexpr Base::SmStateDecl< Session< JUMP >, Packet > SessionHierarchy< JUMP >::states[];
+
+} // namespace
+
+namespace Base {
+
+template < bool JUMP >
+struct SmHierarchy< Session< JUMP >, Packet > : SessionHierarchy< JUMP > {};
+
+template <>
+struct SmJumpTable< Session< true >, Packet >
+{
+    SM_STATIC_CONSTANT( unsigned, signals = SM_REPLAY_CLOSE + 1 );
+};
+
+} // namespace Base
+
+//==============================================================================
+
+namespace {
+
+/// The sessions of one engine, as an SmReplayTarget. Those of a shard
+/// out of shards, if given: session s of the recording is then number
+/// s / shards of this fleet.
+template < bool JUMP >
+class Fleet
+{
+public:
+    explicit Fleet( uint32_t count, uint32_t shards = 1 )
+        : sessions_( ( count + shards - 1 ) / shards ),
+          shards_( shards )
+    {
+        for ( uint32_t s = 0; s < sessions_.size(); ++s )
+        {
+            sessions_[ s ].reset( new Session< JUMP > );
+            sessions_[ s ]->start();
+        }
+    }
+
+    Session< JUMP >& operator[]( uint32_t s ) { return *sessions_[ s ]; }
+
+    SmReplayTarget target()
+    {
+        SmReplayTarget target = { &Fleet::dispatch, &Fleet::state, this };
+        return target;
+    }
+
+private:
+    static int dispatch( void*       context,
+                         uint32_t    session,
+                         uint16_t    signal,
+                         void const* payload,
+                         uint16_t    size )
+    {
+        Packet packet;
+        bool   data = payload && size == sizeof( packet );
+        if ( data )
+        {
+            std::memcpy( &packet, payload, sizeof( packet ) );
+        }
+
+        Fleet* self = static_cast< Fleet* >( context );
+        typename Session< JUMP >::E e( signal, data ? &packet : 0 );
+        return ( *self )[ session / self->shards_ ].send( &e );
+    }
+
+    static uint16_t state( void* context, uint32_t session )
+    {
+        Fleet* self = static_cast< Fleet* >( context );
+        return ( *self )[ session / self->shards_ ].state();
+    }
+
+    std::vector< std::unique_ptr< Session< JUMP > > > sessions_;
+    uint32_t                                          shards_;
+};
+
+//------------------------------------------------------------------------------
+
+typedef std::chrono::steady_clock Clock;
+
+/// The events of a production day, more or less: a session at random,
+/// mostly DATA of up to 4 KiB.
+class Stream
+{
+public:
+    Stream() : seed_( 12345 ) {}
+
+    void next( uint32_t sessions, uint32_t& session, uint16_t& signal, Packet& packet )
+    {
+        session = random() % sessions;
+        unsigned mix = random() % 100;
+        signal = mix < 10 ? SM_REPLAY_CONNECT
+               : mix < 20 ? SM_REPLAY_AUTHED
+               : mix < 95 ? SM_REPLAY_DATA
+               :            SM_REPLAY_CLOSE;
+        packet.bytes = random() % 4096;
+    }
+
+private:
+    uint32_t random()
+    {
+        seed_ = seed_ * 6364136223846793005ull + 1442695040888963407ull;
+        return static_cast< uint32_t >( seed_ >> 33 );
+    }
+
+    uint64_t seed_;
+};
+
+/// Dispatch events to sessions, recording them in recorder if any along
+/// with the final states. Returns ns per event.
+double live( uint32_t sessions, unsigned long events, SmRecorder* recorder )
+{
+    Fleet< false > fleet( sessions );
+    Stream         stream;
+
+    Clock::time_point start = Clock::now();
+    for ( unsigned long i = 0; i < events; ++i )
+    {
+        uint32_t session;
+        uint16_t signal;
+        Packet   packet;
+        stream.next( sessions, session, signal, packet );
+
+        bool data = signal == SM_REPLAY_DATA;
+        if ( recorder )
+        {
+            SmRecorder_dispatch( recorder, session, signal,
+                                 data ? &packet : 0, sizeof( packet ) );
+        }
+
+        Session< false >::E e( signal, data ? &packet : 0 );
+        fleet[ session ].send( &e );
+    }
+    double elapsed = std::chrono::duration< double, std::nano >( Clock::now() - start ).count();
+
+    for ( uint32_t s = 0; recorder && s < sessions; ++s )
+    {
+        SmRecorder_state( recorder, s, fleet[ s ].state() );
+    }
+    return elapsed / events;
+}
+
+//------------------------------------------------------------------------------
+
+/// Replay the recording to target, keeping the report of the fastest run.
+void replay( char const*                engine,
+             Base::SmSnapshotFile const& recording,
+             SmReplayTarget              (*make)( uint32_t, void*& ),
+             void                        (*destroy)( void* ),
+             uint32_t                    sessions )
+{
+    SmReplayReport best;
+    std::memset( &best, 0, sizeof( best ) );
+
+    for ( int i = 0; i < RUNS; ++i )
+    {
+        void*          fleet  = 0;
+        SmReplayTarget target = make( sessions, fleet );
+        SmReplayReport report;
+
+        if ( SmReplay_run( recording.data(), recording.size(), &target, &report ) != 0 )
+        {
+            std::fprintf( stderr, "Not a recording\n" );
+            std::exit( 1 );
+        }
+        destroy( fleet );
+
+        if ( i == 0 || report.nanoseconds < best.nanoseconds )
+        {
+            best = report;
+        }
+    }
+
+    std::printf( "engine=%s events_per_s=%.0f p50=%llu p99=%llu p999=%llu max=%llu "
+                 "handled=%llu mismatched=%llu\n",
+                 engine,
+                 best.events * 1e9 / ( best.nanoseconds ? best.nanoseconds : 1 ),
+                 (unsigned long long)best.p50,
+                 (unsigned long long)best.p99,
+                 (unsigned long long)best.p999,
+                 (unsigned long long)best.max,
+                 (unsigned long long)best.handled,
+                 (unsigned long long)best.mismatched );
+}
+
+//------------------------------------------------------------------------------
+
+/// Replay the recording to cpp on shards threads, keeping the report of
+/// the fastest run. Returns it.
+SmReplayReport replaySharded( Base::SmSnapshotFile const& recording,
+                              unsigned                    shards,
+                              uint32_t                    sessions )
+{
+    Base::SmShardedReplay replay( shards );
+    SmReplayReport        best;
+    double                spread = 0;
+    std::memset( &best, 0, sizeof( best ) );
+
+    for ( int i = 0; i < RUNS; ++i )
+    {
+        std::vector< std::unique_ptr< Fleet< false > > > fleets( shards );
+        std::vector< SmReplayTarget >                    targets( shards );
+        for ( unsigned s = 0; s < shards; ++s )
+        {
+            fleets[ s ].reset( new Fleet< false >( sessions, shards ) );
+            targets[ s ] = fleets[ s ]->target();
+        }
+
+        SmReplayReport report;
+        if ( replay.run( recording.data(), recording.size(), targets.data(), report ) != 0 )
+        {
+            std::fprintf( stderr, "Not a recording\n" );
+            std::exit( 1 );
+        }
+
+        if ( i == 0 || report.nanoseconds < best.nanoseconds )
+        {
+            best = report;
+
+            uint64_t largest = 0;
+            for ( unsigned s = 0; s < shards; ++s )
+            {
+                largest = replay.shard( s ).events > largest ? replay.shard( s ).events : largest;
+            }
+            spread = report.events ? double( largest ) * shards / report.events : 0;
+        }
+    }
+
+    std::printf( "shards=%u events_per_s=%.0f p99=%llu mismatched=%llu spread=%.3f\n",
+                 shards,
+                 best.events * 1e9 / ( best.nanoseconds ? best.nanoseconds : 1 ),
+                 (unsigned long long)best.p99,
+                 (unsigned long long)best.mismatched,
+                 spread );
+    return best;
+}
+
+//------------------------------------------------------------------------------
+
+template < bool JUMP >
+SmReplayTarget makeCpp( uint32_t sessions, void*& fleet )
+{
+    Fleet< JUMP >* made = new Fleet< JUMP >( sessions );
+    fleet = made;
+    return made->target();
+}
+
+template < bool JUMP >
+void destroyCpp( void* fleet )
+{
+    delete static_cast< Fleet< JUMP >* >( fleet );
+}
+
+SmReplayTarget makeC( uint32_t sessions, void*& fleet )
+{
+    fleet = SmReplayC_open( sessions );
+    SmReplayTarget target = { &SmReplayC_dispatch, &SmReplayC_state, fleet };
+    return target;
+}
+
+} // namespace
+
+//==============================================================================
+
+int main( int argc, char* argv[] )
+{
+    uint32_t      sessions = argc > 1 ? std::strtoul( argv[ 1 ], 0, 10 ) : 10000;
+    unsigned long events   = argc > 2 ? std::strtoul( argv[ 2 ], 0, 10 ) : 2000000;
+    char const*   path     = argc > 3 ? argv[ 3 ] : "SmReplayBench.rec";
+
+    double off = 0;
+    double on  = 0;
+    std::unique_ptr< SmRecorder > recorder( new SmRecorder );
+
+    for ( int i = 0; i < RUNS; ++i )
+    {
+        double elapsed = live( sessions, events, 0 );
+        off = i == 0 || elapsed < off ? elapsed : off;
+
+        std::FILE* file = std::fopen( path, "wb" );
+        if ( !file || SmRecorder_open( recorder.get(), file ) != 0 )
+        {
+            std::fprintf( stderr, "Cannot write %s\n", path );
+            return 1;
+        }
+        elapsed = live( sessions, events, recorder.get() );
+        on = i == 0 || elapsed < on ? elapsed : on;
+
+        if ( SmRecorder_close( recorder.get() ) != 0 || std::fclose( file ) != 0 )
+        {
+            std::fprintf( stderr, "Cannot write %s\n", path );
+            return 1;
+        }
+    }
+
+    std::printf( "record=off ns_per_event=%.2f\n", off );
+    std::printf( "record=on ns_per_event=%.2f\n", on );
+
+    {
+        Base::SmSnapshotFile recording( path );
+        replay( "cpp",      recording, makeCpp< false >, destroyCpp< false >, sessions );
+        replay( "cpp_jump", recording, makeCpp< true >,  destroyCpp< true >,  sessions );
+        replay( "c",        recording, makeC,            SmReplayC_close,     sessions );
+
+        static char const* const names[ SM_REPLAY_STATES ] =
+        {
+            "root", "idle", "connected", "authenticating", "open"
+        };
+
+        unsigned       cores = std::thread::hardware_concurrency();
+        SmReplayReport widest;
+        for ( unsigned shards = 1; ; shards *= 2 )
+        {
+            shards = shards < cores ? shards : cores > 0 ? cores : 1;
+            widest = replaySharded( recording, shards, sessions );
+            if ( shards >= cores )
+            {
+                break;
+            }
+        }
+
+        for ( unsigned s = 0; s < SM_REPLAY_STATES; ++s )
+        {
+            std::printf( "state=%s sessions=%llu\n",
+                         names[ s ], (unsigned long long)widest.states[ s ] );
+        }
+    }
+    std::remove( path );
+    return 0;
+}
+
+//==============================================================================
@@ -0,0 +1,79 @@
+//=============================================- -*- C -*- ===================
+//
+// File Name     SmReplayBench.h
+// Author        Tommy Carlsson (topcatse)
+//
+// This file contains the interface between the replay benchmark driver
+// and its C engine machines.
+//==============================================================================
+#if !defined ( BASE_SM_REPLAY_BENCH_H_ )
+#define BASE_SM_REPLAY_BENCH_H_
+//==============================================================================
+
+#include <stdint.h>
+
+#if defined ( __cplusplus )
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * The sessions replayed, the same in both engines:
+ *
+ *   root --+-- idle
+ *          +-- connected --+-- authenticating
+ *                          +-- open
+ *
+ * idle takes CONNECT to authenticating, which takes AUTHED to open.
+ * connected takes CLOSE to idle. open counts the bytes of DATA, and
+ * takes the session to idle once they exceed SM_REPLAY_QUOTA.
+ */
+typedef enum
+{
+    SM_REPLAY_CONNECT = 3,
+    SM_REPLAY_AUTHED,
+    SM_REPLAY_DATA,
+    SM_REPLAY_CLOSE
+} SmReplaySignal;
+
+/// Declared state ids, and in the C engine the index in its state table.
+typedef enum
+{
+    SM_REPLAY_ROOT,
+    SM_REPLAY_IDLE,
+    SM_REPLAY_CONNECTED,
+    SM_REPLAY_AUTHENTICATING,
+    SM_REPLAY_OPEN,
+    SM_REPLAY_STATES
+} SmReplayState;
+
+#define SM_REPLAY_QUOTA 65536
+
+/// Payload of DATA.
+typedef struct
+{
+    uint32_t bytes;
+} SmReplayPacket;
+
+/// Create count C engine sessions, in idle.
+void* SmReplayC_open( uint32_t count );
+
+/// SmReplayTarget::dispatch() of the sessions.
+int SmReplayC_dispatch( void*       sessions,
+                        uint32_t    session,
+                        uint16_t    signal,
+                        void const* payload,
+                        uint16_t    size );
+
+/// SmReplayTarget::state() of the sessions.
+uint16_t SmReplayC_state( void* sessions, uint32_t session );
+
+/// Destroy sessions created by SmReplayC_open().
+void SmReplayC_close( void* sessions );
+
+#if defined ( __cplusplus )
+}
+#endif /* __cplusplus */
+
+//==============================================================================
+#endif /* BASE_SM_REPLAY_BENCH_H_ */
+//==============================================================================
@@ -0,0 +1,187 @@
+//=============================================- -*- C -*- ===================
+//
+// File Name     SmReplayBenchC.c
+// Author        Tommy Carlsson
+//
+// This file contains the C engine sessions of the replay benchmark, see
+// SmReplayBench.h.
+//
+//==============================================================================
+
+#include "SmReplayBench.h"
+#include "StateMachineC.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define HANDLED() StateMachine_handled(t, SM_DUMMY)
+
+typedef struct
+{
+   /// By SmReplayState.
+   struct State           states[ SM_REPLAY_STATES ];
+   struct StateMachine_t  machine;
+   uint32_t               bytes;
+
+   /// The payload of the event being dispatched, if any.
+   SmReplayPacket const*  packet;
+} Session;
+
+typedef struct
+{
+   Session* sessions;
+   uint32_t count;
+} Sessions;
+
+//------------------------------------------------------------------------------
+
+static State Session_root(OWNER owner, Signal e)
+{
+   return StateMachine_topState(owner, SM_DUMMY);
+}
+
+//------------------------------------------------------------------------------
+
+static State Session_idle(OWNER owner, Signal e)
+{
+   Session* t = owner;
+
+   if ( e == SM_REPLAY_CONNECT )
+   {
+      StateMachine_transition(&t->machine, &t->states[ SM_REPLAY_AUTHENTICATING ]);
+      return HANDLED();
+   }
+   return &t->states[ SM_REPLAY_ROOT ];
+}
+
+//------------------------------------------------------------------------------
+
+static State Session_connected(OWNER owner, Signal e)
+{
+   Session* t = owner;
+
+   switch (e)
+   {
+      case SM_ENTRY:
+         t->bytes = 0;
+         return HANDLED();
+      case SM_REPLAY_CLOSE:
+         StateMachine_transition(&t->machine, &t->states[ SM_REPLAY_IDLE ]);
+         return HANDLED();
+      default:
+         break;
+   }
+   return &t->states[ SM_REPLAY_ROOT ];
+}
+
+//------------------------------------------------------------------------------
+
+static State Session_authenticating(OWNER owner, Signal e)
+{
+   Session* t = owner;
+
+   if ( e == SM_REPLAY_AUTHED )
+   {
+      StateMachine_transition(&t->machine, &t->states[ SM_REPLAY_OPEN ]);
+      return HANDLED();
+   }
+   return &t->states[ SM_REPLAY_CONNECTED ];
+}
+
+//------------------------------------------------------------------------------
+
+static State Session_open(OWNER owner, Signal e)
+{
+   Session* t = owner;
+
+   if ( e == SM_REPLAY_DATA && t->packet )
+   {
+      t->bytes += t->packet->bytes;
+      if ( t->bytes > SM_REPLAY_QUOTA )
+      {
+         StateMachine_transition(&t->machine, &t->states[ SM_REPLAY_IDLE ]);
+      }
+      return HANDLED();
+   }
+   return &t->states[ SM_REPLAY_CONNECTED ];
+}
+
+//------------------------------------------------------------------------------
+
+void* SmReplayC_open( uint32_t count )
+{
+   static StateFcn const handlers[ SM_REPLAY_STATES ] =
+   {
+      Session_root,
+      Session_idle,
+      Session_connected,
+      Session_authenticating,
+      Session_open
+   };
+
+   Sessions* self = malloc( sizeof( Sessions ) );
+   uint32_t  i;
+   unsigned  s;
+
+   self->sessions = calloc( count, sizeof( Session ) );
+   self->count    = count;
+
+   for ( i = 0; i < count; ++i )
+   {
+      Session* t = &self->sessions[ i ];
+      for ( s = 0; s < SM_REPLAY_STATES; ++s )
+      {
+         State_init( &t->states[ s ], t, handlers[ s ] );
+      }
+      StateMachine_open( &t->machine, t, &t->states[ SM_REPLAY_IDLE ] );
+   }
+   return self;
+}
+
+//------------------------------------------------------------------------------
+
+int SmReplayC_dispatch( void*       sessions,
+                        uint32_t    session,
+                        uint16_t    signal,
+                        void const* payload,
+                        uint16_t    size )
+{
+   Sessions*      self = sessions;
+   Session*       t    = &self->sessions[ session ];
+   SmReplayPacket packet;
+
+   t->packet = 0;
+   if ( payload && size == sizeof( packet ) )
+   {
+      memcpy( &packet, payload, sizeof( packet ) );
+      t->packet = &packet;
+   }
+   return StateMachine_dispatch( &t->machine, signal );
+}
+
+//------------------------------------------------------------------------------
+
+uint16_t SmReplayC_state( void* sessions, uint32_t session )
+{
+   Sessions* self = sessions;
+   Session*  t    = &self->sessions[ session ];
+   State     states[ SM_REPLAY_STATES ];
+   unsigned  s;
+
+   for ( s = 0; s < SM_REPLAY_STATES; ++s )
+   {
+      states[ s ] = &t->states[ s ];
+   }
+   return StateMachine_save( &t->machine, states, SM_REPLAY_STATES );
+}
+
+//------------------------------------------------------------------------------
+
+void SmReplayC_close( void* sessions )
+{
+   Sessions* self = sessions;
+
+   free( self->sessions );
+   free( self );
+}
+
+//==============================================================================
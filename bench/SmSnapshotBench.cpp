@@ -0,0 +1,278 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmSnapshotBench.cpp
+// Author        Tommy Carlsson (topcatse)
+//
+// Benchmark of bringing a family of sessions back after a restart, by
+// replaying the events of each session against restoring a snapshot
+// (see SmFamily::save()) from a mapped file. Each session has been
+// connected, authenticated and closed a few times, and is left anywhere.
+// The file is written once before it is restored, hence read from the
+// page cache.
+//
+// Build and run:
+//   g++ -std=c++17 -O2 -DNDEBUG -I.. SmSnapshotBench.cpp -o SmSnapshotBench
+//   ./SmSnapshotBench [sessions] [events] [file]
+//
+// One line per way to rebuild: rebuild=<replay|save|restore> sessions=<n>
+// ms=<n> states=<checksum>
+//==============================================================================
+
+#include "SmFamily.h"
+
+// ANSI/STL
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+//==============================================================================
+
+namespace {
+
+enum { RUNS = 5 };
+
+/// Signals after the standard ones.
+enum { CONNECT = 3, AUTHED, DATA, CLOSE };
+
+/// Declared state ids, in the order of the hierarchy.
+enum { ROOT, IDLE, CONNECTED, AUTHENTICATING, OPEN, READING, WRITING };
+
+class Sessions;
+
+} // namespace
+
+/// The layout is decided by the time the machine class is defined.
+namespace Base {
+
+template <>
+struct SmCompact< Sessions >
+{
+    SM_STATIC_CONSTANT( bool, enabled = true );
+};
+
+} // namespace Base
+
+namespace {
+
+/// The events of a session, from an offset of its own.
+Base::SmEvent<>::Signal const history[] =
+{
+    CONNECT, AUTHED, DATA, DATA, DATA, CLOSE, CONNECT, AUTHED,
+    DATA, CLOSE, CONNECT, AUTHED, DATA, DATA, CLOSE, CONNECT
+};
+
+enum { HISTORY = sizeof( history ) / sizeof( history[ 0 ] ) };
+
+//------------------------------------------------------------------------------
+
+class Sessions : public Base::SmFamily< Sessions >
+{
+public:
+    typedef Base::StatePtr< Sessions > S;
+    typedef Base::SmEvent<>            E;
+
+    /// sessions connect with events each, by replay.
+    Sessions( std::size_t sessions, unsigned events );
+
+    /// As saved in snapshot, of size bytes.
+    Sessions( void const* snapshot, std::size_t size );
+
+    /// Sum of the current state ids.
+    unsigned long states() const;
+
+    S root( E const* e ) { return topState(); }
+
+    S idle( E const* e )
+    {
+        if ( e->signal() == CONNECT )
+        {
+            transition( S( &Sessions::authenticating, AUTHENTICATING ) );
+            return handled();
+        }
+        return S( &Sessions::root, ROOT );
+    }
+
+    S connected( E const* e )
+    {
+        if ( e->signal() == CLOSE )
+        {
+            transition( S( &Sessions::idle, IDLE ) );
+            return handled();
+        }
+        return S( &Sessions::root, ROOT );
+    }
+
+    S authenticating( E const* e )
+    {
+        if ( e->signal() == AUTHED )
+        {
+            transition( S( &Sessions::open, OPEN ) );
+            return handled();
+        }
+        return S( &Sessions::connected, CONNECTED );
+    }
+
+    S open( E const* e )
+    {
+        if ( e->signal() == INIT )
+        {
+            initializer( S( &Sessions::reading, READING ) );
+            return handled();
+        }
+        return S( &Sessions::connected, CONNECTED );
+    }
+
+    S reading( E const* e )
+    {
+        if ( e->signal() == DATA )
+        {
+            transition( S( &Sessions::writing, WRITING ) );
+            return handled();
+        }
+        return S( &Sessions::open, OPEN );
+    }
+
+    S writing( E const* e )
+    {
+        if ( e->signal() == DATA )
+        {
+            transition( S( &Sessions::reading, READING ) );
+            return handled();
+        }
+        return S( &Sessions::open, OPEN );
+    }
+};
+
+} // namespace
+
+namespace Base {
+
+template <>
+struct SmHierarchy< Sessions >
+{
+    SM_STATIC_CONSTANT( bool, declared = true );
+    static constexpr SmStateDecl< Sessions > states[] =
+    {
+        { &Sessions::root,           SM_TOP_ID, smSignals() },
+        { &Sessions::idle,           ROOT,      smSignals( CONNECT ) },
+        { &Sessions::connected,      ROOT,      smSignals( CLOSE ) },
+        { &Sessions::authenticating, CONNECTED, smSignals( AUTHED ) },
+        { &Sessions::open,           CONNECTED, smSignals() },
+        { &Sessions::reading,        OPEN,      smSignals( DATA ) },
+        { &Sessions::writing,        OPEN,      smSignals( DATA ) }
+    };
+};
+
+constexpr SmStateDecl< Sessions > SmHierarchy< Sessions >::states[];
+
+} // namespace Base
+
+//==============================================================================
+
+namespace {
+
+/// Defined once the hierarchy is declared.
+Sessions::Sessions( std::size_t sessions, unsigned events )
+{
+    for ( std::size_t s = 0; s < sessions; ++s )
+    {
+        add( S( &Sessions::idle, IDLE ) );
+        for ( unsigned i = 0; i < events; ++i )
+        {
+            E e( history[ ( s + i ) % HISTORY ] );
+            dispatch( s, &e );
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+Sessions::Sessions( void const* snapshot, std::size_t size )
+{
+    if ( !restore( snapshot, size ) )
+    {
+        std::fprintf( stderr, "Not a snapshot of Sessions\n" );
+        std::exit( 1 );
+    }
+}
+
+//------------------------------------------------------------------------------
+
+unsigned long Sessions::states() const
+{
+    unsigned long sum = 0;
+    for ( std::size_t s = 0; s < size(); ++s )
+    {
+        sum += state( s );
+    }
+    return sum;
+}
+
+//------------------------------------------------------------------------------
+
+typedef std::chrono::steady_clock Clock;
+
+double ms( Clock::time_point start )
+{
+    return std::chrono::duration< double, std::milli >( Clock::now() - start ).count();
+}
+
+/// Best of RUNS.
+void keep( double& best, double elapsed, int run )
+{
+    if ( run == 0 || elapsed < best )
+    {
+        best = elapsed;
+    }
+}
+
+} // namespace
+
+//==============================================================================
+
+int main( int argc, char* argv[] )
+{
+    std::size_t sessions = argc > 1 ? std::strtoul( argv[ 1 ], 0, 10 ) : 1000000;
+    unsigned    events   = argc > 2 ? std::strtoul( argv[ 2 ], 0, 10 ) : 16;
+    char const* path     = argc > 3 ? argv[ 3 ] : "SmSnapshotBench.snap";
+
+    double        replay  = 0;
+    double        save    = 0;
+    double        restore = 0;
+    unsigned long replayed = 0;
+    unsigned long restored = 0;
+
+    for ( int run = 0; run < RUNS; ++run )
+    {
+        Clock::time_point start = Clock::now();
+        Sessions          live( sessions, events );
+        keep( replay, ms( start ), run );
+        replayed = live.states();
+
+        start = Clock::now();
+        std::FILE* file = std::fopen( path, "wb" );
+        if ( !file || !live.save( file ) || std::fclose( file ) != 0 )
+        {
+            std::fprintf( stderr, "Cannot write %s\n", path );
+            return 1;
+        }
+        keep( save, ms( start ), run );
+
+        start = Clock::now();
+        Base::SmSnapshotFile snapshot( path );
+        Sessions             back( snapshot.data(), snapshot.size() );
+        keep( restore, ms( start ), run );
+        restored = back.states();
+    }
+    std::remove( path );
+
+    std::printf( "rebuild=replay sessions=%zu ms=%.2f states=%lu\n",
+                 sessions, replay, replayed );
+    std::printf( "rebuild=save sessions=%zu ms=%.2f states=%lu\n",
+                 sessions, save, replayed );
+    std::printf( "rebuild=restore sessions=%zu ms=%.2f states=%lu\n",
+                 sessions, restore, restored );
+    return 0;
+}
+
+//==============================================================================
@@ -0,0 +1,179 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmTimerBench.cpp
+// Author        Tommy Carlsson (topcatse)
+//
+// Benchmark of SmTimerWheel against an ordered map of deadlines, the usual
+// heap based timer with cancel. Each round re-arms a random one of the
+// armed timers, as a state does on EXIT and ENTRY, and advances time by
+// one tick every so many rounds.
+//
+// Build and run:
+//   g++ -std=c++17 -O2 -DNDEBUG -I.. SmTimerBench.cpp -o SmTimerBench
+//   ./SmTimerBench [timers] [rounds]
+//
+// One line per timer service: timers=<wheel|map> armed=<n>
+// ns_per_rearm=<per round> expired=<checksum>
+//==============================================================================
+
+#include "SmTimer.h"
+
+// ANSI/STL
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+//==============================================================================
+
+namespace {
+
+enum { RUNS = 5, ROUNDS_PER_TICK = 64, MAX_TICKS = 5000 };
+
+typedef std::chrono::steady_clock Clock;
+
+/// Pseudo random timeout and timer, the same sequence for both services.
+struct Random
+{
+    Random() : state( 88172645463325252ull ) {}
+
+    uint64_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    uint64_t state;
+};
+
+//------------------------------------------------------------------------------
+
+class Timeout : public Base::SmTimerNode
+{
+public:
+    Timeout() : expired( 0 ) {}
+
+    unsigned long expired;
+
+private:
+    virtual void expire() { ++expired; }
+};
+
+//------------------------------------------------------------------------------
+
+double runWheel( std::size_t timers, unsigned long rounds, unsigned long& expired )
+{
+    Base::SmTimerWheel      wheel;
+    std::vector< Timeout >  timeouts( timers );
+    Random                  random;
+
+    for ( std::size_t i = 0; i < timers; ++i )
+    {
+        wheel.arm( timeouts[ i ], 1 + random.next() % MAX_TICKS );
+    }
+
+    Clock::time_point start = Clock::now();
+    for ( unsigned long r = 0; r < rounds; ++r )
+    {
+        Timeout& timeout = timeouts[ random.next() % timers ];
+        timeout.cancel();
+        wheel.arm( timeout, 1 + random.next() % MAX_TICKS );
+        if ( r % ROUNDS_PER_TICK == 0 )
+        {
+            wheel.advance();
+        }
+    }
+    double elapsed = std::chrono::duration< double, std::nano >( Clock::now() - start ).count();
+
+    expired = 0;
+    for ( std::size_t i = 0; i < timers; ++i )
+    {
+        expired += timeouts[ i ].expired;
+    }
+    return elapsed;
+}
+
+//------------------------------------------------------------------------------
+
+double runMap( std::size_t timers, unsigned long rounds, unsigned long& expired )
+{
+    typedef std::multimap< uint64_t, std::size_t > Deadlines;
+
+    Deadlines                              deadlines;
+    std::vector< Deadlines::iterator >     armed( timers );
+    std::vector< bool >                    isArmed( timers, true );
+    Random                                 random;
+    uint64_t                               now = 0;
+
+    for ( std::size_t i = 0; i < timers; ++i )
+    {
+        armed[ i ] = deadlines.insert( std::make_pair( now + 1 + random.next() % MAX_TICKS, i ) );
+    }
+
+    expired = 0;
+    Clock::time_point start = Clock::now();
+    for ( unsigned long r = 0; r < rounds; ++r )
+    {
+        std::size_t i = random.next() % timers;
+        if ( isArmed[ i ] )
+        {
+            deadlines.erase( armed[ i ] );
+        }
+        armed[ i ]   = deadlines.insert( std::make_pair( now + 1 + random.next() % MAX_TICKS, i ) );
+        isArmed[ i ] = true;
+
+        if ( r % ROUNDS_PER_TICK == 0 )
+        {
+            ++now;
+            while ( !deadlines.empty() && deadlines.begin()->first <= now )
+            {
+                isArmed[ deadlines.begin()->second ] = false;
+                deadlines.erase( deadlines.begin() );
+                ++expired;
+            }
+        }
+    }
+    return std::chrono::duration< double, std::nano >( Clock::now() - start ).count();
+}
+
+//------------------------------------------------------------------------------
+
+void measure( char const* name,
+              double (*run)( std::size_t, unsigned long, unsigned long& ),
+              std::size_t   timers,
+              unsigned long rounds )
+{
+    unsigned long expired = 0;
+    double        best    = 0;
+
+    for ( int i = 0; i < RUNS; ++i )
+    {
+        double elapsed = run( timers, rounds, expired ) / rounds;
+        if ( i == 0 || elapsed < best )
+        {
+            best = elapsed;
+        }
+    }
+
+    std::printf( "timers=%s armed=%zu ns_per_rearm=%.2f expired=%lu\n",
+                 name, timers, best, expired );
+}
+
+} // namespace
+
+//==============================================================================
+
+int main( int argc, char* argv[] )
+{
+    std::size_t   timers = argc > 1 ? std::strtoul( argv[ 1 ], 0, 10 ) : 1000000;
+    unsigned long rounds = argc > 2 ? std::strtoul( argv[ 2 ], 0, 10 ) : 2000000;
+
+    measure( "wheel", runWheel, timers, rounds );
+    measure( "map",   runMap,   timers, rounds );
+    return 0;
+}
+
+//==============================================================================
@@ -0,0 +1,118 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmActiveObjectStopTest.cpp
+// Author        Tommy Carlsson (topcatse)
+//
+// Stress test of SmActiveObject::stop(). A thread is started in run() over
+// and over, while events are posted and stop() is called from another
+// thread at varying moments. A stop() that is lost leaves run() asleep,
+// which the test reports as a hang.
+//
+// Build and run:
+//   g++ -std=c++17 -O2 -I.. -pthread SmActiveObjectStopTest.cpp -o SmActiveObjectStopTest
+//   ./SmActiveObjectStopTest [rounds]
+//
+// Prints rounds=<n> dispatched=<n> result=<ok|hang>, and exits non-zero on
+// a hang.
+//==============================================================================
+
+#include "SmActiveObject.h"
+
+// ANSI/STL
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+//==============================================================================
+
+namespace {
+
+/// First signal after the standard ones.
+enum { PING = 3 };
+
+/// Counts the PINGs dispatched to it.
+class Counter : public Base::SmActiveObject< Counter, int, 64 >
+{
+    typedef Base::StatePtr< Counter > S;
+    typedef Base::SmEvent<>           E;
+
+public:
+    Counter() : count_( 0 )
+    {
+        counting_.init( this, &Counter::counting );
+        open( this, counting_ );
+    }
+
+    unsigned long count() const { return count_.load( std::memory_order_relaxed ); }
+
+private:
+    S counting( E const* e )
+    {
+        if ( e->signal() == PING )
+        {
+            count_.fetch_add( 1, std::memory_order_relaxed );
+            return handled();
+        }
+        return topState();
+    }
+
+    S                              counting_;
+    std::atomic< unsigned long >   count_;
+};
+
+} // namespace
+
+//==============================================================================
+
+int main( int argc, char* argv[] )
+{
+    unsigned long rounds = argc > 1 ? std::strtoul( argv[ 1 ], 0, 10 ) : 100000;
+
+    Counter       counter;
+    Base::SmEvent<> ping( PING );
+
+    for ( unsigned long round = 0; round < rounds; ++round )
+    {
+        std::atomic< bool > done( false );
+        std::thread runner( [ &counter, &done ]
+        {
+            counter.run();
+            done.store( true, std::memory_order_release );
+        } );
+
+        // Stop before, among and after the posts, to hit run() both busy
+        // and about to sleep.
+        unsigned posts = round % 4;
+        for ( unsigned i = 0; i < posts; ++i )
+        {
+            counter.post( &ping, Base::SM_SPIN );
+        }
+        if ( round % 3 == 1 )
+        {
+            std::this_thread::yield();
+        }
+        counter.stop();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while ( !done.load( std::memory_order_acquire ) )
+        {
+            if ( std::chrono::steady_clock::now() - start > std::chrono::seconds( 5 ) )
+            {
+                std::printf( "rounds=%lu dispatched=%lu result=hang\n",
+                             round, counter.count() );
+                std::fflush( stdout );
+                std::_Exit( 1 );
+            }
+            std::this_thread::yield();
+        }
+        runner.join();
+    }
+    counter.pump();
+
+    std::printf( "rounds=%lu dispatched=%lu result=ok\n", rounds, counter.count() );
+    return 0;
+}
+
+//==============================================================================
@@ -0,0 +1,403 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmDispatchAllocTest.cpp
+// Author        Tommy Carlsson (topcatse)
+//
+// Test that StateMachine::dispatch never allocates. Every global allocation
+// is counted while the signals of the transition cases (a) .. (h) of
+// dispatch, and one that no state handles, are dispatched to fresh
+// machines, their first dispatch and cache misses included. Machines:
+//   cpp       hierarchy found by INQUIRE
+//   cpp_decl  hierarchy declared in SmHierarchy
+//   cpp_jump  cpp_decl, with an SmJumpTable
+//   cpp_pitch cpp, with an SmPitcherCache
+//   cpp_compact cpp_decl, with the SmCompact layout
+//
+// Build and run, also with -DSM_NO_TRANSITION_CACHE:
+//   g++ -std=c++11 -O2 -I.. -pthread SmDispatchAllocTest.cpp -o SmDispatchAllocTest
+//   ./SmDispatchAllocTest
+//
+// One line per machine and case: engine=<e> case=<c> allocs=<n>
+// Then result=<ok|fail>; exits non-zero on fail.
+//==============================================================================
+
+#include "StateMachine.h"
+
+// ANSI/STL
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+//==============================================================================
+// Allocation counting. Where malloc can be replaced it counts operator new
+// as well, which calls it.
+
+static unsigned long allocations = 0;
+
+#if defined ( __GLIBC__ )
+
+extern "C" {
+
+void* __libc_malloc( std::size_t size );
+void* __libc_calloc( std::size_t count, std::size_t size );
+void* __libc_realloc( void* ptr, std::size_t size );
+void  __libc_free( void* ptr );
+
+void* malloc( std::size_t size )
+{
+    ++allocations;
+    return __libc_malloc( size );
+}
+
+void* calloc( std::size_t count, std::size_t size )
+{
+    ++allocations;
+    return __libc_calloc( count, size );
+}
+
+void* realloc( void* ptr, std::size_t size )
+{
+    ++allocations;
+    return __libc_realloc( ptr, size );
+}
+
+void free( void* ptr )
+{
+    __libc_free( ptr );
+}
+
+} // extern "C"
+
+#else
+
+void* operator new( std::size_t size )
+{
+    ++allocations;
+    void* p = std::malloc( size ? size : 1 );
+    if ( !p )
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete( void* p ) noexcept
+{
+    std::free( p );
+}
+
+#endif /* __GLIBC__ */
+
+//==============================================================================
+
+namespace {
+
+/// The dispatched cases, as in bench/SmDispatchBench.h:
+///
+///   s0 --+-- s1 --+-- s11 ---- s111 ---- s1111
+///        |        +-- s12 ---- s121
+///        +-- s2 ---- s21 ---- s211
+///
+/// (a) s1111 -> s1111, handled in s1111
+/// (b) s1111 -> s1111, handled in s111
+/// (c) s11 -> s12 and back
+/// (d) s1111 -> s111, which initializes to s1111
+/// (e) s1111 -> s1111, handled in s1
+/// (f) s11 -> s121 and s12 -> s111, from s1111
+/// (g) s1111 -> s211 and back
+/// (h) internal transition in s1111
+enum Case { CASE_A, CASE_B, CASE_C, CASE_D, CASE_E, CASE_F, CASE_G, CASE_H,
+            CASE_NONE, CASES };
+
+typedef Base::SmEvent<> E;
+
+/// The machine. SELF is the OWNER, so that it can be run with each option.
+template < class SELF >
+class Tester : public Base::StateMachine< SELF >
+{
+    typedef Base::StateMachine< SELF > Machine;
+
+public:
+    typedef Base::StatePtr< SELF > S;
+
+    enum Ids { S0, S1, S11, S111, S1111, S12, S121, S2, S21, S211 };
+
+    /// One signal per case, from USER_START.
+    enum Signals { SIG_A = 3, SIG_B, SIG_C, SIG_D, SIG_E, SIG_F, SIG_G, SIG_H,
+                   SIG_NONE, SIG_LAST };
+
+    explicit Tester( Case c )
+    {
+        SELF* self = static_cast< SELF* >( this );
+        s0_.init( self, &Tester::s0, S0 );
+        s1_.init( self, &Tester::s1, S1 );
+        s11_.init( self, &Tester::s11, S11 );
+        s111_.init( self, &Tester::s111, S111 );
+        s1111_.init( self, &Tester::s1111, S1111 );
+        s12_.init( self, &Tester::s12, S12 );
+        s121_.init( self, &Tester::s121, S121 );
+        s2_.init( self, &Tester::s2, S2 );
+        s21_.init( self, &Tester::s21, S21 );
+        s211_.init( self, &Tester::s211, S211 );
+        this->open( self, c == CASE_C ? s11_ : s111_ );
+    }
+
+    /// Dispatch the signal of case c count times.
+    void run( Case c, unsigned count )
+    {
+        E e( SIG_A + c );
+        while ( count-- > 0 )
+        {
+            this->dispatch( &e );
+        }
+    }
+
+    S topState( E const* e = 0 ) { return Machine::topState( e ); }
+    S handled( E const* e = 0 )  { return Machine::handled( e ); }
+
+    S s0( E const* e )
+    {
+        return topState();
+    }
+
+    S s1( E const* e )
+    {
+        if ( e->signal() == SIG_E )
+        {
+            this->transition( s1111_ );
+            return handled();
+        }
+        return s0_;
+    }
+
+    S s11( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case SIG_C:
+            this->transition( s12_ );
+            return handled();
+        case SIG_F:
+            this->transition( s121_ );
+            return handled();
+        }
+        return s1_;
+    }
+
+    S s111( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case Machine::INIT:
+            this->initializer( s1111_ );
+            return handled();
+        case SIG_B:
+            this->transition( s1111_ );
+            return handled();
+        }
+        return s11_;
+    }
+
+    S s1111( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case SIG_A:
+            this->transition( s1111_ );
+            return handled();
+        case SIG_D:
+            this->transition( s111_ );
+            return handled();
+        case SIG_G:
+            this->transition( s211_ );
+            return handled();
+        case SIG_H:
+            return handled();
+        }
+        return s111_;
+    }
+
+    S s12( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case SIG_C:
+            this->transition( s11_ );
+            return handled();
+        case SIG_F:
+            this->transition( s111_ );
+            return handled();
+        }
+        return s1_;
+    }
+
+    S s121( E const* e ) { return s12_; }
+    S s2( E const* e )   { return s0_; }
+    S s21( E const* e )  { return s2_; }
+
+    S s211( E const* e )
+    {
+        if ( e->signal() == SIG_G )
+        {
+            this->transition( s1111_ );
+            return handled();
+        }
+        return s21_;
+    }
+
+private:
+    S s0_, s1_, s11_, s111_, s1111_, s12_, s121_, s2_, s21_, s211_;
+};
+
+class Cpp : public Tester< Cpp >
+{
+public:
+    explicit Cpp( Case c ) : Tester< Cpp >( c ) {}
+};
+
+class Decl : public Tester< Decl >
+{
+public:
+    explicit Decl( Case c ) : Tester< Decl >( c ) {}
+};
+
+class Jump : public Tester< Jump >
+{
+public:
+    explicit Jump( Case c ) : Tester< Jump >( c ) {}
+};
+
+class Pitch : public Tester< Pitch >
+{
+public:
+    explicit Pitch( Case c ) : Tester< Pitch >( c ) {}
+};
+
+class Compact;
+
+} // namespace
+
+namespace Base {
+
+template <>
+struct SmCompact< Compact >
+{
+    SM_STATIC_CONSTANT( bool, enabled = true );
+};
+
+} // namespace Base
+
+namespace {
+
+class Compact : public Tester< Compact >
+{
+public:
+    explicit Compact( Case c ) : Tester< Compact >( c ) {}
+};
+
+/// The hierarchy of Tester< SELF >.
+template < class SELF >
+struct TesterHierarchy
+{
+    typedef Tester< SELF > B;
+
+    SM_STATIC_CONSTANT( bool, declared = true );
+    static constexpr Base::SmStateDecl< SELF > states[] =
+    {
+        { &B::s0,    Base::SM_TOP_ID },
+        { &B::s1,    B::S0 },
+        { &B::s11,   B::S1 },
+        { &B::s111,  B::S11 },
+        { &B::s1111, B::S111 },
+        { &B::s12,   B::S1 },
+        { &B::s121,  B::S12 },
+        { &B::s2,    B::S0 },
+        { &B::s21,   B::S2 },
+        { &B::s211,  B::S21 }
+    };
+};
+
+template < class SELF >
+constexpr Base::SmStateDecl< SELF > TesterHierarchy< SELF >::states[];
+
+} // namespace
+
+namespace Base {
+
+template <>
+struct SmHierarchy< Decl > : TesterHierarchy< Decl > {};
+
+template <>
+struct SmHierarchy< Jump > : TesterHierarchy< Jump > {};
+
+template <>
+struct SmHierarchy< Compact > : TesterHierarchy< Compact > {};
+
+template <>
+struct SmPitcherCache< Pitch >
+{
+    SM_STATIC_CONSTANT( bool, enabled = true );
+};
+
+template <>
+struct SmJumpTable< Jump >
+{
+    SM_STATIC_CONSTANT( unsigned, signals = Tester< Jump >::SIG_LAST );
+};
+
+} // namespace Base
+
+//==============================================================================
+
+namespace {
+
+/// Count the allocations of dispatching each case to a fresh MACHINE.
+/// Returns false if any.
+template < class MACHINE >
+bool
+check( char const* engine )
+{
+    static char const* const names[ CASES ] =
+        { "a", "b", "c", "d", "e", "f", "g", "h", "none" };
+
+    // The first dispatch of a machine definition on a thread registers the
+    // thread's metrics block, a thread_local that the C++ runtime allocates
+    // an exit hook for. That is once per thread, not per dispatch.
+    {
+        MACHINE warm( CASE_H );
+        warm.run( CASE_H, 1 );
+    }
+
+    bool ok = true;
+    for ( int i = 0; i < CASES; ++i )
+    {
+        Case    c = Case( i );
+        MACHINE machine( c );
+
+        unsigned long before = allocations;
+        machine.run( c, 1000 );
+        unsigned long allocs = allocations - before;
+
+        std::printf( "engine=%s case=%s allocs=%lu\n", engine, names[ c ], allocs );
+        ok = ok && allocs == 0;
+    }
+    return ok;
+}
+
+} // namespace
+
+//==============================================================================
+
+int main()
+{
+    bool ok = check< Cpp >( "cpp" );
+    ok = check< Decl >( "cpp_decl" ) && ok;
+    ok = check< Jump >( "cpp_jump" ) && ok;
+    ok = check< Pitch >( "cpp_pitch" ) && ok;
+    ok = check< Compact >( "cpp_compact" ) && ok;
+
+    std::printf( "result=%s\n", ok ? "ok" : "fail" );
+    return ok ? 0 : 1;
+}
+
+//==============================================================================
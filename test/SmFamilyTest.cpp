@@ -0,0 +1,259 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmFamilyTest.cpp
+// Author        Tommy Carlsson (topcatse)
+//
+// Test of SmFamily: broadcast() by group, with a handler that dispatches to
+// a member of a group not yet reached, pure transitions moving a group as
+// a whole, and save() and restore() of the members by snapshot.
+//
+// Build and run:
+//   g++ -std=c++17 -O2 -I.. SmFamilyTest.cpp -o SmFamilyTest
+//   ./SmFamilyTest
+//
+// Prints the first failed check, if any, then result=<ok|fail>; exits
+// non-zero on fail.
+//==============================================================================
+
+#include "SmFamily.h"
+
+// ANSI/STL
+#include <cstdio>
+#include <vector>
+
+//==============================================================================
+
+#define CHECK( c ) \
+    do { if ( !( c ) ) { std::printf( "failed %s, line %d\n", #c, __LINE__ ); \
+                         return false; } } while ( 0 )
+
+namespace {
+
+/// First signals after the standard ones.
+enum { GO = 3, KICK, PARK };
+
+/// Declared state ids, in the order of SmHierarchy< Group >.
+enum { ROOT, A, B, C, P, Q };
+
+class Group;
+
+} // namespace
+
+namespace Base {
+
+template <>
+struct SmCompact< Group >
+{
+    SM_STATIC_CONSTANT( bool, enabled = true );
+};
+
+} // namespace Base
+
+namespace {
+
+/**
+ *   ROOT --+-- A       GO: member 0 kicks member 1, then -> B
+ *          +-- B
+ *          +-- C       GO: counted
+ *          +-- P       PARK: -> Q, declared pure
+ *          +-- Q
+ *
+ * KICK takes A to C.
+ */
+class Group : public Base::SmFamily< Group >
+{
+public:
+    typedef Base::StatePtr< Group > S;
+    typedef Base::SmEvent<>         E;
+
+    Group() : kick_( KICK ), goInC_( 0 ) {}
+
+    std::size_t add( S const& initial ) { return SmFamily< Group >::add( initial ); }
+
+    bool restore( void const* data, std::size_t size )
+    {
+        return SmFamily< Group >::restore( data, size );
+    }
+
+    unsigned goInC() const { return goInC_; }
+
+    S root( E const* e ) { return topState(); }
+
+    S a( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case GO:
+            if ( member() == 0 && size() > 1 )
+            {
+                dispatch( 1, &kick_ );
+            }
+            transition( S( &Group::b, B ) );
+            return handled();
+        case KICK:
+            transition( S( &Group::c, C ) );
+            return handled();
+        }
+        return S( &Group::root, ROOT );
+    }
+
+    S b( E const* e ) { return S( &Group::root, ROOT ); }
+
+    S c( E const* e )
+    {
+        if ( e->signal() == GO )
+        {
+            ++goInC_;
+            return handled();
+        }
+        return S( &Group::root, ROOT );
+    }
+
+    S p( E const* e )
+    {
+        if ( e->signal() == PARK )
+        {
+            transition( S( &Group::q, Q ) );
+            return handled();
+        }
+        return S( &Group::root, ROOT );
+    }
+
+    S q( E const* e ) { return S( &Group::root, ROOT ); }
+
+private:
+    E        kick_;
+    unsigned goInC_;
+};
+
+} // namespace
+
+namespace Base {
+
+template <>
+struct SmHierarchy< Group >
+{
+    SM_STATIC_CONSTANT( bool, declared = true );
+    static constexpr SmStateDecl< Group > states[] =
+    {
+        { &Group::root, SM_TOP_ID, 0 },
+        { &Group::a,    ROOT,      0 },
+        { &Group::b,    ROOT,      0 },
+        { &Group::c,    ROOT,      0 },
+        { &Group::p,    ROOT,      0 },
+        { &Group::q,    ROOT,      0 }
+    };
+};
+
+constexpr SmStateDecl< Group > SmHierarchy< Group >::states[];
+
+template <>
+struct SmPureTransitions< Group >
+{
+    SM_STATIC_CONSTANT( bool, declared = true );
+    static constexpr SmPureTransition transitions[] =
+    {
+        { P, PARK, Q }
+    };
+};
+
+constexpr SmPureTransition SmPureTransitions< Group >::transitions[];
+
+} // namespace Base
+
+//==============================================================================
+
+namespace {
+
+/// A member moved out of its group by a handler gets the event in the
+/// state it was moved to.
+bool nestedDispatch()
+{
+    Group    group;
+    Group::E go( GO );
+
+    group.add( Group::S( &Group::a, A ) );
+    group.add( Group::S( &Group::a, A ) );
+
+    CHECK( group.broadcast( &go ) == 2 );
+    CHECK( group.state( 0 ) == B );
+    CHECK( group.state( 1 ) == C );
+    CHECK( group.goInC() == 1 );
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+/// Groups are dispatched to by state, pure transitions moved as a whole.
+bool groups()
+{
+    Group    group;
+    Group::E go( GO );
+    Group::E park( PARK );
+
+    for ( int i = 0; i < 6; ++i )
+    {
+        group.add( i % 2 ? Group::S( &Group::p, P ) : Group::S( &Group::c, C ) );
+    }
+
+    CHECK( group.broadcast( &go ) == 3 );
+    CHECK( group.goInC() == 3 );
+    CHECK( group.broadcast( &park ) == 3 );
+    for ( std::size_t m = 0; m < group.size(); ++m )
+    {
+        CHECK( group.state( m ) == ( m % 2 ? Q : C ) );
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+/// The members come back from a snapshot, and a corrupt one is refused.
+bool snapshot()
+{
+    Group    group;
+    Group::E park( PARK );
+
+    group.add( Group::S( &Group::p, P ) );
+    group.add( Group::S( &Group::c, C ) );
+    group.add( Group::S( &Group::p, P ) );
+    group.broadcast( &park );
+
+    std::FILE* file = std::tmpfile();
+    CHECK( file && group.save( file ) );
+
+    std::vector< unsigned char > data( static_cast< std::size_t >( std::ftell( file ) ) );
+    std::rewind( file );
+    CHECK( std::fread( data.data(), 1, data.size(), file ) == data.size() );
+    std::fclose( file );
+
+    Group copy;
+    CHECK( copy.restore( data.data(), data.size() ) );
+    CHECK( copy.size() == 3 );
+    CHECK( copy.state( 0 ) == Q && copy.state( 1 ) == C && copy.state( 2 ) == Q );
+
+    // A member in a state that is not declared.
+    data[ data.size() - 1 ] = 0xFF;
+    data[ data.size() - 2 ] = 0xFF;
+    CHECK( !copy.restore( data.data(), data.size() ) );
+    CHECK( copy.state( 2 ) == Q );
+
+    CHECK( !copy.restore( data.data(), 4 ) );
+    return true;
+}
+
+} // namespace
+
+//==============================================================================
+
+int main()
+{
+    bool ok = nestedDispatch();
+    ok = groups() && ok;
+    ok = snapshot() && ok;
+
+    std::printf( "result=%s\n", ok ? "ok" : "fail" );
+    return ok ? 0 : 1;
+}
+
+//==============================================================================
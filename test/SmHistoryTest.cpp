@@ -0,0 +1,274 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmHistoryTest.cpp
+// Author        Tommy Carlsson (topcatse)
+//
+// Test of StateMachine::remember(): shallow and deep history of a state,
+// recorded as it is exited and entered again by a transition to the
+// history, and a history with nothing recorded.
+//
+// Build and run:
+//   g++ -std=c++17 -O2 -I.. SmHistoryTest.cpp -o SmHistoryTest
+//   ./SmHistoryTest
+//
+// Prints the first failed check, if any, then result=<ok|fail>; exits
+// non-zero on fail.
+//==============================================================================
+
+#include "StateMachine.h"
+
+// ANSI/STL
+#include <cstdio>
+
+//==============================================================================
+
+#define CHECK( c ) \
+    do { if ( !( c ) ) { std::printf( "failed %s, line %d\n", #c, __LINE__ ); \
+                         return false; } } while ( 0 )
+
+namespace {
+
+/// First signals after the standard ones.
+enum { UP = 3, NEXT, OFF, SHALLOW, DEEP };
+
+/// Declared state ids, in the order of SmHierarchy< Lamp >.
+enum { ROOT, STANDBY, ON, LOW, HIGH, WARM, HOT };
+
+/**
+ *   ROOT --+-- STANDBY    SHALLOW, DEEP: to the history of ON
+ *          +-- ON         OFF: -> STANDBY
+ *                +-- LOW         UP: -> HIGH
+ *                +-- HIGH
+ *                      +-- WARM  NEXT: -> HOT
+ *                      +-- HOT
+ *
+ * ON is initialized to LOW, HIGH to WARM. ON has a shallow and a deep
+ * history.
+ */
+class Lamp : public Base::StateMachine< Lamp >
+{
+public:
+    typedef Base::StatePtr< Lamp > S;
+    typedef Base::SmEvent<>        E;
+
+    Lamp() : entries_( 0 )
+    {
+        remember( shallow_, S( &Lamp::on, ON ) );
+        remember( deep_, S( &Lamp::on, ON ), Base::SM_DEEP_HISTORY );
+        open( this, S( &Lamp::on, ON ) );
+    }
+
+    bool dispatch( E* e ) { return StateMachine< Lamp >::dispatch( e ); }
+
+    Base::SmStateId id() const { return current().id(); }
+
+    /// ENTRY of ON and its substates.
+    unsigned entries() const { return entries_; }
+
+    History& shallow() { return shallow_; }
+    History& deep()    { return deep_; }
+
+    S root( E const* e ) { return topState(); }
+
+    S standby( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case SHALLOW:
+            transition( shallow_ );
+            return handled();
+        case DEEP:
+            transition( deep_ );
+            return handled();
+        }
+        return S( &Lamp::root, ROOT );
+    }
+
+    S on( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case ENTRY:
+            ++entries_;
+            return handled();
+        case INIT:
+            initializer( S( &Lamp::low, LOW ) );
+            return handled();
+        case OFF:
+            transition( S( &Lamp::standby, STANDBY ) );
+            return handled();
+        }
+        return S( &Lamp::root, ROOT );
+    }
+
+    S low( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case ENTRY:
+            ++entries_;
+            return handled();
+        case UP:
+            transition( S( &Lamp::high, HIGH ) );
+            return handled();
+        }
+        return S( &Lamp::on, ON );
+    }
+
+    S high( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case ENTRY:
+            ++entries_;
+            return handled();
+        case INIT:
+            initializer( S( &Lamp::warm, WARM ) );
+            return handled();
+        }
+        return S( &Lamp::on, ON );
+    }
+
+    S warm( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case ENTRY:
+            ++entries_;
+            return handled();
+        case NEXT:
+            transition( S( &Lamp::hot, HOT ) );
+            return handled();
+        }
+        return S( &Lamp::high, HIGH );
+    }
+
+    S hot( E const* e )
+    {
+        if ( e->signal() == ENTRY )
+        {
+            ++entries_;
+            return handled();
+        }
+        return S( &Lamp::high, HIGH );
+    }
+
+private:
+    History  shallow_;
+    History  deep_;
+    unsigned entries_;
+};
+
+} // namespace
+
+namespace Base {
+
+template <>
+struct SmHierarchy< Lamp >
+{
+    SM_STATIC_CONSTANT( bool, declared = true );
+    static constexpr SmStateDecl< Lamp > states[] =
+    {
+        { &Lamp::root,    SM_TOP_ID, 0 },
+        { &Lamp::standby, ROOT,      0 },
+        { &Lamp::on,      ROOT,      0 },
+        { &Lamp::low,     ON,        0 },
+        { &Lamp::high,    ON,        0 },
+        { &Lamp::warm,    HIGH,      0 },
+        { &Lamp::hot,     HIGH,      0 }
+    };
+};
+
+constexpr SmStateDecl< Lamp > SmHierarchy< Lamp >::states[];
+
+} // namespace Base
+
+//==============================================================================
+
+namespace {
+
+/// Go to HOT, and turn off.
+bool toHot( Lamp& lamp )
+{
+    Lamp::E up( UP );
+    Lamp::E next( NEXT );
+    Lamp::E off( OFF );
+
+    CHECK( lamp.dispatch( &up ) && lamp.id() == WARM );
+    CHECK( lamp.dispatch( &next ) && lamp.id() == HOT );
+    CHECK( lamp.dispatch( &off ) && lamp.id() == STANDBY );
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+/// The shallow history enters the substate by its initial transition.
+bool shallow()
+{
+    Lamp    lamp;
+    Lamp::E resume( SHALLOW );
+
+    CHECK( !lamp.shallow().recorded() );
+    CHECK( toHot( lamp ) );
+    CHECK( lamp.shallow().recorded() );
+
+    unsigned entries = lamp.entries();
+    CHECK( lamp.dispatch( &resume ) );
+    CHECK( lamp.id() == WARM );
+    CHECK( lamp.entries() == entries + 3 );
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+/// The deep history enters the innermost state as it was.
+bool deep()
+{
+    Lamp    lamp;
+    Lamp::E resume( DEEP );
+
+    CHECK( toHot( lamp ) );
+    CHECK( lamp.deep().recorded() );
+
+    unsigned entries = lamp.entries();
+    CHECK( lamp.dispatch( &resume ) );
+    CHECK( lamp.id() == HOT );
+    CHECK( lamp.entries() == entries + 3 );
+    CHECK( lamp.isInState( Lamp::S( &Lamp::high, HIGH ) ) == 1 );
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+/// With nothing recorded, the state itself is entered and initialized.
+bool nothingRecorded()
+{
+    Lamp    lamp;
+    Lamp::E off( OFF );
+    Lamp::E resume( DEEP );
+
+    CHECK( lamp.dispatch( &off ) );
+    CHECK( lamp.deep().recorded() );
+    lamp.deep().clear();
+    CHECK( !lamp.deep().recorded() );
+
+    CHECK( lamp.dispatch( &resume ) );
+    CHECK( lamp.id() == LOW );
+    return true;
+}
+
+} // namespace
+
+//==============================================================================
+
+int main()
+{
+    bool ok = shallow();
+    ok = deep() && ok;
+    ok = nothingRecorded() && ok;
+
+    std::printf( "result=%s\n", ok ? "ok" : "fail" );
+    return ok ? 0 : 1;
+}
+
+//==============================================================================
@@ -0,0 +1,307 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmImageTest.cpp
+// Author        Tommy Carlsson (topcatse)
+//
+// Test of StateMachine::save() and restore(): the current state, a deep
+// history and an armed timer kept in an SmImage and restored into another
+// machine without invoking any state, and images that are refused.
+//
+// Build and run:
+//   g++ -std=c++17 -O2 -I.. SmImageTest.cpp -o SmImageTest
+//   ./SmImageTest
+//
+// Prints the first failed check, if any, then result=<ok|fail>; exits
+// non-zero on fail.
+//==============================================================================
+
+#include "StateMachine.h"
+
+// ANSI/STL
+#include <cstdio>
+
+//==============================================================================
+
+#define CHECK( c ) \
+    do { if ( !( c ) ) { std::printf( "failed %s, line %d\n", #c, __LINE__ ); \
+                         return false; } } while ( 0 )
+
+namespace {
+
+/// First signals after the standard ones.
+enum { EXPIRE = 3, PAUSE, RESUME, GO };
+
+/// Declared state ids, in the order of SmHierarchy< Job >.
+enum { ROOT, IDLE, ACTIVE, A, B, COUNT };
+
+/**
+ *   ROOT --+-- IDLE       RESUME: to the deep history of ACTIVE
+ *          +-- ACTIVE     EXPIRE after 10 ticks: counted, PAUSE: -> IDLE
+ *                +-- A    GO: -> B
+ *                +-- B
+ *
+ * ACTIVE is initialized to A.
+ */
+class Job : public Base::StateMachine< Job >
+{
+public:
+    typedef Base::StatePtr< Job > S;
+    typedef Base::SmEvent<>       E;
+
+    explicit Job( Base::SmTimerWheel& wheel )
+        : wheel_( wheel ), entries_( 0 ), expiries_( 0 )
+    {
+        remember( history_, S( &Job::active, ACTIVE ), Base::SM_DEEP_HISTORY );
+    }
+
+    void start() { open( this, S( &Job::active, ACTIVE ) ); }
+
+    bool restore( Base::SmImage const& image )
+    {
+        return StateMachine< Job >::restore( this, image, &wheel_, &Job::timerOf );
+    }
+
+    bool dispatch( E* e ) { return StateMachine< Job >::dispatch( e ); }
+
+    Base::SmStateId id() const { return current().id(); }
+
+    unsigned entries() const  { return entries_; }
+    unsigned expiries() const { return expiries_; }
+
+    Timer const& timer() const { return timer_; }
+
+    S root( E const* e ) { return topState(); }
+
+    S idle( E const* e )
+    {
+        if ( e->signal() == RESUME )
+        {
+            transition( history_ );
+            return handled();
+        }
+        return S( &Job::root, ROOT );
+    }
+
+    S active( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case ENTRY:
+            ++entries_;
+            arm( timer_, wheel_, S( &Job::active, ACTIVE ), 10, EXPIRE );
+            return handled();
+        case INIT:
+            initializer( S( &Job::a, A ) );
+            return handled();
+        case EXPIRE:
+            ++expiries_;
+            return handled();
+        case PAUSE:
+            transition( S( &Job::idle, IDLE ) );
+            return handled();
+        }
+        return S( &Job::root, ROOT );
+    }
+
+    S a( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case ENTRY:
+            ++entries_;
+            return handled();
+        case GO:
+            transition( S( &Job::b, B ) );
+            return handled();
+        }
+        return S( &Job::active, ACTIVE );
+    }
+
+    S b( E const* e )
+    {
+        if ( e->signal() == ENTRY )
+        {
+            ++entries_;
+            return handled();
+        }
+        return S( &Job::active, ACTIVE );
+    }
+
+private:
+    /// The timer of ACTIVE, the only one.
+    static Timer* timerOf( Job* job, Base::SmStateId state, unsigned short signal )
+    {
+        return state == ACTIVE && signal == EXPIRE ? &job->timer_ : 0;
+    }
+
+    Base::SmTimerWheel& wheel_;
+    History             history_;
+    Timer               timer_;
+    unsigned            entries_;
+    unsigned            expiries_;
+};
+
+} // namespace
+
+namespace Base {
+
+template <>
+struct SmHierarchy< Job >
+{
+    SM_STATIC_CONSTANT( bool, declared = true );
+    static constexpr SmStateDecl< Job > states[] =
+    {
+        { &Job::root,   SM_TOP_ID, 0 },
+        { &Job::idle,   ROOT,      0 },
+        { &Job::active, ROOT,      0 },
+        { &Job::a,      ACTIVE,    0 },
+        { &Job::b,      ACTIVE,    0 }
+    };
+};
+
+constexpr SmStateDecl< Job > SmHierarchy< Job >::states[];
+
+} // namespace Base
+
+//==============================================================================
+
+namespace {
+
+/// The current state and an armed timer are restored, and nothing is
+/// entered.
+bool running()
+{
+    Base::SmTimerWheel wheel;
+    Job                job( wheel );
+    Job::E             go( GO );
+
+    job.start();
+    job.dispatch( &go );
+    wheel.advance( 3 );
+
+    Base::SmImage image;
+    CHECK( !job.save( image ) );
+    CHECK( job.save( image, &wheel ) );
+    CHECK( image.current == B && image.timers == 1 && image.timer[ 0 ].ticks == 7 );
+    CHECK( image.histories == 1 && image.history[ 0 ].last == Base::SM_NO_ID );
+
+    Base::SmTimerWheel other;
+    Job                copy( other );
+    CHECK( copy.restore( image ) );
+    CHECK( copy.id() == B && copy.entries() == 0 );
+    CHECK( copy.timer().armed() && copy.timer().deadline() == 7 );
+
+    CHECK( other.advance( 7 ) == 1 );
+    CHECK( copy.expiries() == 1 );
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+/// A recorded history is restored, and resumed from.
+bool paused()
+{
+    Base::SmTimerWheel wheel;
+    Job                job( wheel );
+    Job::E             go( GO );
+    Job::E             pause( PAUSE );
+    Job::E             resume( RESUME );
+
+    job.start();
+    job.dispatch( &go );
+    job.dispatch( &pause );
+
+    Base::SmImage image;
+    CHECK( job.save( image, &wheel ) );
+    CHECK( image.current == IDLE && image.timers == 0 );
+    CHECK( image.history[ 0 ].state == ACTIVE && image.history[ 0 ].last == B );
+
+    Job copy( wheel );
+    CHECK( copy.restore( image ) );
+    CHECK( copy.id() == IDLE && copy.entries() == 0 );
+
+    CHECK( copy.dispatch( &resume ) );
+    CHECK( copy.id() == B && copy.entries() == 2 );
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+/// Images that are not of the hierarchy, or could not have been saved
+/// from it, are refused, and leave the machine as it was.
+bool refused()
+{
+    Base::SmTimerWheel wheel;
+    Job                job( wheel );
+    Job::E             go( GO );
+
+    job.start();
+    job.dispatch( &go );
+
+    Base::SmImage good;
+    CHECK( job.save( good, &wheel ) );
+
+    Job copy( wheel );
+    copy.start();
+    CHECK( copy.id() == A );
+
+    Base::SmImage image = good;
+    image.fingerprint ^= 1;
+    CHECK( !copy.restore( image ) );
+
+    image = good;
+    image.current = COUNT;
+    CHECK( !copy.restore( image ) );
+    image.current = Base::SM_TOP_ID;
+    CHECK( !copy.restore( image ) );
+
+    image = good;
+    image.histories = SM_IMAGE_HISTORIES + 1;
+    CHECK( !copy.restore( image ) );
+
+    // A history of a state that none is remembered for.
+    image = good;
+    image.history[ 0 ].state = A;
+    CHECK( !copy.restore( image ) );
+
+    // A history recording a state outside of its state.
+    image = good;
+    image.history[ 0 ].last = IDLE;
+    CHECK( !copy.restore( image ) );
+    image.history[ 0 ].last = ACTIVE;
+    CHECK( !copy.restore( image ) );
+    image.history[ 0 ].last = COUNT;
+    CHECK( !copy.restore( image ) );
+
+    // A timer of a state exited, or that is not found.
+    image = good;
+    image.current = IDLE;
+    CHECK( !copy.restore( image ) );
+    image = good;
+    image.timer[ 0 ].signal = GO;
+    CHECK( !copy.restore( image ) );
+    image = good;
+    image.timers = SM_IMAGE_TIMERS + 1;
+    CHECK( !copy.restore( image ) );
+
+    CHECK( copy.id() == A && copy.timer().deadline() == 10 );
+    CHECK( copy.restore( good ) );
+    CHECK( copy.id() == B );
+    return true;
+}
+
+} // namespace
+
+//==============================================================================
+
+int main()
+{
+    bool ok = running();
+    ok = paused() && ok;
+    ok = refused() && ok;
+
+    std::printf( "result=%s\n", ok ? "ok" : "fail" );
+    return ok ? 0 : 1;
+}
+
+//==============================================================================
@@ -0,0 +1,227 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmOrthogonalTest.cpp
+// Author        Tommy Carlsson (topcatse)
+//
+// Test of SmOrthogonal: an event is dispatched to each region, which
+// handles it, or not, as a machine of its own, and isInState() looks in
+// all regions. Run on the calling thread, and in parallel on an
+// SmExecutor.
+//
+// Build and run:
+//   g++ -std=c++17 -O2 -I.. -pthread SmOrthogonalTest.cpp -o SmOrthogonalTest
+//   ./SmOrthogonalTest
+//
+// Prints the first failed check, if any, then result=<ok|fail>; exits
+// non-zero on fail.
+//==============================================================================
+
+#include "SmOrthogonal.h"
+
+// ANSI/STL
+#include <cstdio>
+
+//==============================================================================
+
+#define CHECK( c ) \
+    do { if ( !( c ) ) { std::printf( "failed %s, line %d\n", #c, __LINE__ ); \
+                         return false; } } while ( 0 )
+
+namespace {
+
+/// First signals after the standard ones.
+enum { LINK = 3, LOGIN, RESET, NOISE };
+
+/// Declared state ids, in the order of SmHierarchy< Session >.
+enum { CONN, DOWN, UP, AUTH, OUT, IN };
+
+class Session;
+
+} // namespace
+
+namespace Base {
+
+template <>
+struct SmCompact< Session >
+{
+    SM_STATIC_CONSTANT( bool, enabled = true );
+};
+
+template <>
+struct SmRegions< Session >
+{
+    SM_STATIC_CONSTANT( unsigned, regions = 2 );
+    SM_STATIC_CONSTANT( bool, independent = true );
+};
+
+} // namespace Base
+
+namespace {
+
+/**
+ * Region 0, the connection:      Region 1, the authentication:
+ *
+ *   CONN --+-- DOWN                AUTH --+-- OUT
+ *          +-- UP                         +-- IN
+ *
+ * LINK toggles DOWN and UP, LOGIN takes OUT to IN, RESET takes both
+ * regions back and NOISE is handled by none.
+ */
+class Session : public Base::SmOrthogonal< Session >
+{
+public:
+    typedef Base::StatePtr< Session > S;
+    typedef Base::SmEvent<>           E;
+
+    Session()
+    {
+        counts_[ 0 ] = counts_[ 1 ] = 0;
+
+        S const initials[ 2 ] = { S( &Session::down, DOWN ), S( &Session::out, OUT ) };
+        open( initials );
+    }
+
+    /// Events handled by region r.
+    unsigned count( unsigned r ) const { return counts_[ r ]; }
+
+    S conn( E const* e ) { return topState(); }
+
+    S down( E const* e )
+    {
+        if ( e->signal() == LINK )
+        {
+            return move( S( &Session::up, UP ) );
+        }
+        return S( &Session::conn, CONN );
+    }
+
+    S up( E const* e )
+    {
+        if ( e->signal() == LINK || e->signal() == RESET )
+        {
+            return move( S( &Session::down, DOWN ) );
+        }
+        return S( &Session::conn, CONN );
+    }
+
+    S auth( E const* e ) { return topState(); }
+
+    S out( E const* e )
+    {
+        if ( e->signal() == LOGIN )
+        {
+            return move( S( &Session::in, IN ) );
+        }
+        return S( &Session::auth, AUTH );
+    }
+
+    S in( E const* e )
+    {
+        if ( e->signal() == RESET )
+        {
+            return move( S( &Session::out, OUT ) );
+        }
+        return S( &Session::auth, AUTH );
+    }
+
+private:
+    /// Count the event for the region, and transition to target.
+    S move( S const& target )
+    {
+        ++counts_[ region() ];
+        transition( target );
+        return handled();
+    }
+
+    unsigned counts_[ 2 ];
+};
+
+} // namespace
+
+namespace Base {
+
+template <>
+struct SmHierarchy< Session >
+{
+    SM_STATIC_CONSTANT( bool, declared = true );
+    static constexpr SmStateDecl< Session > states[] =
+    {
+        { &Session::conn, SM_TOP_ID, 0 },
+        { &Session::down, CONN,      0 },
+        { &Session::up,   CONN,      0 },
+        { &Session::auth, SM_TOP_ID, 0 },
+        { &Session::out,  AUTH,      0 },
+        { &Session::in,   AUTH,      0 }
+    };
+};
+
+constexpr SmStateDecl< Session > SmHierarchy< Session >::states[];
+
+} // namespace Base
+
+//==============================================================================
+
+namespace {
+
+/// Dispatch to a fresh session, on executor if given.
+bool regions( Session& session, Base::SmExecutor* executor )
+{
+    Session::E link( LINK );
+    Session::E login( LOGIN );
+    Session::E reset( RESET );
+    Session::E noise( NOISE );
+
+    session.runOn( executor );
+
+    CHECK( session.state( 0 ) == DOWN && session.state( 1 ) == OUT );
+    CHECK( session.isInState( Session::S( &Session::down, DOWN ) ) == 2 );
+    CHECK( session.isInState( Session::S( &Session::auth, AUTH ) ) == 1 );
+    CHECK( session.isInState( Session::S( &Session::up, UP ) ) == 0 );
+
+    // Handled by one region, the other stays.
+    CHECK( session.dispatch( &link ) );
+    CHECK( session.state( 0 ) == UP && session.state( 1 ) == OUT );
+    CHECK( session.dispatch( &login ) );
+    CHECK( session.state( 0 ) == UP && session.state( 1 ) == IN );
+
+    CHECK( !session.dispatch( &noise ) );
+    CHECK( session.state( 0 ) == UP && session.state( 1 ) == IN );
+
+    // Handled by both.
+    CHECK( session.dispatch( &reset ) );
+    CHECK( session.state( 0 ) == DOWN && session.state( 1 ) == OUT );
+    CHECK( session.count( 0 ) == 2 && session.count( 1 ) == 2 );
+
+    for ( int i = 0; i < 1000; ++i )
+    {
+        session.dispatch( &link );
+        session.dispatch( i % 2 ? &reset : &login );
+    }
+    // RESET finds region 0 in DOWN each time.
+    CHECK( session.count( 0 ) == 2 + 1000 );
+    CHECK( session.count( 1 ) == 2 + 1000 );
+    return true;
+}
+
+} // namespace
+
+//==============================================================================
+
+int main()
+{
+    Session serial;
+    bool    ok = regions( serial, 0 );
+
+    // The executor may look at a lane after dispatch() has returned, so
+    // it goes first.
+    Session parallel;
+    {
+        Base::SmExecutor executor( 2 );
+        ok = regions( parallel, &executor ) && ok;
+    }
+
+    std::printf( "result=%s\n", ok ? "ok" : "fail" );
+    return ok ? 0 : 1;
+}
+
+//==============================================================================
@@ -0,0 +1,221 @@
+//=============================================- -*- C++ -*- ===================
+//
+// File Name     SmTimerTest.cpp
+// Author        Tommy Carlsson (topcatse)
+//
+// Test of StateMachine::arm(): timeouts bound to a state and its substate,
+// re-armed by a self transition, cancelled as their state is exited, by
+// cancel() and as the machine is destroyed.
+//
+// Build and run:
+//   g++ -std=c++17 -O2 -I.. SmTimerTest.cpp -o SmTimerTest
+//   ./SmTimerTest
+//
+// Prints the first failed check, if any, then result=<ok|fail>; exits
+// non-zero on fail.
+//==============================================================================
+
+#include "StateMachine.h"
+
+// ANSI/STL
+#include <cstdio>
+
+//==============================================================================
+
+#define CHECK( c ) \
+    do { if ( !( c ) ) { std::printf( "failed %s, line %d\n", #c, __LINE__ ); \
+                         return false; } } while ( 0 )
+
+namespace {
+
+/// First signals after the standard ones.
+enum { GO = 3, TIMEOUT, TICK, LEAVE, QUIET };
+
+/// Declared state ids, in the order of SmHierarchy< Alarm >.
+enum { ROOT, ARMED, POLLING, IDLE };
+
+/**
+ *   ROOT --+-- ARMED      TIMEOUT after 10 ticks, and LEAVE: -> IDLE
+ *          |     +-- POLLING  TICK after 3 ticks: -> POLLING
+ *          +-- IDLE       GO: -> ARMED
+ *
+ * QUIET cancels the TICK timer.
+ */
+class Alarm : public Base::StateMachine< Alarm >
+{
+public:
+    typedef Base::StatePtr< Alarm > S;
+    typedef Base::SmEvent<>         E;
+
+    explicit Alarm( Base::SmTimerWheel& wheel )
+        : wheel_( wheel ), ticks_( 0 ), timeouts_( 0 )
+    {
+        open( this, S( &Alarm::armed, ARMED ) );
+    }
+
+    bool dispatch( E* e ) { return StateMachine< Alarm >::dispatch( e ); }
+
+    unsigned ticks() const    { return ticks_; }
+    unsigned timeouts() const { return timeouts_; }
+
+    Timer const& outer() const { return outer_; }
+    Timer const& inner() const { return inner_; }
+
+    S root( E const* e ) { return topState(); }
+
+    S armed( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case ENTRY:
+            arm( outer_, wheel_, S( &Alarm::armed, ARMED ), 10, TIMEOUT );
+            return handled();
+        case INIT:
+            initializer( S( &Alarm::polling, POLLING ) );
+            return handled();
+        case TIMEOUT:
+            ++timeouts_;
+            transition( S( &Alarm::idle, IDLE ) );
+            return handled();
+        case LEAVE:
+            transition( S( &Alarm::idle, IDLE ) );
+            return handled();
+        }
+        return S( &Alarm::root, ROOT );
+    }
+
+    S polling( E const* e )
+    {
+        switch ( e->signal() )
+        {
+        case ENTRY:
+            arm( inner_, wheel_, S( &Alarm::polling, POLLING ), 3, TICK );
+            return handled();
+        case TICK:
+            ++ticks_;
+            transition( S( &Alarm::polling, POLLING ) );
+            return handled();
+        case QUIET:
+            cancel( inner_ );
+            return handled();
+        }
+        return S( &Alarm::armed, ARMED );
+    }
+
+    S idle( E const* e )
+    {
+        if ( e->signal() == GO )
+        {
+            transition( S( &Alarm::armed, ARMED ) );
+            return handled();
+        }
+        return S( &Alarm::root, ROOT );
+    }
+
+private:
+    Base::SmTimerWheel& wheel_;
+    Timer               outer_;
+    Timer               inner_;
+    unsigned            ticks_;
+    unsigned            timeouts_;
+};
+
+} // namespace
+
+namespace Base {
+
+template <>
+struct SmHierarchy< Alarm >
+{
+    SM_STATIC_CONSTANT( bool, declared = true );
+    static constexpr SmStateDecl< Alarm > states[] =
+    {
+        { &Alarm::root,    SM_TOP_ID, 0 },
+        { &Alarm::armed,   ROOT,      0 },
+        { &Alarm::polling, ARMED,     0 },
+        { &Alarm::idle,    ROOT,      0 }
+    };
+};
+
+constexpr SmStateDecl< Alarm > SmHierarchy< Alarm >::states[];
+
+} // namespace Base
+
+//==============================================================================
+
+namespace {
+
+/// The substate's timer is re-armed by its self transition until the
+/// state's timer takes both out.
+bool expiry()
+{
+    Base::SmTimerWheel wheel;
+    Alarm              alarm( wheel );
+
+    CHECK( alarm.outer().armed() && alarm.outer().deadline() == 10 );
+    CHECK( alarm.inner().armed() && alarm.inner().deadline() == 3 );
+
+    CHECK( wheel.advance( 9 ) == 3 );
+    CHECK( alarm.ticks() == 3 && alarm.timeouts() == 0 );
+    CHECK( alarm.inner().deadline() == 12 );
+
+    CHECK( wheel.advance( 1 ) == 1 );
+    CHECK( alarm.timeouts() == 1 );
+    CHECK( alarm.isInState( Alarm::S( &Alarm::idle, IDLE ) ) == 2 );
+    CHECK( !alarm.outer().armed() && !alarm.inner().armed() );
+
+    CHECK( wheel.advance( 100 ) == 0 );
+    CHECK( alarm.ticks() == 3 );
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+/// Timers are cancelled by a transition out of their state, by cancel()
+/// and as the machine goes.
+bool cancelled()
+{
+    Base::SmTimerWheel wheel;
+    Alarm::E           go( GO );
+    Alarm::E           leave( LEAVE );
+    Alarm::E           quiet( QUIET );
+    {
+        Alarm alarm( wheel );
+
+        wheel.advance( 2 );
+        CHECK( alarm.dispatch( &leave ) );
+        CHECK( !alarm.outer().armed() && !alarm.inner().armed() );
+        CHECK( wheel.advance( 20 ) == 0 );
+
+        // Armed again, relative to now.
+        CHECK( alarm.dispatch( &go ) );
+        CHECK( alarm.outer().deadline() == wheel.now() + 10 );
+
+        CHECK( alarm.dispatch( &quiet ) );
+        CHECK( !alarm.inner().armed() && alarm.outer().armed() );
+        CHECK( wheel.advance( 9 ) == 0 );
+        CHECK( alarm.ticks() == 0 );
+        CHECK( wheel.advance( 1 ) == 1 );
+        CHECK( alarm.timeouts() == 1 );
+
+        CHECK( alarm.dispatch( &go ) );
+        CHECK( alarm.outer().armed() && alarm.inner().armed() );
+    }
+    CHECK( wheel.advance( 1000 ) == 0 );
+    return true;
+}
+
+} // namespace
+
+//==============================================================================
+
+int main()
+{
+    bool ok = expiry();
+    ok = cancelled() && ok;
+
+    std::printf( "result=%s\n", ok ? "ok" : "fail" );
+    return ok ? 0 : 1;
+}
+
+//==============================================================================
@@ -0,0 +1,185 @@
+//=============================================- -*- C -*- ===================
+//
+// File Name     SmTraceDecode.c
+// Author        Tommy Carlsson (topcatse)
+//
+// Decoder of a dump written by smTraceDump(). Prints the records of all
+// threads merged in time order, one line each.
+//
+// Build and run:
+//   gcc -std=c99 -O2 -I.. SmTraceDecode.c -o SmTraceDecode
+//   ./SmTraceDecode <dump file>
+//
+// Time is in us since the first record. States are printed as their
+// declared id, or as #<hash> if not declared.
+//==============================================================================
+
+#include "SmTrace.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+   SmTraceRecord record;
+   uint32_t      thread;
+} Entry;
+
+//------------------------------------------------------------------------------
+
+static int Entry_compare( const void* a, const void* b )
+{
+   Entry const* x = a;
+   Entry const* y = b;
+
+   if ( x->record.time != y->record.time )
+   {
+      return x->record.time < y->record.time ? -1 : 1;
+   }
+   if ( x->thread != y->thread )
+   {
+      return x->thread < y->thread ? -1 : 1;
+   }
+   return x->record.seq < y->record.seq ? -1 : x->record.seq > y->record.seq;
+}
+
+//------------------------------------------------------------------------------
+
+static char const* state( uint16_t id, char* buffer )
+{
+   if ( id == SM_TRACE_NO_STATE )
+   {
+      return "-";
+   }
+
+   sprintf( buffer, id < 0x8000 ? "%u" : "#%04x", (unsigned)id );
+   return buffer;
+}
+
+//------------------------------------------------------------------------------
+
+static void print( Entry const* e, uint64_t start, double rate )
+{
+   SmTraceRecord const* r = &e->record;
+   uint64_t time = (uint64_t)( ( r->time - start ) * rate );
+   char     from[ 8 ];
+   char     to[ 8 ];
+
+   printf( "%8llu.%03llu thread=%u machine=0x%llx ",
+           (unsigned long long)( time / 1000 ),
+           (unsigned long long)( time % 1000 ),
+           (unsigned)e->thread,
+           (unsigned long long)r->machine );
+
+   switch ( r->event )
+   {
+      case SM_TRACE_OPEN:
+         printf( "open state=%s\n", state( r->next, to ) );
+         break;
+      case SM_TRACE_DISPATCH:
+         if ( r->kase == 0 )
+         {
+            printf( "dispatch signal=%u state=%s unhandled\n",
+                    (unsigned)r->signal, state( r->state, from ) );
+         }
+         else
+         {
+            printf( "dispatch signal=%u state=%s case=(%c) next=%s\n",
+                    (unsigned)r->signal, state( r->state, from ),
+                    r->kase, state( r->next, to ) );
+         }
+         break;
+      default:
+         printf( "event=%u\n", (unsigned)r->event );
+         break;
+   }
+}
+
+//==============================================================================
+
+int main( int argc, char* argv[] )
+{
+   if ( argc != 2 )
+   {
+      fprintf( stderr, "usage: %s <dump file>\n", argv[ 0 ] );
+      return 2;
+   }
+
+   FILE* file = fopen( argv[ 1 ], "rb" );
+   if ( file == 0 )
+   {
+      perror( argv[ 1 ] );
+      return 1;
+   }
+
+   SmTraceFileHeader header;
+   if ( fread( &header, sizeof( header ), 1, file ) != 1 ||
+        memcmp( header.magic, "SMTR", 4 ) != 0 ||
+        header.version != 1 ||
+        header.recordSize != sizeof( SmTraceRecord ) )
+   {
+      fprintf( stderr, "%s: not a trace dump\n", argv[ 1 ] );
+      fclose( file );
+      return 1;
+   }
+
+   Entry*   entries = 0;
+   size_t   count   = 0;
+   uint32_t i;
+
+   for ( i = 0; i < header.rings; ++i )
+   {
+      SmTraceRingHeader ring;
+      uint32_t          j;
+
+      if ( fread( &ring, sizeof( ring ), 1, file ) != 1 )
+      {
+         fprintf( stderr, "%s: truncated\n", argv[ 1 ] );
+         break;
+      }
+
+      Entry* more = realloc( entries, ( count + ring.count ) * sizeof( Entry ) );
+      if ( more == 0 && ring.count > 0 )
+      {
+         fprintf( stderr, "out of memory\n" );
+         break;
+      }
+      entries = more;
+
+      for ( j = 0; j < ring.count; ++j )
+      {
+         if ( fread( &entries[ count ].record, sizeof( SmTraceRecord ), 1,
+                     file ) != 1 )
+         {
+            fprintf( stderr, "%s: truncated\n", argv[ 1 ] );
+            break;
+         }
+         entries[ count++ ].thread = ring.thread;
+      }
+      if ( j < ring.count )
+      {
+         break;
+      }
+   }
+   fclose( file );
+
+   qsort( entries, count, sizeof( Entry ), Entry_compare );
+
+   // ns per tick.
+   double rate = 1.0;
+   if ( header.ticks[ 1 ] > header.ticks[ 0 ] )
+   {
+      rate = (double)( header.nanoseconds[ 1 ] - header.nanoseconds[ 0 ] ) /
+             (double)( header.ticks[ 1 ] - header.ticks[ 0 ] );
+   }
+
+   size_t n;
+   for ( n = 0; n < count; ++n )
+   {
+      print( &entries[ n ], entries[ 0 ].record.time, rate );
+   }
+
+   free( entries );
+   return 0;
+}
+
+//==============================================================================